@@ -27,9 +27,16 @@ typedef struct {
 typedef void (*oepl_display_driver_init_t)(const oepl_display_parameters_t* params);
 typedef void (*oepl_display_driver_draw_t)(void);
 
+// A driver implements either a blocking draw, or a split draw where the
+// (long-running) refresh in between draw_start and draw_finish is awaited
+// asynchronously by the caller through the BUSY line.
 typedef struct {
   oepl_display_driver_init_t init;
-  oepl_display_driver_draw_t draw;
+  oepl_display_driver_draw_t draw;          // Blocking draw, NULL if split draw is implemented
+  oepl_display_driver_draw_t draw_start;    // Upload the frame and issue the refresh command
+  oepl_display_driver_draw_t draw_finish;   // Put the display to sleep after refresh completed
+  size_t refresh_timeout_ms;                // Max expected refresh time, 0 = unknown
+  unsigned int refresh_idle_state;          // BUSY pin level signalling refresh completion
 } oepl_display_driver_desc_t;
 
 // -----------------------------------------------------------------------------
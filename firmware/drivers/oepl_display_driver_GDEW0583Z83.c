@@ -32,12 +32,13 @@
 //                          Static Function Declarations
 // -----------------------------------------------------------------------------
 static void display_init(const oepl_display_parameters_t* display_params);
-static void display_draw(void);
+static void display_draw_start(void);
+static void display_draw_finish(void);
 
 static void display_reset(void);
 static void display_reinit(void);
 static void display_sleep(void);
-static void display_refresh_and_wait(void);
+static void display_refresh(void);
 
 // -----------------------------------------------------------------------------
 //                                Global Variables
@@ -45,7 +46,10 @@ static void display_refresh_and_wait(void);
 const oepl_display_driver_desc_t oepl_display_driver_gdew0583z83 =
 {
   .init = &display_init,
-  .draw = &display_draw
+  .draw_start = &display_draw_start,
+  .draw_finish = &display_draw_finish,
+  .refresh_timeout_ms = 0,
+  .refresh_idle_state = true
 };
 
 // -----------------------------------------------------------------------------
@@ -72,12 +76,12 @@ static void display_init(const oepl_display_parameters_t* display_params)
   memcpy(params, display_params, sizeof(oepl_display_parameters_t));
 }
 
-static void display_draw(void)
+static void display_draw_start(void)
 {
   DPRINTF("enter GDEW0583Z83 draw\n");
   display_reinit();
 
-  uint8_t* linebuf = malloc(params->x_res_effective / 8);
+  uint8_t* linebuf = C_drawArenaAlloc(params->x_res_effective / 8);
 
   DPRINTF("Black:\n");
   oepl_display_driver_common_instruction(0x10, false);
@@ -111,9 +115,13 @@ static void display_draw(void)
     );
   }
 
-  free(linebuf);
+  C_drawArenaFree(linebuf);
 
-  display_refresh_and_wait();
+  display_refresh();
+}
+
+static void display_draw_finish(void)
+{
   display_sleep();
 }
 
@@ -141,7 +149,7 @@ static void display_sleep(void)
   oepl_display_driver_common_deactivate();
 }
 
-static void display_refresh_and_wait(void)
+static void display_refresh(void)
 {
   DPRINTF("Sending refresh\n");
   oepl_display_driver_wait(1);
@@ -150,7 +158,6 @@ static void display_refresh_and_wait(void)
   oepl_display_driver_wait_busy(0, true);
   EMIT_INSTRUCTION_NO_DATA(0x12);
   sl_udelay_wait(2000);
-  oepl_display_driver_wait_busy(0, true);
 }
 
 static void display_reinit(void)
@@ -76,13 +76,14 @@
 //                          Static Function Declarations
 // -----------------------------------------------------------------------------
 static void display_init(const oepl_display_parameters_t* params);
-static void display_draw(void);
+static void display_draw_start(void);
+static void display_draw_finish(void);
 
 static void display_reset(void);
 static void display_reinit(void);
 //static void display_clear_frame(void);
 static void display_sleep(void);
-static void display_refresh_and_wait(void);
+static void display_refresh(void);
 
 // -----------------------------------------------------------------------------
 //                                Global Variables
@@ -90,7 +91,10 @@ static void display_refresh_and_wait(void);
 const oepl_display_driver_desc_t oepl_display_driver_IL91874 =
 {
   .init = &display_init,
-  .draw = &display_draw
+  .draw_start = &display_draw_start,
+  .draw_finish = &display_draw_finish,
+  .refresh_timeout_ms = 0,
+  .refresh_idle_state = true
 };
 
 // -----------------------------------------------------------------------------
@@ -157,13 +161,13 @@ static void display_init(const oepl_display_parameters_t* params)
   oepl_display_driver_common_init();
 }
 
-static void display_draw(void)
+static void display_draw_start(void)
 {
   display_reinit();
 
   const uint8_t window_data[] = {0,0,0,0,EPD_WIDTH >> 8, EPD_WIDTH & 0xFF, EPD_HEIGHT >> 8, EPD_HEIGHT & 0xFF};
 
-  uint8_t* linebuf = malloc(EPD_WIDTH/8);
+  uint8_t* linebuf = C_drawArenaAlloc(EPD_WIDTH/8);
   if(linebuf == NULL) {
     oepl_hw_crash(DBG_DISPLAY, true, "Couldn't allocate linebuffer\n");
   }
@@ -191,8 +195,12 @@ static void display_draw(void)
     1, false, false
   );
 
-  free(linebuf);
-  display_refresh_and_wait();
+  C_drawArenaFree(linebuf);
+  display_refresh();
+}
+
+static void display_draw_finish(void)
+{
   display_sleep();
 }
 
@@ -243,11 +251,10 @@ static void display_sleep(void)
   oepl_display_driver_common_deactivate();
 }
 
-static void display_refresh_and_wait(void)
+static void display_refresh(void)
 {
   EMIT_INSTRUCTION_NO_DATA(DISPLAY_REFRESH);
   sl_udelay_wait(2000);
-  oepl_display_driver_wait_busy(0, true);
 }
 
 static void display_reinit(void)
@@ -10,6 +10,8 @@
 #include "sl_sleeptimer.h"
 #include "gpiointerrupt.h"
 #include "sl_power_manager.h"
+#include "em_core.h"
+#include "em_emu.h"
 #include "oepl_drawing_capi.h"
 
 // -----------------------------------------------------------------------------
@@ -19,6 +21,12 @@
 #define DISPLAY_COMMON_DEBUG_PRINT 1
 #endif
 
+// Size of each of the two buffers used to pipeline frame scans, taken from the
+// draw arena. As many lines as fit are coalesced into a single DMA transfer.
+#ifndef SCAN_PIPELINE_CHUNK_SIZE
+#define SCAN_PIPELINE_CHUNK_SIZE 512
+#endif
+
 // -----------------------------------------------------------------------------
 //                              Macros and Typedefs
 // -----------------------------------------------------------------------------
@@ -52,9 +60,17 @@ static void busyint_cb(uint8_t pin, void* ctx);
 static void busywait_timer_cb(sl_sleeptimer_timer_handle_t *handle, void *data);
 /// Internal callback for the busywait GPIO
 static void busywait_internal_cb(oepl_display_driver_common_event_t event);
+/// Internal callback for the asynchronous busywait, cleans up before notifying
+static void busywait_async_cb(oepl_display_driver_common_event_t event);
 
 // Callback function for SPI driver
 static void spicb(struct SPIDRV_HandleData *handle, Ecode_t transferStatus, int itemsTransferred);
+/// Callback function for SPI driver during pipelined frame scans
+static void scan_pipeline_cb(struct SPIDRV_HandleData *handle, Ecode_t transferStatus, int itemsTransferred);
+/// Wait for the pipelined transfer in flight, and finish it blocking if it failed
+static void scan_pipeline_wait(void);
+/// Render a scan line and copy the scanned part of it to dest
+static void scan_render_line(uint8_t* xbuf, size_t bufsize, size_t xstart, size_t xbytes, size_t line, int color, bool mirrorX, uint8_t* dest);
 
 // -----------------------------------------------------------------------------
 //                                Global Variables
@@ -69,6 +85,8 @@ static SPIDRV_Handle_t const handle = &handledata;
 
 static volatile oepl_display_driver_common_callback_t cb_after_busy = NULL;
 static volatile oepl_display_driver_common_callback_t cb_after_scan = NULL;
+/// Caller's callback for an ongoing asynchronous busywait
+static volatile oepl_display_driver_common_callback_t cb_after_busy_async = NULL;
 
 // Busywait timer is responsible for waking up the system periodically to check
 // the busy pin.
@@ -80,6 +98,14 @@ static scan_parameters_t scan_parameters = {
   .buf = NULL
 };
 
+/// Whether a pipelined scan DMA transfer is in flight
+static volatile bool scan_pipeline_busy = false;
+/// Buffer, length and outcome of the last pipelined transfer
+static const uint8_t* scan_pipeline_chunk = NULL;
+static size_t scan_pipeline_len = 0;
+static volatile Ecode_t scan_pipeline_status = ECODE_EMDRV_SPIDRV_OK;
+static volatile int scan_pipeline_sent = 0;
+
 // -----------------------------------------------------------------------------
 //                          Public Function Definitions
 // -----------------------------------------------------------------------------
@@ -346,34 +372,64 @@ void oepl_display_scan_frame_multi(uint8_t* xbuf, size_t bufsize, size_t xstart,
     oepl_hw_crash(DBG_DISPLAY, true, "No line buffer given!\n");
   }
 
-  uint8_t* swapbuf = malloc(bufsize);
-
-  if(swapbuf == NULL) {
-    oepl_hw_crash(DBG_DISPLAY, true, "Malloc ran out");
+  // Ping-pong buffers: one is being rendered into while DMA clocks out the other
+  size_t lines_per_chunk = SCAN_PIPELINE_CHUNK_SIZE / xbytes;
+  uint8_t* pipeline = NULL;
+  if(lines_per_chunk > 0) {
+    pipeline = C_getDrawScanBuffer(2 * lines_per_chunk * xbytes);
   }
 
-  uint8_t* outbuf = &xbuf[xstart];
+  _assert_data();
+  _assert_cs(cs_mask);
 
-  for(size_t line = ystart; line < ystart + ylines; line++) {
-    memset(xbuf, 0, bufsize);
-    if(mirrorY) {
-      C_renderDrawLine(xbuf, ystart + ylines - 1 - (line - ystart), color);
-    } else {
-      C_renderDrawLine(xbuf, line, color);
-    }
-    if(mirrorX) {
-      for(size_t i = 0; i < xbytes; i++) {
-        swapbuf[xbytes - 1 - i] = SL_RBIT8(xbuf[xstart + i]);
-        outbuf = swapbuf;
+  if(pipeline == NULL) {
+    // Lines too long for the pipeline or no room for it, render and send them one by one
+    for(size_t line = ystart; line < ystart + ylines; line++) {
+      size_t src_line = mirrorY ? ystart + ylines - 1 - (line - ystart) : line;
+      memset(xbuf, 0, bufsize);
+      C_renderDrawLine(xbuf, src_line, color);
+      if(mirrorX) {
+        // Reverse in place, swapping from both ends towards the middle
+        uint8_t* out = &xbuf[xstart];
+        for(size_t i = 0; i < (xbytes + 1) / 2; i++) {
+          uint8_t tmp = SL_RBIT8(out[i]);
+          out[i] = SL_RBIT8(out[xbytes - 1 - i]);
+          out[xbytes - 1 - i] = tmp;
+        }
       }
-    } else {
-      outbuf = &xbuf[xstart];
+      SPIDRV_MTransmitB(handle, &xbuf[xstart], xbytes);
     }
-    oepl_display_driver_common_data_multi(outbuf, xbytes, false, cs_mask);
+    _deassert_cs(cs_mask);
+    return;
   }
 
-  free(swapbuf);
+  size_t line = ystart;
+  size_t cur_chunk = 0;
+  while(line < ystart + ylines) {
+    uint8_t* chunk = &pipeline[cur_chunk * lines_per_chunk * xbytes];
+    size_t chunk_len = 0;
+
+    // Render the next set of lines while the previous set is being clocked out
+    for(size_t i = 0; i < lines_per_chunk && line < ystart + ylines; i++, line++) {
+      size_t src_line = mirrorY ? ystart + ylines - 1 - (line - ystart) : line;
+      scan_render_line(xbuf, bufsize, xstart, xbytes, src_line, color, mirrorX, &chunk[chunk_len]);
+      chunk_len += xbytes;
+    }
 
+    scan_pipeline_wait();
+    scan_pipeline_chunk = chunk;
+    scan_pipeline_len = chunk_len;
+    scan_pipeline_busy = true;
+    if(SPIDRV_MTransmit(handle, chunk, chunk_len, scan_pipeline_cb) != ECODE_EMDRV_SPIDRV_OK) {
+      scan_pipeline_busy = false;
+      DPRINTF("Scan DMA failed to start, sending blocking\n");
+      SPIDRV_MTransmitB(handle, chunk, chunk_len);
+    }
+    cur_chunk ^= 1;
+  }
+
+  scan_pipeline_wait();
+  _deassert_cs(cs_mask);
 }
 
 void oepl_display_scan_frame_async(uint8_t* xbuf, size_t bufsize, size_t xstart, size_t xbytes, size_t ystart, size_t ylines, int color, bool mirrorX, bool mirrorY, oepl_display_driver_common_callback_t cb_done)
@@ -500,19 +556,50 @@ void oepl_display_driver_wait_busy(size_t timeout_ms, unsigned int expected_pin_
   }
 
   uint32_t ms = sl_sleeptimer_tick_to_ms(sl_sleeptimer_get_tick_count() - start_ticks);
+  (void)ms;  // unused without debug prints
   DPRINTF("Display action executed in %d.%03d s\n", ms/1000, ms%1000);
 }
 
 void oepl_display_driver_wait_busy_async(oepl_display_driver_common_callback_t cb_idle, size_t timeout_ms, unsigned int expected_pin_state)
 {
+  switch(cfg->display->BUSY.port) {
+    case gpioPortA:
+      break;
+    case gpioPortB:
+      break;
+    default:
+      // Other ports can't generate interrupts from low power modes
+      sl_power_manager_add_em_requirement(SL_POWER_MANAGER_EM1);
+      break;
+  }
+
   pinstate_expected = expected_pin_state;
-  sl_sleeptimer_start_timer_ms(&busywait_timer_handle,
-                               timeout_ms,
-                               busywait_timer_cb,
-                               NULL, 0, SL_SLEEPTIMER_NO_HIGH_PRECISION_HF_CLOCKS_REQUIRED_FLAG);
-  cb_after_busy = cb_idle;
+  cb_after_busy_async = cb_idle;
+  cb_after_busy = busywait_async_cb;
+
+  if(timeout_ms) {
+    sl_status_t status = sl_sleeptimer_restart_timer_ms(
+                          &busywait_timer_handle,
+                          timeout_ms,
+                          busywait_timer_cb,
+                          NULL, 0, SL_SLEEPTIMER_NO_HIGH_PRECISION_HF_CLOCKS_REQUIRED_FLAG);
+    if(status != SL_STATUS_OK) {
+      DPRINTF("Couldn't start sleeptimer!!!\n");
+    }
+  }
+
   GPIO_IntClear(1<<(cfg->display->BUSY.pin));
   GPIO_IntEnable(1<<(cfg->display->BUSY.pin));
+
+  // The controller may have finished before we got to enable the interrupt,
+  // in which case there won't be an edge to trigger on.
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_ATOMIC();
+  if(cb_after_busy == busywait_async_cb &&
+     GPIO_PinInGet(cfg->display->BUSY.port, cfg->display->BUSY.pin) == expected_pin_state) {
+    busywait_async_cb(BUSY_DEASSERTED);
+  }
+  CORE_EXIT_ATOMIC();
 }
 
 // -----------------------------------------------------------------------------
@@ -542,6 +629,47 @@ static void busywait_internal_cb(oepl_display_driver_common_event_t event) {
   }
 }
 
+static void busywait_async_cb(oepl_display_driver_common_event_t event)
+{
+  oepl_display_driver_common_callback_t cb = cb_after_busy_async;
+
+  if(event == BUSY_TIMEOUT &&
+     GPIO_PinInGet(cfg->display->BUSY.port, cfg->display->BUSY.pin) != pinstate_expected) {
+    // Cold panels can take longer than the timeout. Let the caller know, but keep
+    // waiting for BUSY, and poll it in case the edge doesn't get detected.
+    DPRINTF("Display took longer than expected to clear busy\n");
+    sl_sleeptimer_restart_timer_ms(
+      &busywait_timer_handle,
+      500,
+      busywait_timer_cb,
+      NULL, 0, SL_SLEEPTIMER_NO_HIGH_PRECISION_HF_CLOCKS_REQUIRED_FLAG);
+    if(cb != NULL) {
+      cb(BUSY_TIMEOUT);
+    }
+    return;
+  }
+
+  // Tear down both wakeup sources, whichever of them fired first
+  sl_sleeptimer_stop_timer(&busywait_timer_handle);
+  GPIO_IntDisable(1<<(cfg->display->BUSY.pin));
+  GPIO_IntClear(1<<(cfg->display->BUSY.pin));
+  cb_after_busy = NULL;
+  cb_after_busy_async = NULL;
+  switch(cfg->display->BUSY.port) {
+    case gpioPortA:
+      break;
+    case gpioPortB:
+      break;
+    default:
+      sl_power_manager_remove_em_requirement(SL_POWER_MANAGER_EM1);
+      break;
+  }
+
+  if(cb != NULL) {
+    cb(event);
+  }
+}
+
 static void busywait_timer_cb(sl_sleeptimer_timer_handle_t *handle, void *data)
 {
   (void)handle;
@@ -551,6 +679,52 @@ static void busywait_timer_cb(sl_sleeptimer_timer_handle_t *handle, void *data)
   }
 }
 
+static void scan_render_line(uint8_t* xbuf, size_t bufsize, size_t xstart, size_t xbytes, size_t line, int color, bool mirrorX, uint8_t* dest)
+{
+  memset(xbuf, 0, bufsize);
+  C_renderDrawLine(xbuf, line, color);
+  if(mirrorX) {
+    for(size_t i = 0; i < xbytes; i++) {
+      dest[xbytes - 1 - i] = SL_RBIT8(xbuf[xstart + i]);
+    }
+  } else {
+    memcpy(dest, &xbuf[xstart], xbytes);
+  }
+}
+
+static void scan_pipeline_cb(struct SPIDRV_HandleData *handle, Ecode_t transferStatus, int itemsTransferred)
+{
+  (void)handle;
+  scan_pipeline_status = transferStatus;
+  scan_pipeline_sent = itemsTransferred;
+  scan_pipeline_busy = false;
+}
+
+static void scan_pipeline_wait(void)
+{
+  // Sleep in EM1 until the transfer is done. The flag is checked with interrupts
+  // disabled, and a completion in between stays pending and ends the sleep.
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_CRITICAL();
+  while(scan_pipeline_busy) {
+    EMU_EnterEM1();
+    CORE_EXIT_CRITICAL();
+    CORE_ENTER_CRITICAL();
+  }
+  CORE_EXIT_CRITICAL();
+
+  if(scan_pipeline_status != ECODE_EMDRV_SPIDRV_OK) {
+    // The other chunk is still intact, send what didn't make it out
+    size_t sent = scan_pipeline_sent > 0 ? (size_t)scan_pipeline_sent : 0;
+    DPRINTF("Scan DMA failed (%lx) after %d of %d bytes, sending the rest blocking\n",
+            (unsigned long)scan_pipeline_status, sent, scan_pipeline_len);
+    if(sent < scan_pipeline_len) {
+      SPIDRV_MTransmitB(handle, &scan_pipeline_chunk[sent], scan_pipeline_len - sent);
+    }
+    scan_pipeline_status = ECODE_EMDRV_SPIDRV_OK;
+  }
+}
+
 static void spicb(struct SPIDRV_HandleData *handle, Ecode_t transferStatus, int itemsTransferred)
 {
   (void)transferStatus;
@@ -561,6 +735,7 @@ static void spicb(struct SPIDRV_HandleData *handle, Ecode_t transferStatus, int
     scan_parameters.buf = NULL;
     cb_after_scan(SCAN_COMPLETE);
     sl_power_manager_remove_em_requirement(SL_POWER_MANAGER_EM1);
+    return;
   }
 
   _assert_data();
@@ -89,6 +89,8 @@ void oepl_display_scan_frame_async_multi(uint8_t* xbuf, size_t bufsize, size_t x
 
 void oepl_display_driver_wait(size_t timeout_ms);
 void oepl_display_driver_wait_busy(size_t timeout_ms, unsigned int expected_pin_state);
+// cb_idle gets BUSY_DEASSERTED once BUSY reaches expected_pin_state. Past timeout_ms it gets
+// BUSY_TIMEOUT, every 500 ms, while the wait goes on.
 void oepl_display_driver_wait_busy_async(oepl_display_driver_common_callback_t cb_idle, size_t timeout_ms, unsigned int expected_pin_state);
 
 #endif
\ No newline at end of file
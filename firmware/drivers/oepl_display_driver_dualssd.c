@@ -70,12 +70,13 @@
 //                          Static Function Declarations
 // -----------------------------------------------------------------------------
 static void display_init(const oepl_display_parameters_t* display_params);
-static void display_draw(void);
+static void display_draw_start(void);
+static void display_draw_finish(void);
 
 static void display_reset(void);
 static void display_reinit(void);
 static void display_sleep(void);
-static void display_refresh_and_wait(void);
+static void display_refresh(void);
 
 // -----------------------------------------------------------------------------
 //                                Global Variables
@@ -83,7 +84,10 @@ static void display_refresh_and_wait(void);
 const oepl_display_driver_desc_t oepl_display_driver_dualssd =
 {
   .init = &display_init,
-  .draw = &display_draw
+  .draw_start = &display_draw_start,
+  .draw_finish = &display_draw_finish,
+  .refresh_timeout_ms = 120000,
+  .refresh_idle_state = false
 };
 
 // -----------------------------------------------------------------------------
@@ -110,12 +114,12 @@ static void display_init(const oepl_display_parameters_t* display_params)
   memcpy(params, display_params, sizeof(oepl_display_parameters_t));
 }
 
-static void display_draw(void)
+static void display_draw_start(void)
 {
   DPRINTF("enter DualSSD draw\n");
   display_reinit();
 
-  uint8_t* linebuf = malloc(params->x_res_effective / 8);
+  uint8_t* linebuf = C_drawArenaAlloc(params->x_res_effective / 8);
 
   DPRINTF("Black 1:\n");
   oepl_display_driver_common_instruction(CMD_WRITE_FB_BW + CONTROLLER_ONE, true);
@@ -181,9 +185,13 @@ static void display_draw(void)
     );
   }
 
-  free(linebuf);
+  C_drawArenaFree(linebuf);
 
-  display_refresh_and_wait();
+  display_refresh();
+}
+
+static void display_draw_finish(void)
+{
   display_sleep();
 }
 
@@ -207,12 +215,11 @@ static void display_sleep(void)
   oepl_display_driver_common_deactivate();
 }
 
-static void display_refresh_and_wait(void)
+static void display_refresh(void)
 {
   DPRINTF("Sending refresh\n");
   EMIT_INSTRUCTION_NO_DATA(CMD_ACTIVATION);
   sl_udelay_wait(2000);
-  oepl_display_driver_wait_busy(120000, false);
 }
 
 static void display_reinit(void)
@@ -43,12 +43,13 @@
 //                          Static Function Declarations
 // -----------------------------------------------------------------------------
 static void display_init(const oepl_display_parameters_t* display_params);
-static void display_draw(void);
+static void display_draw_start(void);
+static void display_draw_finish(void);
 
 static void display_reset(void);
 static void display_reinit(void);
 static void display_sleep(void);
-static void display_refresh_and_wait(void);
+static void display_refresh(void);
 
 // -----------------------------------------------------------------------------
 //                                Global Variables
@@ -56,7 +57,10 @@ static void display_refresh_and_wait(void);
 const oepl_display_driver_desc_t oepl_display_driver_interleaved =
 {
   .init = &display_init,
-  .draw = &display_draw
+  .draw_start = &display_draw_start,
+  .draw_finish = &display_draw_finish,
+  .refresh_timeout_ms = 50000,
+  .refresh_idle_state = true
 };
 
 // -----------------------------------------------------------------------------
@@ -83,7 +87,7 @@ static void display_init(const oepl_display_parameters_t* display_params)
   memcpy(params, display_params, sizeof(oepl_display_parameters_t));
 }
 
-static void display_draw(void)
+static void display_draw_start(void)
 {
   DPRINTF("enter interleaved draw\n");
   display_reinit();
@@ -100,10 +104,10 @@ static void display_draw(void)
   // output bits = RW YW BW WW YY YY WW WW
   // i.e. x1y0 x0y0 x1y1 x0y1 etc
 
-  uint8_t* drawline_b = malloc(params->x_res_effective / 4);
-  uint8_t* drawline_r = malloc(params->x_res_effective / 4);
-  uint8_t* drawline_y = malloc(params->x_res_effective / 4);
-  uint8_t* outbuf = malloc(params->x_res_effective / 2);
+  uint8_t* drawline_b = C_drawArenaAlloc(params->x_res_effective / 4);
+  uint8_t* drawline_r = C_drawArenaAlloc(params->x_res_effective / 4);
+  uint8_t* drawline_y = C_drawArenaAlloc(params->x_res_effective / 4);
+  uint8_t* outbuf = C_drawArenaAlloc(params->x_res_effective / 2);
 
   if(drawline_b == NULL || drawline_r == NULL || drawline_y == NULL || outbuf == NULL) {
     oepl_hw_crash(DBG_DISPLAY, false, "Out of memory for rendering drawlines");
@@ -117,20 +121,20 @@ static void display_draw(void)
       memset(drawline_r, 0, params->x_res_effective / 4);
       memset(drawline_y, 0, params->x_res_effective / 4);
 
+      // Planes indexed by color: black, red, yellow
+      uint8_t* planes_lo[3] = {drawline_b, drawline_r, drawline_y};
+      uint8_t* planes_hi[3] = {
+        &drawline_b[params->x_res_effective / 8],
+        &drawline_r[params->x_res_effective / 8],
+        &drawline_y[params->x_res_effective / 8]
+      };
+
       if (params->mirrorV) {
-          C_renderDrawLine(drawline_b, params->y_res_effective - curY - 1, COLOR_BLACK);
-          C_renderDrawLine(drawline_r, params->y_res_effective - curY - 1, COLOR_RED);
-          C_renderDrawLine(drawline_y, params->y_res_effective - curY - 1, COLOR_YELLOW);
-          C_renderDrawLine(&drawline_b[params->x_res_effective / 8], params->y_res_effective - curY, COLOR_BLACK);
-          C_renderDrawLine(&drawline_r[params->x_res_effective / 8], params->y_res_effective - curY, COLOR_RED);
-          C_renderDrawLine(&drawline_y[params->x_res_effective / 8], params->y_res_effective - curY, COLOR_YELLOW);
+          C_renderDrawLinePlanes(params->y_res_effective - curY - 1, planes_lo, 3);
+          C_renderDrawLinePlanes(params->y_res_effective - curY, planes_hi, 3);
       } else {
-          C_renderDrawLine(&drawline_b[params->x_res_effective / 8], curY, COLOR_BLACK);
-          C_renderDrawLine(&drawline_r[params->x_res_effective / 8], curY, COLOR_RED);
-          C_renderDrawLine(&drawline_y[params->x_res_effective / 8], curY, COLOR_YELLOW);
-          C_renderDrawLine(drawline_b, curY + 1, COLOR_BLACK);
-          C_renderDrawLine(drawline_r, curY + 1, COLOR_RED);
-          C_renderDrawLine(drawline_y, curY + 1, COLOR_YELLOW);
+          C_renderDrawLinePlanes(curY, planes_hi, 3);
+          C_renderDrawLinePlanes(curY + 1, planes_lo, 3);
       }
 
       for (uint16_t x = 0; x < params->x_res_effective;) {
@@ -168,16 +172,20 @@ static void display_draw(void)
 
   DPRINTF("Rendering complete");
 
-  free(drawline_b);
-  free(drawline_r);
-  free(drawline_y);
-  free(outbuf);
+  C_drawArenaFree(drawline_b);
+  C_drawArenaFree(drawline_r);
+  C_drawArenaFree(drawline_y);
+  C_drawArenaFree(outbuf);
 
   EMIT_INSTRUCTION_NO_DATA(0x04);
   oepl_display_driver_wait_busy(5000, true);
   oepl_display_driver_wait(5);
 
-  display_refresh_and_wait();
+  display_refresh();
+}
+
+static void display_draw_finish(void)
+{
   display_sleep();
 
   DPRINTF("Display sleeping");
@@ -206,12 +214,11 @@ static void display_sleep(void)
   oepl_display_driver_common_deactivate();
 }
 
-static void display_refresh_and_wait(void)
+static void display_refresh(void)
 {
   DPRINTF("Sending refresh\n");
   EMIT_INSTRUCTION_STATIC_DATA(EPD_CMD_DISPLAY_REFRESH, {0x00});
   sl_udelay_wait(200);
-  oepl_display_driver_wait_busy(50000, true);
 }
 
 static void display_reinit(void)
@@ -43,12 +43,13 @@
 //                          Static Function Declarations
 // -----------------------------------------------------------------------------
 static void display_init(const oepl_display_parameters_t* display_params);
-static void display_draw(void);
+static void display_draw_start(void);
+static void display_draw_finish(void);
 
 static void display_reset(void);
 static void display_reinit(void);
 static void display_sleep(void);
-static void display_refresh_and_wait(void);
+static void display_refresh(void);
 
 // -----------------------------------------------------------------------------
 //                                Global Variables
@@ -56,7 +57,10 @@ static void display_refresh_and_wait(void);
 const oepl_display_driver_desc_t oepl_display_driver_jd =
 {
   .init = &display_init,
-  .draw = &display_draw
+  .draw_start = &display_draw_start,
+  .draw_finish = &display_draw_finish,
+  .refresh_timeout_ms = 50000,
+  .refresh_idle_state = true
 };
 
 // -----------------------------------------------------------------------------
@@ -83,7 +87,7 @@ static void display_init(const oepl_display_parameters_t* display_params)
   memcpy(params, display_params, sizeof(oepl_display_parameters_t));
 }
 
-static void display_draw(void)
+static void display_draw_start(void)
 {
   DPRINTF("enter JD draw\n");
   display_reinit();
@@ -92,10 +96,10 @@ static void display_draw(void)
   // of BWR displays which are fed two 1bpp frames. This means we need to render
   // the colors for each line and then merge them into a 2bpp encoded line.
 
-  uint8_t* drawline_b = malloc(params->x_res_effective / 8);
-  uint8_t* drawline_r = malloc(params->x_res_effective / 8);
-  uint8_t* drawline_y = malloc(params->x_res_effective / 8);
-  uint8_t* outbuf = malloc(params->x_res_effective / 4);
+  uint8_t* drawline_b = C_drawArenaAlloc(params->x_res_effective / 8);
+  uint8_t* drawline_r = C_drawArenaAlloc(params->x_res_effective / 8);
+  uint8_t* drawline_y = C_drawArenaAlloc(params->x_res_effective / 8);
+  uint8_t* outbuf = C_drawArenaAlloc(params->x_res_effective / 4);
 
   if(drawline_b == NULL || drawline_r == NULL || drawline_y == NULL || outbuf == NULL) {
     oepl_hw_crash(DBG_DISPLAY, false, "Out of memory for rendering drawlines");
@@ -109,14 +113,13 @@ static void display_draw(void)
       memset(drawline_r, 0, params->x_res_effective / 8);
       memset(drawline_y, 0, params->x_res_effective / 8);
 
+      // Planes indexed by color: black, red, yellow
+      uint8_t* planes[3] = {drawline_b, drawline_r, drawline_y};
+
       if (params->mirrorV) {
-          C_renderDrawLine(drawline_b, params->y_res_effective - curY - 1, COLOR_BLACK);
-          C_renderDrawLine(drawline_r, params->y_res_effective - curY - 1, COLOR_RED);
-          C_renderDrawLine(drawline_y, params->y_res_effective - curY - 1, COLOR_YELLOW);
+          C_renderDrawLinePlanes(params->y_res_effective - curY - 1, planes, 3);
       } else {
-          C_renderDrawLine(drawline_b, curY, COLOR_BLACK);
-          C_renderDrawLine(drawline_r, curY, COLOR_RED);
-          C_renderDrawLine(drawline_y, curY, COLOR_YELLOW);
+          C_renderDrawLinePlanes(curY, planes, 3);
       }
 
       for (uint16_t x = 0; x < params->x_res_effective;) {
@@ -143,12 +146,16 @@ static void display_draw(void)
 
   DPRINTF("Rendering complete");
 
-  free(drawline_b);
-  free(drawline_r);
-  free(drawline_y);
-  free(outbuf);
+  C_drawArenaFree(drawline_b);
+  C_drawArenaFree(drawline_r);
+  C_drawArenaFree(drawline_y);
+  C_drawArenaFree(outbuf);
+
+  display_refresh();
+}
 
-  display_refresh_and_wait();
+static void display_draw_finish(void)
+{
   display_sleep();
 
   DPRINTF("Display sleeping");
@@ -178,7 +185,7 @@ static void display_sleep(void)
   oepl_display_driver_common_deactivate();
 }
 
-static void display_refresh_and_wait(void)
+static void display_refresh(void)
 {
   if((params->x_res_effective == 168 && params->y_res_effective == 384) ||
      (params->x_res_effective == 184 && params->y_res_effective == 360) ||
@@ -196,7 +203,6 @@ static void display_refresh_and_wait(void)
   DPRINTF("Sending refresh\n");
   EMIT_INSTRUCTION_STATIC_DATA(EPD_CMD_DISPLAY_REFRESH, {0x00});
   sl_udelay_wait(2000);
-  oepl_display_driver_wait_busy(50000, true);
 }
 
 static void display_reinit(void)
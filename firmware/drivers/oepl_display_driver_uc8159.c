@@ -81,12 +81,13 @@
 //                          Static Function Declarations
 // -----------------------------------------------------------------------------
 static void display_init(const oepl_display_parameters_t* display_params);
-static void display_draw(void);
+static void display_draw_start(void);
+static void display_draw_finish(void);
 
 static void display_reset(void);
 static void display_reinit(void);
 static void display_sleep(void);
-static void display_refresh_and_wait(void);
+static void display_refresh(void);
 
 // -----------------------------------------------------------------------------
 //                                Global Variables
@@ -94,7 +95,10 @@ static void display_refresh_and_wait(void);
 const oepl_display_driver_desc_t oepl_display_driver_uc8159 =
 {
   .init = &display_init,
-  .draw = &display_draw
+  .draw_start = &display_draw_start,
+  .draw_finish = &display_draw_finish,
+  .refresh_timeout_ms = 0,
+  .refresh_idle_state = true
 };
 
 // -----------------------------------------------------------------------------
@@ -150,7 +154,7 @@ static void interleave_buffer(uint8_t *dst, uint8_t b, uint8_t r) {
   }
 }
 
-static void display_draw(void)
+static void display_draw_start(void)
 {
   DPRINTF("enter UC8179 draw\n");
   display_reinit();
@@ -158,9 +162,9 @@ static void display_draw(void)
   size_t blocksize = 16;
   size_t rowsize = params->x_res_effective / 8;
 
-  uint8_t* bw_buf = malloc(rowsize * blocksize);
-  uint8_t* r_buf = malloc(rowsize * blocksize);
-  uint8_t* interleaved_buf = malloc(rowsize * 4);
+  uint8_t* bw_buf = C_drawArenaAlloc(rowsize * blocksize);
+  uint8_t* r_buf = C_drawArenaAlloc(rowsize * blocksize);
+  uint8_t* interleaved_buf = C_drawArenaAlloc(rowsize * 4);
 
   if(bw_buf == NULL || r_buf == NULL || interleaved_buf == NULL) {
     oepl_hw_crash(DBG_DISPLAY, true, "Could not allocate display buffers\n");
@@ -171,11 +175,8 @@ static void display_draw(void)
     memset(r_buf, 0, rowsize * blocksize);
 
     for(size_t block_i = 0; block_i < blocksize; block_i++) {
-      C_renderDrawLine(bw_buf + (block_i * rowsize), block_i + cur_y, 0);
-    }
-
-    for(size_t block_i = 0; block_i < blocksize; block_i++) {
-      C_renderDrawLine(r_buf + (block_i * rowsize), block_i + cur_y, 1);
+      uint8_t* planes[2] = {bw_buf + (block_i * rowsize), r_buf + (block_i * rowsize)};
+      C_renderDrawLinePlanes(block_i + cur_y, planes, 2);
     }
 
     for(size_t block_i = 0; block_i < blocksize; block_i++) {
@@ -186,11 +187,15 @@ static void display_draw(void)
     }
   }
 
-  free(bw_buf);
-  free(r_buf);
-  free(interleaved_buf);
+  C_drawArenaFree(bw_buf);
+  C_drawArenaFree(r_buf);
+  C_drawArenaFree(interleaved_buf);
 
-  display_refresh_and_wait();
+  display_refresh();
+}
+
+static void display_draw_finish(void)
+{
   display_sleep();
 }
 
@@ -220,12 +225,11 @@ static void display_sleep(void)
   oepl_display_driver_common_deactivate();
 }
 
-static void display_refresh_and_wait(void)
+static void display_refresh(void)
 {
   DPRINTF("Sending refresh\n");
   EMIT_INSTRUCTION_NO_DATA(CMD_DISPLAY_REFRESH);
   sl_udelay_wait(2000);
-  oepl_display_driver_wait_busy(0, true);
 }
 
 static void display_reinit(void)
@@ -43,12 +43,13 @@
 //                          Static Function Declarations
 // -----------------------------------------------------------------------------
 static void display_init(const oepl_display_parameters_t* display_params);
-static void display_draw(void);
+static void display_draw_start(void);
+static void display_draw_finish(void);
 
 static void display_reset(void);
 static void display_reinit(void);
 static void display_sleep(void);
-static void display_refresh_and_wait(void);
+static void display_refresh(void);
 
 // -----------------------------------------------------------------------------
 //                                Global Variables
@@ -56,7 +57,10 @@ static void display_refresh_and_wait(void);
 const oepl_display_driver_desc_t oepl_display_driver_ucvar026 =
 {
   .init = &display_init,
-  .draw = &display_draw
+  .draw_start = &display_draw_start,
+  .draw_finish = &display_draw_finish,
+  .refresh_timeout_ms = 50000,
+  .refresh_idle_state = true
 };
 
 // -----------------------------------------------------------------------------
@@ -83,7 +87,7 @@ static void display_init(const oepl_display_parameters_t* display_params)
   memcpy(params, display_params, sizeof(oepl_display_parameters_t));
 }
 
-static void display_draw(void)
+static void display_draw_start(void)
 {
   DPRINTF("enter UC 2.6\" variant draw\n");
   display_reinit();
@@ -92,7 +96,7 @@ static void display_draw(void)
   const uint8_t dummy[] = {0};
   oepl_display_driver_common_data(dummy, sizeof(dummy), false);
 
-  uint8_t* linebuf = malloc(params->x_res_effective / 8);
+  uint8_t* linebuf = C_drawArenaAlloc(params->x_res_effective / 8);
 
   DPRINTF("Black:\n");
   oepl_display_driver_common_instruction(EPD_CMD_DISPLAY_START_TRANSMISSION_DTM1, true);
@@ -126,9 +130,13 @@ static void display_draw(void)
     );
   }
 
-  free(linebuf);
+  C_drawArenaFree(linebuf);
 
-  display_refresh_and_wait();
+  display_refresh();
+}
+
+static void display_draw_finish(void)
+{
   display_sleep();
 }
 
@@ -154,7 +162,7 @@ static void display_sleep(void)
   oepl_display_driver_common_deactivate();
 }
 
-static void display_refresh_and_wait(void)
+static void display_refresh(void)
 {
   DPRINTF("Sending refresh\n");
   EMIT_INSTRUCTION_NO_DATA(EPD_CMD_POWER_ON);
@@ -162,7 +170,6 @@ static void display_refresh_and_wait(void)
   oepl_display_driver_wait_busy(200, true);
   EMIT_INSTRUCTION_NO_DATA(EPD_CMD_DISPLAY_REFRESH);
   sl_udelay_wait(2000);
-  oepl_display_driver_wait_busy(50000, true);
 }
 
 static void display_reinit(void)
@@ -7,7 +7,10 @@
 #include "oepl_nvm.h"
 #include "oepl_led.h"
 #include "oepl_display.h"
+#include "oepl_drawing_capi.h"
+#include "oepl_flash_driver.h"
 #include "md5.h"
+#include "sl_sleeptimer.h"
 
 #include <stdio.h>
 #include <stddef.h>
@@ -22,12 +25,30 @@
 #define APP_DEBUG_PRINT 1
 #endif
 
+// Inflate compressed images into the raw layout once their download is confirmed, so
+// redraws don't have to decompress. Needs a spare image slot while it runs.
+#ifndef APP_TRANSCODE_COMPRESSED_IMAGES
+#define APP_TRANSCODE_COMPRESSED_IMAGES 0
+#endif
+
+// Stream image blocks into their slot while they're received, instead of assembling
+// them in a 4 KB RAM buffer first. Costs more retransmissions when parts get lost.
+#ifndef APP_STREAM_IMAGE_BLOCKS
+#define APP_STREAM_IMAGE_BLOCKS 0
+#endif
+
+// Consecutive block requests the radio may turn down before the download is abandoned,
+// and the pause before each retry, so they span a second instead of a few loop passes
+#define DATABLOCK_REQUEST_ATTEMPTS 10
+#define DATABLOCK_REQUEST_RETRY_MS 100
+
 #define EVENT_FLAG_BUTTON_1     (1 << 0)
 #define EVENT_FLAG_BUTTON_2     (1 << 1)
 #define EVENT_FLAG_GPIO         (1 << 2)
 #define EVENT_FLAG_NFC_WAKE     (1 << 3)
 #define EVENT_FLAG_CONNECTED    (1 << 4)
 #define EVENT_FLAG_DISCONNECTED (1 << 5)
+#define EVENT_FLAG_DATABLOCK_RETRY (1 << 6)
 
 // -----------------------------------------------------------------------------
 //                              Macros and Typedefs
@@ -78,6 +99,9 @@ static void application_state_transition(application_state_t new_state);
 static void application_mode_transition(application_mode_t new_mode);
 static void application_process_data(oepl_radio_data_indication_t* data);
 static void application_process_datablock(oepl_radio_blockrecv_t* block);
+static void application_request_next_datablock(void);
+static void datablock_retry_timer_cb(sl_sleeptimer_timer_handle_t *handle, void *data);
+static bool application_stream_image_bytes(size_t block_index, size_t offset, const uint8_t* data, size_t length);
 static bool application_check_md5(const uint8_t* data, size_t bytes, const uint8_t* reference);
 static void oepl_app_button_handler(oepl_hw_gpio_channel_t button, oepl_hw_gpio_event_t event);
 
@@ -87,6 +111,8 @@ static bool application_process_fwu_block(size_t index, const uint8_t* data, siz
 static bool application_process_config_block(size_t index, const uint8_t* data, size_t length, bool is_last);
 static bool application_process_nfcu_block(size_t index, const uint8_t* data, size_t length, bool is_last);
 static bool application_process_nfcr_block(size_t index, const uint8_t* data, size_t length, bool is_last);
+static void application_transcode_image(void);
+static bool application_write_transcoded_bytes(void* ctx, uint32_t offset, const uint8_t* data, size_t length);
 
 // -----------------------------------------------------------------------------
 //                                Global Variables
@@ -98,6 +124,21 @@ static bool application_process_nfcr_block(size_t index, const uint8_t* data, si
 static oepl_radio_data_indication_t data_to_process;
 static oepl_datablock_descriptor_t datablock_in_progress;
 static const uint8_t* datablock = NULL;
+// Set when the block in progress has been received. Streamed blocks are already in flash (datablock is NULL)
+static bool datablock_received = false;
+// Image slot which streamed blocks are written to
+static size_t datablock_stream_img_idx = 0;
+// Index of the next block to request, which runs one ahead of datablock_in_progress while a block is processed
+static size_t datablock_next_request = 0;
+static bool datablock_requested = false;
+// Block requests turned down by the radio in a row, retried when the retry timer fires
+static size_t datablock_request_failures = 0;
+static sl_sleeptimer_timer_handle_t datablock_retry_timer_handle;
+static volatile bool datablock_retry_waiting = false;
+// Compressed image download waiting to be transcoded, identified by its hash and size
+static bool transcode_pending = false;
+static uint64_t transcode_md5;
+static uint32_t transcode_size;
 
 static application_state_t current_state = BOOT;
 static bool stay_awake = false;
@@ -110,7 +151,8 @@ static volatile uint32_t event_flags = 0;
 // -----------------------------------------------------------------------------
 bool oepl_app_is_event_pending(void)
 {
-  return (event_flags != 0) || stay_awake;
+  return (event_flags != 0) || stay_awake ||
+         (transcode_pending && current_state == CONNECTED);
 }
 
 void oepl_app_init(void)
@@ -163,6 +205,11 @@ void oepl_app_process(void)
     oepl_radio_process();
   }
 
+  // Wrap up a display refresh which completed in the background
+  if(oepl_display_is_event_pending()) {
+    oepl_display_process();
+  }
+
   // Application event loop
   switch(current_state) {
     case BOOT:
@@ -170,9 +217,13 @@ void oepl_app_process(void)
       // either connected or orphaned
       break;
     case CONNECTED:
-      // Nothing to see here, waiting for the radio process to tell us we've
-      // got a pending action, or we've been disconnected due to the AP going
-      // AWOL.
+      // Waiting for the radio process to tell us we've got a pending action,
+      // or we've been disconnected due to the AP going AWOL. Meanwhile, the AP
+      // has had its confirmation, so there's time to transcode a download.
+      if(transcode_pending) {
+        transcode_pending = false;
+        application_transcode_image();
+      }
       break;
     case DATA_AVAILABLE:
       // Process the received data indication from the AP. This state will 
@@ -207,11 +258,19 @@ void oepl_app_process(void)
           oepl_nvm_status_t nvm_status = oepl_nvm_get_image_by_hash(
             data_to_process.AP_data.dataVer, data_to_process.AP_data.dataSize,
             &img_idx, &img_meta);
+          size_t bytes_received;
           if(nvm_status == NVM_SUCCESS) {
             // if regular image, display from cache if it is complete
             if(img_meta.is_valid) {
               DPRINTF("We have this one in cache...\n");
               application_state_transition(AWAITING_CONFIRMATION);
+            } else if(img_meta.image_format == data_to_process.AP_data.dataType &&
+                      img_meta.image_type == IMG_EXTTYPE_IMGID_FROM_EXTTYPE( data_to_process.AP_data.dataTypeArgument ) &&
+                      oepl_nvm_get_image_progress(img_idx, &bytes_received) == NVM_SUCCESS &&
+                      bytes_received > 0) {
+              // Part of this image made it to flash before, the download will pick up from there
+              DPRINTF("Continuing image ID 0x%x in slot 0x%x\n", img_meta.image_type, img_idx);
+              application_state_transition(DOWNLOAD);
             } else {
               // Something happened to the download of this image... erase and retry in the same slot
               oepl_nvm_erase_image(img_idx);
@@ -226,12 +285,12 @@ void oepl_app_process(void)
             }
           } else {
             // Allocate a slot
-            nvm_status = oepl_nvm_get_free_image_slot(&img_idx, IMG_EXTTYPE_IMGID_FROM_EXTTYPE( data_to_process.AP_data.dataTypeArgument ));
+            nvm_status = oepl_nvm_get_free_image_slot(&img_idx, IMG_EXTTYPE_IMGID_FROM_EXTTYPE( data_to_process.AP_data.dataTypeArgument ), true);
             if(nvm_status != NVM_SUCCESS) {
               // Out of slots for holding persistent images. Remove cached images (without removing most recent one) to try and alleviate.
               nvm_status = oepl_nvm_erase_image_cache(CUSTOM_IMAGE_NOCUSTOM);
               nvm_status = oepl_nvm_erase_image_cache(CUSTOM_IMAGE_SLIDESHOW);
-              nvm_status = oepl_nvm_get_free_image_slot(&img_idx, IMG_EXTTYPE_IMGID_FROM_EXTTYPE( data_to_process.AP_data.dataTypeArgument ));
+              nvm_status = oepl_nvm_get_free_image_slot(&img_idx, IMG_EXTTYPE_IMGID_FROM_EXTTYPE( data_to_process.AP_data.dataTypeArgument ), true);
             }
             if(nvm_status == NVM_SUCCESS) {
               oepl_stored_image_hdr_t img_meta;
@@ -335,6 +394,7 @@ void oepl_app_process(void)
             DPRINTF("Enter deepsleep\n");
             DPRINTF("To wake, press a button or power cycle\n");
             oepl_display_show_infoscreen(INFOSCREEN_DEEPSLEEP);
+            oepl_display_wait_idle();
             oepl_hw_enter_deepsleep();
             break;
           case CMD_DO_LEDFLASH:
@@ -425,6 +485,7 @@ void oepl_app_process(void)
             } else {
               DPRINTF("Applying upgrade...\n");
               oepl_display_show_infoscreen(INFOSCREEN_FWU);
+              oepl_display_wait_idle();
               oepl_fwu_apply();
               oepl_hw_crash(DBG_APP, true, "Failed to apply FWU\n");
             }
@@ -474,7 +535,14 @@ void oepl_app_process(void)
       application_state_transition(CONNECTED);
       break;
     case DOWNLOAD:
-      if(datablock != NULL)
+      // Have the radio receive the next block while this one is written to flash
+      application_request_next_datablock();
+      if(datablock_request_failures >= DATABLOCK_REQUEST_ATTEMPTS) {
+        DPRINTF("Radio keeps refusing block requests, abandoning download\n");
+        application_state_transition(CONNECTED);
+        break;
+      }
+      if(datablock_received)
       {
         size_t blocks_in_file = data_to_process.AP_data.dataSize / 4096;
         if(data_to_process.AP_data.dataSize % 4096 != 0) {
@@ -513,12 +581,16 @@ void oepl_app_process(void)
             oepl_hw_reboot();
         }
 
-        oepl_radio_release_datablock();
+        if(datablock != NULL) {
+          oepl_radio_release_datablock();
+          datablock = NULL;
+        }
+        datablock_received = false;
 
         if(!is_last_block && proceed) {
           datablock_in_progress.idx += 1;
-          datablock = NULL;
-          oepl_radio_request_datablock(datablock_in_progress);
+          // A request which was refused for lack of buffers can go out now
+          application_request_next_datablock();
         } else {
           application_state_transition(AWAITING_CONFIRMATION);
         }
@@ -583,6 +655,10 @@ void oepl_app_process(void)
       oepl_display_draw(NULL);
       event_flags &= ~EVENT_FLAG_DISCONNECTED;
     }
+    if(event_flags & EVENT_FLAG_DATABLOCK_RETRY) {
+      // The retry itself went out with the download state handling above
+      event_flags &= ~EVENT_FLAG_DATABLOCK_RETRY;
+    }
   }
 }
 
@@ -597,7 +673,7 @@ static oepl_radio_action_t radio_event_handler(oepl_radio_event_t event, const v
       DPRINTF("Associated on channel %ld!\n", (uint32_t)event_data);
       uint32_t prev_ch;
       oepl_nvm_setting_get(OEPL_LAST_CONNECTED_CHANNEL, &prev_ch, sizeof(uint32_t));
-      if(prev_ch != (uint32_t)event_data) {
+      if(prev_ch != (uint32_t)(uintptr_t)event_data) {
         oepl_nvm_setting_set(OEPL_LAST_CONNECTED_CHANNEL, &event_data, sizeof(uint32_t));
       }
       application_state_transition(CONNECTED);
@@ -645,7 +721,7 @@ static oepl_radio_action_t radio_event_handler(oepl_radio_event_t event, const v
       // channel number for fast-associate after reboot
       uint32_t prev_ch;
       oepl_nvm_setting_get(OEPL_LAST_CONNECTED_CHANNEL, &prev_ch, sizeof(uint32_t));
-      if(prev_ch != (uint32_t) event_data) {
+      if(prev_ch != (uint32_t)(uintptr_t) event_data) {
         oepl_nvm_setting_set(OEPL_LAST_CONNECTED_CHANNEL, &event_data, sizeof(uint32_t));
       }
       break;
@@ -679,6 +755,30 @@ static void application_state_transition(application_state_t new_state)
     return;
   }
 
+  if(current_state == DOWNLOAD) {
+    size_t rx_high_water, rx_dropped;
+    oepl_radio_get_rx_stats(&rx_high_water, &rx_dropped);
+    DPRINTF("RX queue: high water %d, %d dropped\n", rx_high_water, rx_dropped);
+
+    // Stop a block request which was sent ahead, and drop a block which wasn't processed
+    if(datablock_requested) {
+      oepl_radio_cancel_datablock();
+      datablock_requested = false;
+    }
+    if(datablock != NULL) {
+      oepl_radio_release_datablock();
+      datablock = NULL;
+    }
+    datablock_received = false;
+    datablock_request_failures = 0;
+    sl_sleeptimer_stop_timer(&datablock_retry_timer_handle);
+    datablock_retry_waiting = false;
+    oepl_radio_set_block_sink(NULL);
+
+    // Keep what was received so far for a later attempt at this download
+    oepl_nvm_save_download_progress();
+  }
+
   // Perform housekeeping on state transition
   switch(new_state) {
     case CONNECTED:
@@ -777,6 +877,31 @@ static void application_state_transition(application_state_t new_state)
           }
           break;
         }
+        case DATATYPE_IMG_RAW_1BPP:
+        case DATATYPE_IMG_RAW_2BPP:
+        case DATATYPE_IMG_ZLIB:
+        {
+          oepl_stored_image_hdr_t img_meta;
+          size_t img_idx, bytes_received;
+          datablock_in_progress.idx = 0;
+          if(oepl_nvm_get_image_by_hash(data_to_process.AP_data.dataVer, data_to_process.AP_data.dataSize,
+                                        &img_idx, &img_meta) == NVM_SUCCESS &&
+             oepl_nvm_get_image_progress(img_idx, &bytes_received) == NVM_SUCCESS) {
+            size_t blocks_in_file = data_to_process.AP_data.dataSize / 4096;
+            if(data_to_process.AP_data.dataSize % 4096) {
+              blocks_in_file++;
+            }
+            // Always (re)fetch the last block, since that's what completes the image
+            datablock_in_progress.idx = bytes_received / 4096;
+            if(datablock_in_progress.idx >= blocks_in_file) {
+              datablock_in_progress.idx = blocks_in_file - 1;
+            }
+            if(datablock_in_progress.idx > 0) {
+              DPRINTF("Resuming image download at block %d\n", datablock_in_progress.idx);
+            }
+          }
+          break;
+        }
         default:
           datablock_in_progress.idx = 0;
           break;
@@ -785,7 +910,28 @@ static void application_state_transition(application_state_t new_state)
       // Start the download if we still want to proceed
       if(new_state == DOWNLOAD) {
         datablock = NULL;
-        oepl_radio_request_datablock(datablock_in_progress);
+        datablock_received = false;
+        datablock_requested = false;
+        datablock_request_failures = 0;
+#if APP_STREAM_IMAGE_BLOCKS
+        switch(data_to_process.AP_data.dataType) {
+          case DATATYPE_IMG_RAW_1BPP:
+          case DATATYPE_IMG_RAW_2BPP:
+          case DATATYPE_IMG_ZLIB:
+          {
+            oepl_stored_image_hdr_t img_meta;
+            if(oepl_nvm_get_image_by_hash(data_to_process.AP_data.dataVer, data_to_process.AP_data.dataSize,
+                                          &datablock_stream_img_idx, &img_meta) == NVM_SUCCESS) {
+              oepl_radio_set_block_sink(application_stream_image_bytes);
+            }
+            break;
+          }
+          default:
+            break;
+        }
+#endif
+        datablock_next_request = datablock_in_progress.idx;
+        application_request_next_datablock();
       }
       break;
     default:
@@ -824,14 +970,64 @@ static void application_process_datablock(oepl_radio_blockrecv_t* block)
     oepl_hw_reboot();
   }
 
-  if(datablock != NULL) {
+  if(datablock_received) {
     DPRINTF("\n\nERR: not finished with the previous datablock\n\n");
     oepl_hw_reboot();
   }
 
+  datablock_requested = false;
+  datablock_received = true;
   datablock = block->block_data;
 }
 
+static void datablock_retry_timer_cb(sl_sleeptimer_timer_handle_t *handle, void *data)
+{
+  (void) handle;
+  (void) data;
+  datablock_retry_waiting = false;
+  event_flags |= EVENT_FLAG_DATABLOCK_RETRY;
+}
+
+static void application_request_next_datablock(void)
+{
+  size_t blocks_in_file = data_to_process.AP_data.dataSize / 4096;
+  if(data_to_process.AP_data.dataSize % 4096 != 0) {
+    blocks_in_file += 1;
+  }
+
+  // One request at a time. The radio's spare buffer limits us to one block ahead
+  // of the one being processed, so this also throttles on the flash writes.
+  if(datablock_requested || datablock_retry_waiting || datablock_next_request >= blocks_in_file) {
+    return;
+  }
+
+  oepl_datablock_descriptor_t next_block = datablock_in_progress;
+  next_block.idx = datablock_next_request;
+  if(oepl_radio_request_datablock(next_block) != SUCCESS) {
+    // Out of block buffers (back-pressure) or memory. A block we're holding retries the
+    // request once it's released, otherwise count it against the download and let the
+    // retry timer wake us up for the next attempt.
+    DPRINTF("Couldn't request block %d yet\n", next_block.idx);
+    if(!datablock_received) {
+      datablock_request_failures++;
+      datablock_retry_waiting = true;
+      sl_sleeptimer_start_timer_ms(&datablock_retry_timer_handle,
+                                   DATABLOCK_REQUEST_RETRY_MS,
+                                   datablock_retry_timer_cb,
+                                   NULL, 0, SL_SLEEPTIMER_NO_HIGH_PRECISION_HF_CLOCKS_REQUIRED_FLAG);
+    }
+    return;
+  }
+  datablock_request_failures = 0;
+  datablock_requested = true;
+  datablock_next_request++;
+}
+
+static bool application_stream_image_bytes(size_t block_index, size_t offset, const uint8_t* data, size_t length)
+{
+  return oepl_nvm_append_image_bytes(datablock_stream_img_idx, block_index * 4096 + offset, data, length) == NVM_SUCCESS;
+}
+
 static bool application_process_image_block(size_t index, const uint8_t* data, size_t length, bool is_last)
 {
   oepl_stored_image_hdr_t img_meta;
@@ -840,7 +1036,14 @@ static bool application_process_image_block(size_t index, const uint8_t* data, s
     data_to_process.AP_data.dataVer, data_to_process.AP_data.dataSize,
     &img_idx, &img_meta);
   if(nvm_status == NVM_SUCCESS) {
-    nvm_status = oepl_nvm_write_image_bytes(img_idx, index * 4096, data, length);
+    // Streamed blocks (without data) have been written while they were received
+    if(data != NULL) {
+      nvm_status = oepl_nvm_append_image_bytes(img_idx, index * 4096, data, length);
+    }
+    // The block passed its checksum, so what's in flash up to here counts as progress
+    if(nvm_status == NVM_SUCCESS) {
+      oepl_nvm_accept_image_bytes(img_idx, index * 4096 + length);
+    }
   } else {
     DPRINTF("App error: couldn't get image metadata for download in progress\n");
     return false;
@@ -853,35 +1056,23 @@ static bool application_process_image_block(size_t index, const uint8_t* data, s
   }
 
   if(is_last) {
-    MD5Context md5;
-    md5Init(&md5);
-
-    size_t img_blocks = img_meta.size / 4096;
-    if(img_meta.size % 4096) {
-      img_blocks++;
-    }
-
-    for(size_t i = 0; i < img_blocks; i++) {
-      size_t this_block_size = i == img_blocks - 1 ? img_meta.size % 4096 : 4096;
-      //Todo: do something about this cast?
-      // -> We know we're using the radio buffer here which is mutable...
-      memset(data, 0x12, this_block_size);
-      nvm_status = oepl_nvm_read_image_bytes(img_idx, i*4096, (uint8_t*)data, this_block_size);
-      if(nvm_status != NVM_SUCCESS) {
-        DPRINTF("Error reading image data from NVM\n");
-        return false;
-      }
-      DPRINTF("Feeding MD5 %d bytes\n", this_block_size);
-      md5Update(&md5, data, this_block_size);
+    nvm_status = oepl_nvm_check_image_md5(img_idx, img_meta.md5, img_meta.size);
+    if(nvm_status != NVM_SUCCESS && nvm_status != NVM_NOT_FOUND) {
+      DPRINTF("Error reading image data from NVM\n");
+      return false;
     }
-    md5Finalize(&md5);
-    if(memcmp(&md5.digest[0], &img_meta.md5, sizeof(img_meta.md5)) == 0) {
+    if(nvm_status == NVM_SUCCESS) {
       // Mark image download as valid
       DPRINTF("Image MD5 checks out\nMaking image of type 0x%x in slot 0x%x valid\n", img_meta.image_type, img_idx);
       img_meta.is_valid = true;
       nvm_status = oepl_nvm_write_image_metadata(img_idx, &img_meta);
       if(nvm_status != NVM_SUCCESS) {
         DPRINTF("Error making image valid\n");
+      } else if(APP_TRANSCODE_COMPRESSED_IMAGES && img_meta.image_format == DATATYPE_IMG_ZLIB) {
+        // Inflating takes a while, so leave it until the download has been confirmed
+        transcode_pending = true;
+        transcode_md5 = img_meta.md5;
+        transcode_size = img_meta.size;
       }
       return false;
     } else {
@@ -898,6 +1089,54 @@ static bool application_process_image_block(size_t index, const uint8_t* data, s
   }
 }
 
+static void application_transcode_image(void)
+{
+  // The image may have been replaced or erased since its download finished
+  oepl_stored_image_hdr_t img_meta;
+  size_t img_idx;
+  if(oepl_nvm_get_image_by_hash(transcode_md5, transcode_size, &img_idx, &img_meta) != NVM_SUCCESS ||
+     !img_meta.is_valid) {
+    DPRINTF("Image to transcode is gone\n");
+    return;
+  }
+
+  // Flash can't be rewritten in place, so inflate into a spare slot and retire the
+  // compressed one afterwards. Without a spare slot, the image stays compressed.
+  size_t num_slots, slot_size, raw_idx;
+  uint32_t img_addr;
+  if(oepl_nvm_get_num_img_slots(&num_slots, &slot_size) != NVM_SUCCESS ||
+     oepl_nvm_get_image_raw_address(img_idx, &img_addr) != NVM_SUCCESS ||
+     oepl_nvm_get_free_image_slot(&raw_idx, img_meta.image_type, false) != NVM_SUCCESS) {
+    DPRINTF("No spare slot to transcode image in slot 0x%x\n", img_idx);
+    return;
+  }
+
+  oepl_stored_image_hdr_t raw_meta = img_meta;
+  if(!C_inflateFlashImage(img_addr, img_meta.size, slot_size, &raw_meta.image_format,
+                          application_write_transcoded_bytes, &raw_idx)) {
+    DPRINTF("Keeping image in slot 0x%x compressed\n", img_idx);
+    oepl_nvm_erase_image(raw_idx);
+    return;
+  }
+
+  // Keep the hash and size of the download, so the AP's announcements still match the image
+  raw_meta.is_valid = true;
+  if(oepl_nvm_write_image_metadata(raw_idx, &raw_meta) != NVM_SUCCESS) {
+    DPRINTF("Error making transcoded image valid\n");
+    oepl_nvm_erase_image(raw_idx);
+    return;
+  }
+
+  DPRINTF("Transcoded image from slot 0x%x into slot 0x%x as type 0x%x\n", img_idx, raw_idx, raw_meta.image_format);
+  oepl_display_image_moved(img_idx, raw_idx);
+  oepl_nvm_erase_image(img_idx);
+}
+
+static bool application_write_transcoded_bytes(void* ctx, uint32_t offset, const uint8_t* data, size_t length)
+{
+  return oepl_nvm_write_image_bytes(*(size_t*)ctx, offset, data, length) == NVM_SUCCESS;
+}
+
 static bool application_process_fwu_block(size_t index, const uint8_t* data, size_t length, bool is_last)
 {
   (void) is_last;
@@ -914,7 +1153,7 @@ static bool application_check_md5(const uint8_t* data, size_t bytes, const uint8
 {
   MD5Context md5;
   md5Init(&md5);
-  md5Update(&md5, data, bytes);
+  md5Update(&md5, (uint8_t*)data, bytes);
   md5Finalize(&md5);
   if(memcmp(&md5.digest[0], reference, 8) == 0) {
     return true;
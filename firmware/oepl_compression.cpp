@@ -1,5 +1,6 @@
 #include "oepl_compression.hpp"
 #include <vector>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -7,9 +8,18 @@
 extern "C" {
 #include "oepl_flash_driver.h"
 }
+// Stream buffers come out of the drawing engine's per-frame arena
+#include "oepl_drawing_capi.h"
 
 std::vector<decompress *> decompContexts;
 
+// Seek points store the context up to the trees, and the trees only when a block needs them
+static_assert(offsetof(struct uzlib_uncomp, dtree) == offsetof(struct uzlib_uncomp, ltree) + sizeof(TINF_TREE),
+              "seek points expect the trees at the end of the uzlib context");
+static_assert(offsetof(struct uzlib_uncomp, dtree) + sizeof(TINF_TREE) == sizeof(struct uzlib_uncomp),
+              "seek points expect the trees at the end of the uzlib context");
+#define SEEK_POINT_CTX_SIZE offsetof(struct uzlib_uncomp, ltree)
+
 int decompCallback(TINF_DATA *d) {
     // in the callback for uzlib we'll get a uzlib context from which it originates
     for (uint8_t i = 0; i < decompContexts.size(); i++) {
@@ -30,7 +40,7 @@ decompress::decompress() {
     decompContexts.push_back(this);
 
     // allocate decompressed data cache
-    this->outCache = (uint8_t *)malloc(OUT_CACHE_SIZE);
+    this->outCache = (uint8_t *)C_drawArenaAlloc(OUT_CACHE_SIZE);
 }
 
 void decompress::seek(uint32_t address) {
@@ -38,6 +48,8 @@ void decompress::seek(uint32_t address) {
 }
 
 bool decompress::readHeader() {
+    if (this->codec == CODEC_HEATSHRINK) return this->readHeatshrinkHeader();
+
     uzlib_init();
 
     // read the window size from the zlib header
@@ -63,32 +75,37 @@ bool decompress::readHeader() {
     }
 
     // window = 8192;
+    this->windowSize = window;
 
     // allocate dict/window if not already allocated
-    if (!this->dictionary) this->dictionary = (uint8_t *)malloc(window);
+    if (!this->dictionary) this->dictionary = (uint8_t *)C_drawArenaAlloc(window);
     if (!this->dictionary) printf("FS: window malloc failed\n");
 
     uzlib_uncompress_init(this->ctx, this->dictionary, window);
     return true;
 }
 
-bool decompress::openFromFlash(uint32_t eepBase, uint32_t cSize) {
+bool decompress::openFromFlash(uint32_t eepBase, uint32_t cSize, uint8_t codec) {
+    this->codec = codec;
     this->setupContext();
-    this->ctx->source_read_cb = decompCallback;
+    if (this->ctx) this->ctx->source_read_cb = decompCallback;
     this->compressedPos += ZLIB_CACHE_SIZE;
     this->compressedSize = cSize - 4;
     this->eepromBase = eepBase;
     HAL_flashRead(this->eepromBase, (uint8_t *)&this->decompressedSize, 4);
     HAL_flashRead(this->eepromBase + 4, this->compBuffer, ZLIB_CACHE_SIZE);
+
+    this->resetSeekPoints();
     this->fromFile = false;
     return this->readHeader();
 }
 
 void decompress::setupContext() {
-    if (!this->ctx) this->ctx = new struct uzlib_uncomp;
-    if (!this->compBuffer) this->compBuffer = (uint8_t *)malloc(ZLIB_CACHE_SIZE);
-    this->ctx->source = this->compBuffer;
-    this->ctx->source_limit = this->compBuffer + ZLIB_CACHE_SIZE;
+    // heatshrink keeps its few bytes of state in hs, only zlib needs the uzlib context
+    if (!this->ctx && this->codec == CODEC_ZLIB) this->ctx = new struct uzlib_uncomp;
+    if (!this->compBuffer) this->compBuffer = (uint8_t *)C_drawArenaAlloc(ZLIB_CACHE_SIZE);
+    this->source() = this->compBuffer;
+    this->sourceLimit() = this->compBuffer + ZLIB_CACHE_SIZE;
     compressedPos = 0;
     decompressedPos = 0;
     cacheStart = 0;
@@ -96,17 +113,22 @@ void decompress::setupContext() {
 }
 
 decompress::~decompress() {
+#ifdef DEBUG_COMPRESSION
+    printf("FS: Inflated %lu bytes, %d seek points in %lu bytes\n", (unsigned long)this->inflatedBytes, this->seekPointCount, (unsigned long)this->seekPoolUsed);
+#endif
+    if (this->seekPool) C_drawArenaFree(this->seekPool);
+    this->seekPool = nullptr;
     for (uint8_t i = 0; i < decompContexts.size(); i++) {
         if (decompContexts.at(i) == this)
             decompContexts.erase(decompContexts.begin() + i);
     }
-    if (this->dictionary) free(this->dictionary);
+    if (this->dictionary) C_drawArenaFree(this->dictionary);
     this->dictionary = nullptr;
     if (this->ctx) delete this->ctx;
     this->ctx = nullptr;
-    if (this->compBuffer) free(this->compBuffer);
+    if (this->compBuffer) C_drawArenaFree(this->compBuffer);
     this->compBuffer = nullptr;
-    if (this->outCache) free(this->outCache);
+    if (this->outCache) C_drawArenaFree(this->outCache);
     this->outCache = nullptr;
 }
 
@@ -115,80 +137,454 @@ int decompress::getNextCompressedBlockFromFlash() {
     if (bytesLeft <= 0) return -1;
     if (bytesLeft > ZLIB_CACHE_SIZE) bytesLeft = ZLIB_CACHE_SIZE;
     HAL_flashRead(this->eepromBase + 4 + compressedPos, this->compBuffer, bytesLeft);
-    ctx->source = this->compBuffer + 1;
-    ctx->source_limit = this->compBuffer + bytesLeft;
+    this->source() = this->compBuffer + 1;
+    this->sourceLimit() = this->compBuffer + bytesLeft;
     this->compressedPos += bytesLeft;
     return this->compBuffer[0];
 }
 
-uint32_t decompress::getBlock(uint32_t address, uint8_t *target, uint32_t len) {
+const uint8_t *decompress::getSpan(uint32_t address, uint32_t len) {
+    if (len > OUT_CACHE_SIZE) return nullptr;
+    if (address + len > decompressedSize) return nullptr;
+
     // check if we have the requested block of data in cache
-    if (address >= cacheStart) {
-        if ((address + len) <= (cacheStart + cacheLen)) {
-            memcpy(target, (this->outCache) + (address - cacheStart), len);
-            // cache hit, copy cache to target
-            return len;
-        }
+    if ((address >= cacheStart) && ((address + len) <= (cacheStart + cacheLen))) {
+        return (this->outCache) + (address - cacheStart);
+    }
+
+    // A span that starts in the cache and runs past its end, as rows do on a forward scan:
+    // keep the part that's there and inflate the rest behind it instead of seeking back
+    if ((address >= cacheStart) && (address < cacheStart + cacheLen) && (cacheStart + cacheLen == this->decompressedPos)) {
+        uint32_t kept = this->decompressedPos - address;
+        uint32_t bufferEnd = address + OUT_CACHE_SIZE;
+        if (bufferEnd > this->decompressedSize) bufferEnd = this->decompressedSize;
+        memmove(this->outCache, this->outCache + (address - cacheStart), kept);
+        this->inflate(this->outCache + kept, bufferEnd - this->decompressedPos);
+        this->cacheStart = address;
+        this->cacheLen = bufferEnd - address;
+        return this->outCache;
     }
 
-    if (address + len > decompressedSize) return 0;
     if (address < this->decompressedPos) {
-        // reload file, start from scratch
-        this->ctx->source = this->compBuffer;
-        compressedPos = 0;
-        decompressedPos = 0;
-        this->getNextCompressedBlockFromFlash();
-        this->ctx->source = this->compBuffer;
-        this->readHeader();
+        // The stream is read backwards, start taking seek points from here on. The pass
+        // from the start below is the only one that has to inflate the whole way up
+        if (!this->seekPool && !this->seekPoolFailed) this->allocSeekPool();
+
+        // resume from the closest seek point, or reload file and start from scratch
+        if (!this->restoreSeekPoint(address)) {
+            this->source() = this->compBuffer;
+            compressedPos = 0;
+            decompressedPos = 0;
+            this->getNextCompressedBlockFromFlash();
+            this->source() = this->compBuffer;
+            this->readHeader();
+        }
     }
 
     uint32_t bufferStart = (address + len) - OUT_CACHE_SIZE;
-    uint32_t bufferEnd;
 
     // don't read from before the start if a low address is requested
     if (bufferStart > 512000) bufferStart = 0;
 
-    // don't start reading data that starts before the current pointer
-    if (bufferStart < this->decompressedPos) {
-        bufferStart = this->decompressedPos;
-        bufferEnd = bufferStart + len;
-    } else {
-        bufferEnd = bufferStart + OUT_CACHE_SIZE;
-    }
+    // don't start reading data that starts before the current pointer. The request always
+    // ends within a full cache from there, so fill all of it and read ahead for the next call
+    if (bufferStart < this->decompressedPos) bufferStart = this->decompressedPos;
+    uint32_t bufferEnd = bufferStart + OUT_CACHE_SIZE;
     if (bufferEnd > this->decompressedSize) bufferEnd = this->decompressedSize;
 
     // skip to the next part of the output stream
-    if (bufferStart != decompressedPos) {
-        while (this->decompressedPos < bufferStart) {
-            uint32_t readBytes = bufferStart - decompressedPos;
-            if (readBytes > OUT_CACHE_SIZE) readBytes = OUT_CACHE_SIZE;
-            decompressedPos += readBytes;
-            this->ctx->dest = this->outCache;
-            ctx->dest_start = ctx->dest;
-            ctx->dest_limit = ctx->dest + readBytes;
-            uzlib_uncompress(ctx);
-        }
+    while (this->decompressedPos < bufferStart) {
+        uint32_t readBytes = bufferStart - decompressedPos;
+        if (readBytes > OUT_CACHE_SIZE) readBytes = OUT_CACHE_SIZE;
+        this->inflate(this->outCache, readBytes);
     }
 
-    uint32_t bytesLeft = this->decompressedSize - this->decompressedPos;
-    if (len > bytesLeft) len = bytesLeft;
-
-    this->ctx->dest = (unsigned char *)this->outCache;
-    ctx->dest_start = ctx->dest;
-    ctx->dest_limit = ctx->dest + (bufferEnd - bufferStart);
-
-    uzlib_uncompress(ctx);
+    this->inflate(this->outCache, bufferEnd - bufferStart);
 
-    // save cache metadata
+    // save cache metadata. The window starts at or before the address and ends at or after
+    // address + len, so the whole span is contiguous in the cache
     this->cacheLen = bufferEnd - bufferStart;
     this->cacheStart = bufferStart;
 
-    this->decompressedPos += (bufferEnd - bufferStart);
-    return this->getBlock(address, target, len);
+    return (this->outCache) + (address - cacheStart);
+}
+
+uint32_t decompress::getBlock(uint32_t address, uint8_t *target, uint32_t len) {
+    // copy in cache sized pieces, so requests larger than the cache work too
+    for (uint32_t done = 0; done < len;) {
+        uint32_t part = len - done;
+        if (part > OUT_CACHE_SIZE) part = OUT_CACHE_SIZE;
+        const uint8_t *span = this->getSpan(address + done, part);
+        if (span == nullptr) return 0;
+        memcpy(target + done, span, part);
+        done += part;
+    }
+    return len;
 }
 
 uint8_t decompress::readByte(uint32_t address) {
-    uint8_t a;
+    uint8_t a = 0;
     this->getBlock(address, &a, 1);
     return a;
 }
+
+void decompress::inflate(uint8_t *dest, uint32_t len) {
+    while (len) {
+        uint32_t chunk = len;
+        bool atSeekPoint = false;
+
+        // stop exactly on the next seek point boundary so the state can be saved there
+        if (this->seekPool) {
+            uint32_t nextSeekPoint = this->seekBase;
+            if (this->decompressedPos >= this->seekBase) nextSeekPoint += (((this->decompressedPos - this->seekBase) / this->seekInterval) + 1) * this->seekInterval;
+            if (this->decompressedPos + chunk >= nextSeekPoint) {
+                chunk = nextSeekPoint - this->decompressedPos;
+                atSeekPoint = true;
+            }
+        }
+
+        if (this->codec == CODEC_HEATSHRINK) {
+            this->unshrink(dest, chunk);
+        } else {
+            ctx->dest = dest;
+            ctx->dest_start = ctx->dest;
+            ctx->dest_limit = ctx->dest + chunk;
+            uzlib_uncompress(ctx);
+        }
+
+        this->decompressedPos += chunk;
+        this->inflatedBytes += chunk;
+        dest += chunk;
+        len -= chunk;
+
+        if (atSeekPoint) this->saveSeekPoint();
+    }
+}
+
+void decompress::setSeekRows(uint32_t start, uint16_t rowBytes) {
+    if (this->seekPointCount || rowBytes == 0) return;
+    uint16_t rows = OUT_CACHE_SIZE / rowBytes;
+    if (rows == 0) rows = 1;
+    this->seekBase = start;
+    this->seekInterval = rows * rowBytes;
+}
+
+bool decompress::allocSeekPool() {
+    // Share what the arena has left between the streams that don't have a pool yet
+    uint8_t streams = 0;
+    for (uint8_t i = 0; i < decompContexts.size(); i++) {
+        if (!decompContexts.at(i)->seekPool && !decompContexts.at(i)->seekPoolFailed) streams++;
+    }
+    size_t avail = C_getDrawArenaFree();
+    size_t size = (avail > SEEK_POOL_RESERVE) ? (avail - SEEK_POOL_RESERVE) / (streams ? streams : 1) : 0;
+    if (size > SEEK_POOL_MAX_SIZE) size = SEEK_POOL_MAX_SIZE;
+    size &= ~(size_t)3;
+    if (size >= SEEK_POOL_MIN_SIZE) this->seekPool = (uint8_t *)C_drawArenaAlloc(size);
+    if (!this->seekPool) {
+#ifdef DEBUG_COMPRESSION
+        printf("FS: No room for seek points, %lu bytes free\n", (unsigned long)avail);
+#endif
+        // this stream will restart from the beginning on every backward seek
+        this->seekPoolFailed = true;
+        return false;
+    }
+    this->seekPoolSize = size;
+    this->seekTreesStart = size;
+    return true;
+}
+
+// Run-length coding for the window, the same as PackBits: a control byte below 128 is followed
+// by that many plus one literals, one from 128 up repeats the next byte control - 125 times
+static uint32_t packWindow(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t room) {
+    uint32_t in = 0;
+    uint32_t out = 0;
+    while (in < len) {
+        uint32_t run = 1;
+        while (in + run < len && run < 130 && src[in + run] == src[in]) run++;
+        if (run >= 3) {
+            if (out + 2 > room) return 0;
+            dst[out++] = run + 125;
+            dst[out++] = src[in];
+            in += run;
+            continue;
+        }
+
+        // literals up to the next run of three
+        uint32_t literals = 0;
+        while (in + literals < len && literals < 128) {
+            const uint8_t *p = &src[in + literals];
+            if (in + literals + 2 < len && p[0] == p[1] && p[0] == p[2]) break;
+            literals++;
+        }
+        if (out + 1 + literals > room) return 0;
+        dst[out++] = literals - 1;
+        memcpy(&dst[out], &src[in], literals);
+        out += literals;
+        in += literals;
+    }
+    return out;
+}
+
+static void unpackWindow(const uint8_t *src, uint8_t *dst, uint32_t len) {
+    uint32_t out = 0;
+    while (out < len) {
+        uint8_t control = *src++;
+        if (control < 128) {
+            memcpy(&dst[out], src, control + 1);
+            src += control + 1;
+            out += control + 1;
+        } else {
+            memset(&dst[out], *src++, control - 125);
+            out += control - 125;
+        }
+    }
+}
+
+// A tree only uses as many entries of trans as it has codes
+static uint16_t treeSize(const TINF_TREE *tree) {
+    uint16_t codes = 0;
+    for (uint8_t i = 0; i < 16; i++) codes += tree->table[i];
+    if (codes > 288) codes = 288;
+    return sizeof(tree->table) + (codes * sizeof(tree->trans[0]));
+}
+
+// Stores the trees of the current block at the top of the pool, or finds them there if the
+// last point was taken in the same block. Returns their offset, or 0 if they don't fit
+uint16_t decompress::saveSeekTrees() {
+    uint16_t ltreeSize = treeSize(&this->ctx->ltree);
+    uint16_t dtreeSize = treeSize(&this->ctx->dtree);
+    if (this->seekTreesStart < this->seekPoolSize) {
+        const uint8_t *p = &this->seekPool[this->seekTreesStart];
+        if (memcmp(p, &this->ctx->ltree, ltreeSize) == 0 && memcmp(p + ltreeSize, &this->ctx->dtree, dtreeSize) == 0) {
+            return this->seekTreesStart;
+        }
+    }
+
+    uint32_t size = (ltreeSize + dtreeSize + 3) & ~3;
+    if (this->seekTreesStart < this->seekPoolUsed + size + sizeof(struct seekPoint)) return 0;
+    this->seekTreesStart -= size;
+    memcpy(&this->seekPool[this->seekTreesStart], &this->ctx->ltree, ltreeSize);
+    memcpy(&this->seekPool[this->seekTreesStart + ltreeSize], &this->ctx->dtree, dtreeSize);
+    return this->seekTreesStart;
+}
+
+bool decompress::saveSeekPoint() {
+    if (!this->dictionary || this->decompressedPos >= this->decompressedSize) return false;
+
+    // don't take points again when going over a part of the stream that's covered already
+    if (this->seekPointCount) {
+        uint32_t last = 0;
+        for (uint32_t offset = 0; offset < this->seekPoolUsed; offset += ((struct seekPoint *)&this->seekPool[offset])->size) {
+            last = ((struct seekPoint *)&this->seekPool[offset])->decompressedPos;
+        }
+        if (this->decompressedPos <= last) return false;
+    }
+
+    // trees are only live inside a huffman coded block
+    bool hasTrees = (this->codec == CODEC_ZLIB) && (this->ctx->btype == 1 || this->ctx->btype == 2);
+    uint32_t ctxSize = (this->codec == CODEC_ZLIB) ? SEEK_POINT_CTX_SIZE : 0;
+    uint32_t fixedSize = sizeof(struct seekPoint) + ctxSize;
+
+    while (true) {
+        uint16_t trees = hasTrees ? this->saveSeekTrees() : 0;
+
+        // the pool and the points in it are whole words, so the padding always fits
+        uint32_t room = this->seekTreesStart - this->seekPoolUsed;
+        uint32_t windowBytes = 0;
+        if ((trees || !hasTrees) && room > fixedSize) {
+            windowBytes = packWindow(this->dictionary, this->windowSize, &this->seekPool[this->seekPoolUsed + fixedSize], room - fixedSize);
+        }
+        if (windowBytes) {
+            struct seekPoint *sp = (struct seekPoint *)&this->seekPool[this->seekPoolUsed];
+            sp->decompressedPos = this->decompressedPos;
+            sp->compressedPos = this->compressedPos;
+            sp->sourceOffset = this->source() - this->compBuffer;
+            sp->sourceLimit = this->sourceLimit() - this->compBuffer;
+            sp->size = (fixedSize + windowBytes + 3) & ~3;
+            sp->trees = trees;
+            sp->hs = this->hs;
+            if (ctxSize) memcpy(&this->seekPool[this->seekPoolUsed + sizeof(struct seekPoint)], this->ctx, ctxSize);
+            this->seekPoolUsed += sp->size;
+            this->seekPointCount++;
+            return true;
+        }
+
+        // full, keep every other point and try again if this one is still on the wider grid
+        if (!this->seekPointCount) {
+#ifdef DEBUG_COMPRESSION
+            printf("FS: Seek point at %lu doesn't fit the pool\n", (unsigned long)this->decompressedPos);
+#endif
+            this->seekTreesStart = this->seekPoolSize;
+            return false;
+        }
+        this->thinSeekPoints();
+        if ((this->decompressedPos - this->seekBase) % this->seekInterval) return false;
+    }
+}
+
+void decompress::thinSeekPoints() {
+    uint32_t wider = this->seekInterval * 2;
+    uint32_t used = 0;
+    uint16_t count = 0;
+    uint32_t treesStart = this->seekPoolSize;
+    for (uint32_t offset = 0; offset < this->seekPoolUsed;) {
+        struct seekPoint *sp = (struct seekPoint *)&this->seekPool[offset];
+        uint16_t size = sp->size;
+        if ((sp->decompressedPos - this->seekBase) % wider == 0) {
+            if (sp->trees && sp->trees < treesStart) treesStart = sp->trees;
+            if (used != offset) memmove(&this->seekPool[used], sp, size);
+            used += size;
+            count++;
+        }
+        offset += size;
+    }
+    this->seekPoolUsed = used;
+    this->seekPointCount = count;
+    this->seekInterval = wider;
+
+    // trees are stored in the order the points were taken, so the ones below the lowest
+    // that's still used belong to dropped points only
+    this->seekTreesStart = treesStart;
+}
+
+bool decompress::restoreSeekPoint(uint32_t address) {
+    struct seekPoint *sp = nullptr;
+    for (uint32_t offset = 0; offset < this->seekPoolUsed;) {
+        struct seekPoint *next = (struct seekPoint *)&this->seekPool[offset];
+        if (next->decompressedPos > address) break;
+        sp = next;
+        offset += next->size;
+    }
+    if (!sp) return false;
+
+    // reload the compressed chunk the inflater was reading from at the time of the snapshot
+    this->compressedPos = sp->compressedPos;
+    HAL_flashRead(this->eepromBase + 4 + this->compressedPos - sp->sourceLimit, this->compBuffer, sp->sourceLimit);
+
+    const uint8_t *p = (const uint8_t *)sp + sizeof(struct seekPoint);
+    uint32_t ctxSize = (this->codec == CODEC_ZLIB) ? SEEK_POINT_CTX_SIZE : 0;
+    if (ctxSize) memcpy(this->ctx, p, ctxSize);
+    unpackWindow(p + ctxSize, this->dictionary, this->windowSize);
+    if (sp->trees) {
+        // the table of each tree tells how much of trans follows it
+        const uint8_t *trees = &this->seekPool[sp->trees];
+        memcpy(&this->ctx->ltree, trees, sizeof(this->ctx->ltree.table));
+        memcpy(&this->ctx->ltree, trees, treeSize(&this->ctx->ltree));
+        trees += treeSize(&this->ctx->ltree);
+        memcpy(&this->ctx->dtree, trees, sizeof(this->ctx->dtree.table));
+        memcpy(&this->ctx->dtree, trees, treeSize(&this->ctx->dtree));
+    }
+
+    this->hs = sp->hs;
+    this->source() = this->compBuffer + sp->sourceOffset;
+    this->sourceLimit() = this->compBuffer + sp->sourceLimit;
+    if (this->ctx) this->ctx->dict_ring = this->dictionary;
+    this->decompressedPos = sp->decompressedPos;
+    return true;
+}
+
+void decompress::resetSeekPoints() {
+    // the pool itself stays until the context goes, it is arena memory anyway
+    this->seekPoolUsed = 0;
+    this->seekTreesStart = this->seekPoolSize;
+    this->seekPointCount = 0;
+}
+
+bool decompress::readHeatshrinkHeader() {
+    int params = this->readSourceByte();
+    if (params < 0) return false;
+
+    memset(&this->hs, 0, sizeof(this->hs));
+    this->hs.windowBits = params >> 4;
+    this->hs.lookaheadBits = params & 0x0F;
+    uint32_t window = 1UL << this->hs.windowBits;
+    if (this->hs.windowBits < HEATSHRINK_MIN_WINDOW_BITS || window > MAX_WINDOW_SIZE ||
+        this->hs.lookaheadBits < HEATSHRINK_MIN_LOOKAHEAD_BITS || this->hs.lookaheadBits >= this->hs.windowBits) {
+        printf("FS: Invalid heatshrink parameters %02X\n", params);
+        return false;
+    }
+#ifdef DEBUG_COMPRESSION
+    printf("FS: Opened heatshrink file with window size %lu\n", (unsigned long)window);
+#endif
+
+    // A window that was allocated for a smaller stream can't be reused
+    if (this->dictionary && this->windowSize < window) {
+        C_drawArenaFree(this->dictionary);
+        this->dictionary = nullptr;
+    }
+    this->windowSize = window;
+    if (!this->dictionary) this->dictionary = (uint8_t *)C_drawArenaAlloc(window);
+    if (!this->dictionary) {
+        printf("FS: window malloc failed\n");
+        return false;
+    }
+
+    // back-references from before the start of the stream read zeroes
+    memset(this->dictionary, 0, window);
+    return true;
+}
+
+int decompress::readSourceByte() {
+    if (this->hsSource < this->hsSourceLimit) return *this->hsSource++;
+    return this->getNextCompressedBlockFromFlash();
+}
+
+int32_t decompress::readBits(uint8_t count) {
+    int32_t value = 0;
+    while (count) {
+        if (this->hs.bitsLeft == 0) {
+            int next = this->readSourceByte();
+            if (next < 0) return -1;
+            this->hs.bitBuffer = next;
+            this->hs.bitsLeft = 8;
+        }
+        uint8_t take = (count < this->hs.bitsLeft) ? count : this->hs.bitsLeft;
+        value = (value << take) | (this->hs.bitBuffer >> (8 - take));
+        this->hs.bitBuffer = (uint8_t)(this->hs.bitBuffer << take);
+        this->hs.bitsLeft -= take;
+        count -= take;
+    }
+    return value;
+}
+
+void decompress::unshrink(uint8_t *dest, uint32_t len) {
+    uint16_t mask = this->windowSize - 1;
+    uint8_t *window = this->dictionary;
+    while (len) {
+        if (this->hs.backrefCount) {
+            // copy as much of the back-reference as fits
+            uint16_t count = (this->hs.backrefCount < len) ? this->hs.backrefCount : len;
+            uint16_t from = this->hs.head - this->hs.backrefOffset;
+            for (uint16_t i = 0; i < count; i++) {
+                uint8_t c = window[(from + i) & mask];
+                window[(this->hs.head + i) & mask] = c;
+                dest[i] = c;
+            }
+            this->hs.head += count;
+            this->hs.backrefCount -= count;
+            dest += count;
+            len -= count;
+            continue;
+        }
+
+        int32_t tag = this->readBits(1);
+        if (tag == 1) {
+            int32_t c = this->readBits(8);
+            if (c < 0) break;
+            window[this->hs.head++ & mask] = c;
+            *dest++ = c;
+            len--;
+        } else if (tag == 0) {
+            int32_t offset = this->readBits(this->hs.windowBits);
+            int32_t count = this->readBits(this->hs.lookaheadBits);
+            if (offset < 0 || count < 0) break;
+            this->hs.backrefOffset = offset + 1;
+            this->hs.backrefCount = count + 1;
+        } else {
+            break;
+        }
+    }
+
+    // a truncated stream decodes as blank instead of leaving stale data in the cache
+    if (len) memset(dest, 0, len);
+}
@@ -4,12 +4,62 @@
 #define ZLIB_CACHE_SIZE 256
 #define OUT_CACHE_SIZE 1024
 
+// Seek points are snapshots of the inflate state taken at a fixed row interval while
+// inflating forward, so a backward seek can resume from the nearest one instead of
+// restarting the stream. They are only taken once a stream is read backwards, and are
+// packed into a pool carved out of the free part of the draw arena: the context without
+// the huffman trees and the window run-length coded grow up from the bottom, the used
+// part of the trees grows down from the top, once for all points in the same block.
+// When the pool fills up every other point is dropped and the interval doubled.
+#define SEEK_POOL_RESERVE 512     // arena bytes left for allocations later in the frame
+#define SEEK_POOL_MIN_SIZE 1024   // don't bother with checkpoints below this
+#define SEEK_POOL_MAX_SIZE 0xFFFC  // offsets in the pool are 16 bits
+
+// heatshrink streams carry their window and lookahead sizes (in bits) in the first byte
+#define HEATSHRINK_MIN_WINDOW_BITS 4
+#define HEATSHRINK_MIN_LOOKAHEAD_BITS 3
+
+enum decompressCodec : uint8_t {
+    CODEC_ZLIB,
+    CODEC_HEATSHRINK
+};
+
+// Decoder state of a heatshrink (LZSS) stream. Literals are a 1 bit followed by the byte,
+// back-references a 0 bit followed by offset-1 and length-1, all MSB first.
+struct heatshrinkState {
+    uint8_t windowBits;
+    uint8_t lookaheadBits;
+    uint8_t bitBuffer;       // unread bits of the current input byte, left aligned
+    uint8_t bitsLeft;
+    uint16_t head;           // write position in the window
+    uint16_t backrefOffset;
+    uint16_t backrefCount;   // bytes of the current back-reference still to be copied
+};
+
+// Header of a seek point in the pool. It is followed by the first part of the uzlib context
+// for zlib streams, and the packed window.
+struct seekPoint {
+    uint32_t decompressedPos;   // output offset at which the snapshot was taken
+    uint32_t compressedPos;     // value of compressedPos at the snapshot
+    uint16_t sourceOffset;      // ctx->source relative to compBuffer
+    uint16_t sourceLimit;       // ctx->source_limit relative to compBuffer
+    uint16_t size;              // bytes taken in the pool, header included
+    uint16_t trees;             // pool offset of the trees, 0 outside a huffman coded block
+    struct heatshrinkState hs;
+};
+
 class decompress {
    public:
-    bool openFromFlash(uint32_t eepBase, uint32_t cSize);
+    bool openFromFlash(uint32_t eepBase, uint32_t cSize, uint8_t codec = CODEC_ZLIB);
     uint32_t getBlock(uint32_t address, uint8_t *target, uint32_t len);
+    // Returns a view of len bytes straight out of the output cache, or nullptr if the range
+    // is out of bounds or larger than OUT_CACHE_SIZE. It stays valid until the next call
+    const uint8_t *getSpan(uint32_t address, uint32_t len);
     uint8_t readByte(uint32_t address);
     void seek(uint32_t address);
+    // Where the rows this stream is read for start and how long they are, so seek points
+    // land on row boundaries. Takes effect until the first seek point is taken
+    void setSeekRows(uint32_t start, uint16_t rowBytes);
 
     int getNextCompressedBlockFromFlash();
 
@@ -22,6 +72,20 @@ class decompress {
    protected:
     void setupContext();
     bool readHeader();
+    void inflate(uint8_t *dest, uint32_t len);
+    bool readHeatshrinkHeader();
+    void unshrink(uint8_t *dest, uint32_t len);
+    int32_t readBits(uint8_t count);
+    int readSourceByte();
+    // Read position in compBuffer, kept in the uzlib context for zlib and next to hs for heatshrink
+    const unsigned char *&source() { return (this->codec == CODEC_HEATSHRINK) ? this->hsSource : this->ctx->source; }
+    const unsigned char *&sourceLimit() { return (this->codec == CODEC_HEATSHRINK) ? this->hsSourceLimit : this->ctx->source_limit; }
+    bool allocSeekPool();
+    uint16_t saveSeekTrees();
+    bool saveSeekPoint();
+    void thinSeekPoints();
+    bool restoreSeekPoint(uint32_t address);
+    void resetSeekPoints();
     uint8_t *compBuffer = nullptr;
     uint32_t decompressedSize;
     uint32_t decompressedPos;
@@ -32,4 +96,23 @@ class decompress {
     uint32_t cacheLen;
     uint32_t cacheStart;
     uint8_t *dictionary = nullptr;
+    uint16_t windowSize = 0;
+    uint8_t codec = CODEC_ZLIB;
+    struct heatshrinkState hs;
+    // heatshrink doesn't take a uzlib context, only its own cursor into compBuffer
+    const unsigned char *hsSource = nullptr;
+    const unsigned char *hsSourceLimit = nullptr;
+
+    uint8_t *seekPool = nullptr;
+    uint32_t seekPoolSize = 0;
+    uint32_t seekPoolUsed = 0;
+    uint32_t seekTreesStart = 0;  // the trees take the pool from here to the end
+    uint16_t seekPointCount = 0;
+    uint32_t seekInterval = OUT_CACHE_SIZE;
+    uint32_t seekBase = 0;  // first point, where the image rows start
+    bool seekPoolFailed = false;
+
+   public:
+    // number of bytes run through the inflater since opening, for profiling
+    uint32_t inflatedBytes = 0;
 };
@@ -6,6 +6,8 @@
 #include "oepl_radio.h"
 #include "oepl-definitions.h"
 #include "oepl_drawing_capi.h"
+#include "oepl_flash_driver.h"
+#include "oepl_display_driver_common.h"
 #include "oepl_display_driver_memlcd.h"
 #include "oepl_display_driver_IL91874.h"
 #include "oepl_display_driver_unissd.h"
@@ -27,6 +29,7 @@
 #include "oepl_efr32_hwtypes.h"
 #include "oepl_hw_abstraction.h"
 #include "sl_power_manager.h"
+#include "sl_sleeptimer.h"
 
 // -----------------------------------------------------------------------------
 //                              Configuration values
@@ -35,6 +38,12 @@
 #define DISPLAY_DEBUG_PRINT 1
 #endif
 
+// Upper bound on how long we wait for BUSY to clear after a refresh when the
+// driver doesn't know how long its refresh takes.
+#ifndef DISPLAY_REFRESH_TIMEOUT_MAX_MS
+#define DISPLAY_REFRESH_TIMEOUT_MAX_MS 180000
+#endif
+
 // -----------------------------------------------------------------------------
 //                              Macros and Typedefs
 // -----------------------------------------------------------------------------
@@ -60,9 +69,31 @@ typedef struct {
   uint32_t overlay_flags;
 } display_state_t;
 
+typedef enum {
+  DRAW_IDLE,          // No draw in progress
+  DRAW_REFRESHING,    // Frame uploaded, waiting for the controller to finish
+  DRAW_REFRESHED      // Controller finished, needs wrapping up
+} draw_state_t;
+
+typedef struct {
+  bool is_infoscreen;
+  union {
+    size_t image_idx;
+    oepl_display_infoscreen_t infoscreen;
+  };
+  oepl_display_draw_done_cb_t cb;
+} draw_request_t;
+
 // -----------------------------------------------------------------------------
 //                          Static Function Declarations
 // -----------------------------------------------------------------------------
+static void start_draw(void);
+static void finish_draw(void);
+static void report_draw_memory(void);
+static void notify_draw_done(void);
+static void queue_draw(const draw_request_t* request);
+static void execute_draw(const draw_request_t* request);
+static void refresh_done_cb(oepl_display_driver_common_event_t event);
 static void add_overlays(uint32_t overlay_mask);
 static void add_rendered_content_splash(void);
 static void add_rendered_content_ap_found(void);
@@ -82,7 +113,17 @@ static uint32_t requested_overlay_flags;
 static size_t xres, yres, num_colors;
 static bool is_drawing = false;
 
-// Todo: Log the next to-be-displayed content when async display is implemented
+/// State of the asynchronous refresh, advanced from the BUSY interrupt
+static volatile draw_state_t draw_state = DRAW_IDLE;
+/// Whether the ongoing refresh ran past the driver's timeout before clearing BUSY
+static volatile bool refresh_timed_out = false;
+/// Start of the ongoing refresh, for timing statistics
+static uint32_t refresh_start_ticks = 0;
+/// Callback to call when the ongoing draw is done
+static oepl_display_draw_done_cb_t draw_done_cb = NULL;
+/// Content requested while a refresh was in progress, drawn after it
+static draw_request_t queued_request;
+static bool have_queued_request = false;
 
 static const oepl_display_driver_desc_t* driver = NULL;
 
@@ -156,6 +197,8 @@ void oepl_display_init(oepl_efr32xg22_displayparams_t* driverconfig)
 
   driver->init(&displayparams);
   C_setDisplayParameters(driverconfig->swapXY, driverconfig->xres_working, driverconfig->yres_working);
+  C_setDrawArenaSize(driverconfig->draw_arena_size);
+  C_setDrawItemBudget(driverconfig->draw_item_budget);
 
   current_state.is_infoscreen = false;
   current_state.image.image_hash = 0;
@@ -164,8 +207,49 @@ void oepl_display_init(oepl_efr32xg22_displayparams_t* driverconfig)
   current_state.overlay_flags = 0;
 }
 
+void oepl_display_process(void)
+{
+  if(draw_state == DRAW_REFRESHED) {
+    finish_draw();
+  }
+
+  if(draw_state == DRAW_IDLE && have_queued_request) {
+    draw_request_t request = queued_request;
+    have_queued_request = false;
+    DPRINTF("Drawing content queued during refresh\n");
+    execute_draw(&request);
+  }
+}
+
+bool oepl_display_is_event_pending(void)
+{
+  return draw_state == DRAW_REFRESHED ||
+         (draw_state == DRAW_IDLE && have_queued_request);
+}
+
+void oepl_display_wait_idle(void)
+{
+  while(draw_state != DRAW_IDLE || have_queued_request) {
+    if(oepl_display_is_event_pending()) {
+      oepl_display_process();
+    } else {
+      sl_power_manager_sleep();
+    }
+  }
+}
+
 void oepl_display_show_image(size_t img_idx)
 {
+  if(draw_state != DRAW_IDLE) {
+    draw_request_t request = {
+      .is_infoscreen = false,
+      .image_idx = img_idx,
+      .cb = NULL
+    };
+    queue_draw(&request);
+    return;
+  }
+
   oepl_stored_image_hdr_t img_meta;
   uint32_t img_addr;
   oepl_nvm_status_t nvm_status = oepl_nvm_read_image_metadata(img_idx, &img_meta);
@@ -193,15 +277,18 @@ void oepl_display_show_image(size_t img_idx)
     return;
   }
 
+  // Keep the flash awake for the whole scan instead of waking it for every line
+  oepl_flash_session_begin();
   C_flushDrawItems();
   C_drawFlashFullscreenImageWithType(img_addr, img_meta.image_format, img_meta.size);
   add_overlays(requested_overlay_flags);
 
   DPRINTF("Showing image in slot %d\n", img_idx);
 
-  is_drawing = true;
-  driver->draw();
-  is_drawing = false;
+  // Draw items are in place now, so whatever heap is left can cache flash pages
+  oepl_flash_cache_enable();
+  start_draw();
+  oepl_flash_session_end();
   current_state.image.image_hash = img_meta.md5;
   current_state.image.image_size = img_meta.size;
   current_state.image.image_idx = img_idx;
@@ -211,6 +298,16 @@ void oepl_display_show_image(size_t img_idx)
 
 void oepl_display_show_infoscreen(oepl_display_infoscreen_t screen)
 {
+  if(draw_state != DRAW_IDLE) {
+    draw_request_t request = {
+      .is_infoscreen = true,
+      .infoscreen = screen,
+      .cb = NULL
+    };
+    queue_draw(&request);
+    return;
+  }
+
   if(current_state.is_infoscreen &&
      current_state.infoscreen == screen &&
      requested_overlay_flags == current_state.overlay_flags) {
@@ -302,9 +399,7 @@ void oepl_display_show_infoscreen(oepl_display_infoscreen_t screen)
   }
 
   add_overlays(requested_overlay_flags);
-  is_drawing = true;
-  driver->draw();
-  is_drawing = false;
+  start_draw();
   current_state.overlay_flags = requested_overlay_flags;
   current_state.is_infoscreen = true;
   current_state.infoscreen = screen;
@@ -340,6 +435,16 @@ void oepl_display_set_overlay(oepl_display_overlay_t overlay, bool show)
   }
 }
 
+void oepl_display_image_moved(size_t from_idx, size_t to_idx)
+{
+  if(!current_state.is_infoscreen && current_state.image.image_idx == (int)from_idx) {
+    current_state.image.image_idx = to_idx;
+  }
+  if(have_queued_request && !queued_request.is_infoscreen && queued_request.image_idx == from_idx) {
+    queued_request.image_idx = to_idx;
+  }
+}
+
 bool oepl_display_is_drawing(void)
 {
   return is_drawing;
@@ -347,18 +452,139 @@ bool oepl_display_is_drawing(void)
 
 void oepl_display_draw(oepl_display_draw_done_cb_t cb)
 {
-  // Todo: async display updates
-  (void)cb;
+  draw_request_t request = {
+    .is_infoscreen = current_state.is_infoscreen,
+    .cb = cb
+  };
   if(current_state.is_infoscreen) {
-    oepl_display_show_infoscreen(current_state.infoscreen);
+    request.infoscreen = current_state.infoscreen;
   } else {
-    oepl_display_show_image(current_state.image.image_idx);
+    request.image_idx = current_state.image.image_idx;
+  }
+
+  if(draw_state != DRAW_IDLE) {
+    queue_draw(&request);
+  } else {
+    execute_draw(&request);
   }
 }
 
 // -----------------------------------------------------------------------------
 //                          Static Function Definitions
 // -----------------------------------------------------------------------------
+static void start_draw(void)
+{
+  is_drawing = true;
+  if(driver->draw_start == NULL) {
+    // Driver can only draw synchronously
+    driver->draw();
+    is_drawing = false;
+    report_draw_memory();
+    C_releaseDrawArena();
+    notify_draw_done();
+    return;
+  }
+
+  driver->draw_start();
+  is_drawing = false;
+  report_draw_memory();
+  // The frame is scanned out, so the heap is free for downloads during the refresh
+  C_releaseDrawArena();
+
+  // Let the rest of the system run while the controller refreshes the panel.
+  // The state has to be set before arming, since BUSY may already be cleared.
+  size_t timeout_ms = driver->refresh_timeout_ms;
+  if(timeout_ms == 0) {
+    timeout_ms = DISPLAY_REFRESH_TIMEOUT_MAX_MS;
+  }
+  refresh_timed_out = false;
+  refresh_start_ticks = sl_sleeptimer_get_tick_count();
+  draw_state = DRAW_REFRESHING;
+  oepl_display_driver_wait_busy_async(refresh_done_cb, timeout_ms, driver->refresh_idle_state);
+}
+
+static void finish_draw(void)
+{
+  uint32_t ms = sl_sleeptimer_tick_to_ms(sl_sleeptimer_get_tick_count() - refresh_start_ticks);
+  if(refresh_timed_out) {
+    DPRINTF("Display refresh ran past its timeout, done in %ld.%03ld s\n", ms/1000, ms%1000);
+  } else {
+    DPRINTF("Display refreshed in %ld.%03ld s\n", ms/1000, ms%1000);
+  }
+
+  is_drawing = true;
+  driver->draw_finish();
+  is_drawing = false;
+  draw_state = DRAW_IDLE;
+  notify_draw_done();
+}
+
+static void report_draw_memory(void)
+{
+  // The high water mark is what draw_arena_size would need to be for this hwtype
+  size_t used, spilled, high_water;
+  C_getDrawArenaUsage(&used, &spilled, &high_water);
+  DPRINTF("Draw arena: %d bytes used, %d spilled to heap, high water %d\n", used, spilled, high_water);
+  if(spilled != 0) {
+    // The arena sizes per hwtype are estimates, this is where they fall short
+    DPRINTF("Draw arena of %d bytes too small for this frame\n", used + C_getDrawArenaFree());
+  }
+
+  // Dropped items mean a layout didn't fit in draw_item_budget and was drawn incomplete
+  uint16_t items, items_high_water, dropped;
+  C_getDrawItemUsage(&items, &items_high_water, &dropped);
+  DPRINTF("Draw list: %d items, high water %d, %d dropped\n", items, items_high_water, dropped);
+}
+
+static void notify_draw_done(void)
+{
+  oepl_display_draw_done_cb_t cb = draw_done_cb;
+  draw_done_cb = NULL;
+  if(cb != NULL) {
+    cb();
+  }
+}
+
+static void queue_draw(const draw_request_t* request)
+{
+  // Only the latest request matters, since it would overwrite earlier content
+  if(have_queued_request && queued_request.cb != NULL && request->cb == NULL) {
+    draw_request_t merged = *request;
+    merged.cb = queued_request.cb;
+    queued_request = merged;
+  } else {
+    queued_request = *request;
+  }
+  have_queued_request = true;
+  DPRINTF("Refresh in progress, queueing draw\n");
+}
+
+static void execute_draw(const draw_request_t* request)
+{
+  draw_done_cb = request->cb;
+  if(request->is_infoscreen) {
+    oepl_display_show_infoscreen(request->infoscreen);
+  } else {
+    oepl_display_show_image(request->image_idx);
+  }
+
+  if(draw_state == DRAW_IDLE) {
+    // Content was already on screen, or the driver drew synchronously
+    notify_draw_done();
+  }
+}
+
+static void refresh_done_cb(oepl_display_driver_common_event_t event)
+{
+  // Called from IRQ context, the event loop does the actual work. A timeout only
+  // gets noted, the panel can't go to sleep before it has cleared BUSY.
+  if(event == BUSY_TIMEOUT) {
+    refresh_timed_out = true;
+    return;
+  }
+  draw_state = DRAW_REFRESHED;
+}
+
 static void add_overlays(uint32_t overlay_mask)
 {
   if(overlay_mask & OVERLAY_FLAG_LOW_BATTERY) {
@@ -58,6 +58,13 @@ void oepl_display_process(void);
  *****************************************************************************/
 bool oepl_display_is_event_pending(void);
 
+/**************************************************************************//**
+ * Block until an ongoing refresh, and any content queued behind it, has been
+ * drawn. Use before actions which won't return to the event loop, such as
+ * entering deep sleep or applying a firmware upgrade.
+ *****************************************************************************/
+void oepl_display_wait_idle(void);
+
 /**************************************************************************//**
  * Show an image from a persistent slot (and add currently enabled overlays).
  * Showing an image will override the previous image or info screen.
@@ -67,6 +74,12 @@ bool oepl_display_is_event_pending(void);
  *****************************************************************************/
 void oepl_display_show_image(size_t img_idx);
 
+/**************************************************************************//**
+ * Tell the display an image has moved to another slot, so redrawing the image
+ * on screen (or queued to be) reads it from its new location.
+ *****************************************************************************/
+void oepl_display_image_moved(size_t from_idx, size_t to_idx);
+
 /**************************************************************************//**
  * Show an info screen (and add currently enabled overlays).
  * Info screen is either runtime generated or read from persistent storage
@@ -84,7 +97,10 @@ void oepl_display_show_infoscreen(oepl_display_infoscreen_t screen);
 void oepl_display_set_overlay(oepl_display_overlay_t overlay, bool show);
 
 /**************************************************************************//**
- * Check whether the display driver is currently drawing the screen
+ * Check whether the display driver is currently executing a blocking part of
+ * a draw (frame upload, putting the display to sleep, or the full draw for
+ * drivers without asynchronous refresh). The refresh itself runs in the
+ * background and is not reported here.
  *****************************************************************************/
 bool oepl_display_is_drawing(void);
 
@@ -92,6 +108,8 @@ bool oepl_display_is_drawing(void);
  * Start a display refresh
  * 
  * The registered callback will be called when the refresh cycle is done.
+ * If a refresh is already in progress, the draw is queued and started from
+ * oepl_display_process() once the display has finished.
  *****************************************************************************/
 void oepl_display_draw(oepl_display_draw_done_cb_t cb);
 
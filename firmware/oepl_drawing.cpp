@@ -7,7 +7,18 @@
 #include "common/QRCode/src/qrcode.h"
 
 #define EEPROM_XFER_BLOCKSIZE 512  // shouldn't be any less than 256 bytes probably
-#define DRAWITEM_LIST_SIZE 24
+#define DRAWITEM_POOL_CHUNK 8  // draw items allocated at once when the pool runs dry
+#define DRAWITEM_DEFAULT_BUDGET 64
+#define DRAWITEM_MASK_BITS 32
+#define DRAWITEM_COLOR_COUNT 4
+#define DRAWITEM_LINE_END 0x10000UL  // one past the last possible line number
+#define DRAWITEM_COLUMN_STRIP_BYTES 2  // source bytes per row fetched at once for compressed images drawn in Y direction
+#define DRAWITEM_SCRATCH_LINES 3
+#define DRAW_ARENA_DEFAULT_SIZE 4096
+#define DRAW_ARENA_ALIGN 4
+#define RLE_READ_CHUNK 32  // bytes of runs fetched from flash at once
+#define GLYPH_CACHE_ENTRIES 32
+#define GLYPH_CACHE_POOL_SIZE 1024
 
 struct __attribute__((packed)) imageHeader {
     uint16_t width;
@@ -21,7 +32,131 @@ static bool drawDirectionRight;
 static const GFXfont* current_font = nullptr;
 static fontrender* current_fontrender = nullptr;
 
-static drawItem *drawItems[DRAWITEM_LIST_SIZE] = {0};
+// Draw list in the order items were added. It grows as needed, up to the budget;
+// items beyond that are dropped and counted.
+static drawItem **drawItems = nullptr;
+static uint16_t drawItemCount = 0;
+static uint16_t drawItemCapacity = 0;
+static uint16_t drawItemBudget = DRAWITEM_DEFAULT_BUDGET;
+static uint16_t drawItemHighWater = 0;
+static uint16_t drawItemsDropped = 0;
+
+// Fixed-size slots for the draw items themselves, taken from the arena a chunk at
+// a time. Deleted items go onto a free list and are reused within the frame.
+union drawItemSlot {
+    drawItemSlot *next;
+    alignas(drawItem) uint8_t storage[sizeof(drawItem)];
+};
+struct drawItemChunk {
+    drawItemChunk *next;
+    drawItemSlot slots[DRAWITEM_POOL_CHUNK];
+};
+static drawItemChunk *drawItemChunks = nullptr;
+static drawItemSlot *drawItemFreeSlots = nullptr;
+
+// Scanline index for the draw list. The line range is cut into bands at every
+// item's first and last line, and each band holds a mask of the items covering
+// it, drawIndexWords words long. Rebuilt on the first render after the list has
+// changed, and reallocated when the list has outgrown it.
+static bool drawIndexDirty = true;
+static uint16_t drawBandCount = 0;
+static uint16_t drawLastBand = 0;
+static uint16_t drawIndexCapacity = 0;
+static uint16_t drawIndexWords = 0;
+static uint32_t *drawIndex = nullptr;
+static uint32_t *drawBandStart = nullptr;
+static uint32_t *drawBandItems = nullptr;
+static uint32_t *drawColorItems = nullptr;
+static uint32_t *drawItemFirst = nullptr;
+static uint32_t *drawItemLast = nullptr;
+
+// Per-frame bump arena. Draw items, their bitmaps and decompression buffers are
+// carved out of one block and released all at once when the list is flushed, so a
+// frame doesn't leave holes in the heap. The block itself is freed once the frame
+// is on screen, and taken again with the next one. Allocations that don't fit
+// spill over to the heap, and are counted so the arena can be sized per hwtype.
+static uint8_t *drawArena = nullptr;
+static size_t drawArenaSize = DRAW_ARENA_DEFAULT_SIZE;
+static size_t drawArenaUsed = 0;
+static size_t drawArenaSpilled = 0;
+static size_t drawArenaHighWater = 0;
+
+// Line buffers for the renderers, sized to the widest item when the list is indexed
+static uint8_t *drawScratch[DRAWITEM_SCRATCH_LINES] = {nullptr};
+static uint16_t drawScratchSize = 0;
+
+// Transfer buffers of the display driver's frame scan, taken once per frame
+static uint8_t *drawScanBuffer = nullptr;
+static size_t drawScanBufferSize = 0;
+
+// Decoded glyphs, keyed by font and character. GFX bitmaps are one continuous
+// bit stream; here every glyph row starts on a byte so it can be ORed into the
+// text buffer a byte at a time. Infoscreens render the same few strings over and
+// over, so the whole cache is simply dropped when it runs full. The entries and the
+// pool are taken from the arena with the first glyph of a frame, and go with it.
+struct glyphCacheEntry {
+    const GFXfont *font;
+    uint16_t c;
+    uint16_t offset;
+};
+static glyphCacheEntry *glyphCache = nullptr;
+static uint8_t glyphCacheCount = 0;
+static uint16_t glyphCacheUsed = 0;
+static uint8_t *glyphCachePool = nullptr;
+
+static void *drawArenaAlloc(size_t size) {
+    size = (size + DRAW_ARENA_ALIGN - 1) & ~(size_t)(DRAW_ARENA_ALIGN - 1);
+    if (drawArena == nullptr) drawArena = (uint8_t *)malloc(drawArenaSize);
+
+    void *ptr;
+    if (drawArena != nullptr && drawArenaUsed + size <= drawArenaSize) {
+        ptr = &drawArena[drawArenaUsed];
+        drawArenaUsed += size;
+    } else {
+        ptr = malloc(size);
+        if (ptr == nullptr) return nullptr;
+        drawArenaSpilled += size;
+    }
+    if (drawArenaUsed + drawArenaSpilled > drawArenaHighWater) drawArenaHighWater = drawArenaUsed + drawArenaSpilled;
+    return ptr;
+}
+
+static void *drawArenaCalloc(size_t size) {
+    void *ptr = drawArenaAlloc(size);
+    if (ptr != nullptr) memset(ptr, 0, size);
+    return ptr;
+}
+
+static void drawArenaFree(void *ptr) {
+    // Arena memory is only given back when the whole frame is flushed
+    if (drawArena != nullptr && (uint8_t *)ptr >= drawArena && (uint8_t *)ptr < drawArena + drawArenaSize) return;
+    free(ptr);
+}
+
+static drawItem *addShape(enum drawItem::drawType type, int16_t x, int16_t y, uint16_t width, uint16_t height, uint8_t color);
+
+// Hands back everything allocated since the mark was taken, for work that isn't part of a frame.
+// When the block itself was only taken for that work, it goes back to the heap as well.
+static void drawArenaRewind(size_t mark, bool release) {
+    drawArenaUsed = mark;
+    if (release && drawArenaUsed == 0) {
+        free(drawArena);
+        drawArena = nullptr;
+    }
+}
+
+static void drawArenaReset() {
+    for (uint8_t i = 0; i < DRAWITEM_SCRATCH_LINES; i++) {
+        drawArenaFree(drawScratch[i]);
+        drawScratch[i] = nullptr;
+    }
+    drawScratchSize = 0;
+    drawArenaFree(drawScanBuffer);
+    drawScanBuffer = nullptr;
+    drawScanBufferSize = 0;
+    drawArenaUsed = 0;
+    drawArenaSpilled = 0;
+}
 
 extern "C" {
 #include <stdarg.h>
@@ -96,18 +231,108 @@ void C_drawMask(uint16_t xpos, uint16_t ypos, uint16_t width, uint16_t height, u
   return drawMask(xpos, ypos, width, height, color);
 }
 
+void C_drawRectangle(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint8_t radius, uint8_t thickness, uint8_t color)
+{
+  return drawRectangle(x, y, width, height, radius, thickness, color);
+}
+
+void C_drawCircle(uint16_t x, uint16_t y, uint16_t radius, uint8_t thickness, uint8_t color)
+{
+  return drawCircle(x, y, radius, thickness, color);
+}
+
+void C_drawLine(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t color)
+{
+  return drawLine(x0, y0, x1, y1, color);
+}
+
+bool C_inflateFlashImage(uint32_t addr, uint32_t filesize, uint32_t maxsize, uint8_t *rawtype, C_imageWriter_t writer, void *ctx)
+{
+  return inflateFlashImage(addr, filesize, maxsize, rawtype, writer, ctx);
+}
+
 void C_renderDrawLine(uint8_t *line, uint16_t number, uint8_t c)
 {
   return drawItem::renderDrawLine(line, number, c);
 }
 
+void C_renderDrawLinePlanes(uint16_t number, uint8_t **planes, uint8_t nplanes)
+{
+  return drawItem::renderDrawLinePlanes(number, planes, nplanes);
+}
+
 void C_flushDrawItems(void) {
   return drawItem::flushDrawItems();
 }
+
+void C_setDrawArenaSize(size_t size)
+{
+  if (size == 0) size = DRAW_ARENA_DEFAULT_SIZE;
+  if (size == drawArenaSize) return;
+
+  // The old block can only go once nothing lives in it anymore
+  drawItem::flushDrawItems();
+  free(drawArena);
+  drawArena = nullptr;
+  drawArenaSize = size;
+}
+
+void C_releaseDrawArena(void)
+{
+  drawItem::flushDrawItems();
+  free(drawArena);
+  drawArena = nullptr;
+}
+
+void *C_drawArenaAlloc(size_t size)
+{
+  return drawArenaAlloc(size);
+}
+
+void C_drawArenaFree(void *ptr)
+{
+  return drawArenaFree(ptr);
+}
+
+void *C_getDrawScanBuffer(size_t size)
+{
+  if (size > drawScanBufferSize) {
+    drawArenaFree(drawScanBuffer);
+    drawScanBuffer = (uint8_t *)drawArenaAlloc(size);
+    drawScanBufferSize = (drawScanBuffer != nullptr) ? size : 0;
+  }
+  return drawScanBuffer;
+}
+
+void C_getDrawArenaUsage(size_t *used, size_t *spilled, size_t *high_water)
+{
+  *used = drawArenaUsed;
+  *spilled = drawArenaSpilled;
+  *high_water = drawArenaHighWater;
+}
+
+size_t C_getDrawArenaFree(void)
+{
+  return drawArenaSize - drawArenaUsed;
+}
+
+void C_setDrawItemBudget(uint16_t budget)
+{
+  if (budget == 0) budget = DRAWITEM_DEFAULT_BUDGET;
+  drawItemBudget = budget;
+}
+
+void C_getDrawItemUsage(uint16_t *count, uint16_t *high_water, uint16_t *dropped)
+{
+  *count = drawItemCount;
+  *high_water = drawItemHighWater;
+  *dropped = drawItemsDropped;
+}
 }
 
 void addBufferedImage(uint16_t x, uint16_t y, uint8_t color, enum rotation ro, const uint8_t *image, bool mask) {
     drawItem *di = new drawItem;
+    if (di == nullptr) return;
 
     di->setRotation(ro);
     if (di->direction ^ drawDirectionRight) {
@@ -116,39 +341,18 @@ void addBufferedImage(uint16_t x, uint16_t y, uint8_t color, enum rotation ro, c
         y = temp;
     }
 
-    uint16_t originalWidthBytes = (((uint16_t *)image)[0]) / 8;
-    uint16_t size = 0;
-    uint16_t width = ((uint16_t *)image)[0];
-
     // find out if the original data was aligned in one byte; if not, add a byte
-    if (((uint16_t *)image)[0] % 8) originalWidthBytes++;
-
-    // if we're drawing in X direction, we shift the content here. Add extra space for shifting!
-    if (!di->direction) {
-        width += x % 8;
-    }
-
-    // check if the size is aligned in bytes; if not, add an extra for good measure;
-    if (width % 8) {
-        width /= 8;
-        width++;
-    } else {
-        width /= 8;
-    }
-
-    size = width * ((uint16_t *)image)[1];
-    size += 2;  // not needed
-
-    uint8_t *im = (uint8_t *)calloc(size, 1);
-
-    for (uint16_t copyY = 0; copyY < ((uint16_t *)image)[1]; copyY++) {
-        memcpy(im + (copyY * width), image + 4 + (copyY * originalWidthBytes), originalWidthBytes);
+    uint16_t width = (((uint16_t *)image)[0]) / 8;
+    if (((uint16_t *)image)[0] % 8) width++;
 
-        // if we draw in X direction, we need to shift bytes in the array
-        if (!di->direction && (x % 8)) {
-            drawItem::shiftBytesRight(im + (copyY * width), x % 8, width);
-        }
+    // the sprite is stored unshifted, sub-byte x positions are handled when compositing
+    uint16_t size = width * ((uint16_t *)image)[1];
+    uint8_t *im = (uint8_t *)drawArenaAlloc(size);
+    if (im == nullptr) {
+        delete di;
+        return;
     }
+    memcpy(im, image + 4, size);
 
     di->addItem(im, width * 8, ((uint16_t *)image)[1]);
 
@@ -165,6 +369,7 @@ void addBufferedImage(uint16_t x, uint16_t y, uint8_t color, enum rotation ro, c
 
 void addFlashImage(uint16_t x, uint16_t y, uint8_t color, enum rotation ro, const uint8_t *image) {
     drawItem *di = new drawItem;
+    if (di == nullptr) return;
 
     di->setRotation(ro);
 
@@ -192,54 +397,76 @@ void addQR(uint16_t x, uint16_t y, uint8_t version, uint8_t scale, const char *c
     vsnprintf(out_buffer, 255, c, lst);
     va_end(lst);
 
-    QRCode qrcode;
-    // Allocate a chunk of memory to store the QR code
-    uint8_t qrcodeBytes[qrcode_getBufferSize(version)];
-    qrcode_initText(&qrcode, qrcodeBytes, version, ECC_LOW, out_buffer);
+    // Scanlines are expanded from whole module bytes, so they're a multiple of the scale wide
+    uint8_t size = (4 * version) + 17;
+    uint8_t moduleBytes = (size + 7) / 8;
+    if (scale == 0 || version == 0 || version > 40 || (uint16_t)moduleBytes * scale > 0xFF) return;
 
     drawItem *di = new drawItem;
-    di->setRotation(rotation::ROTATE_0);
-
-    uint8_t xbytes = (qrcode.size * scale) / 8;
-    if (qrcode.size % 8) xbytes++;
-
-    uint16_t size = xbytes * (qrcode.size * scale);
-    uint8_t *im = (uint8_t *)calloc(size + 1, 1);
-
-    uint8_t *qrbuf = im;
+    if (di == nullptr) return;
 
-    for (uint8_t qry = 0; qry < qrcode.size; qry++) {
-        for (uint8_t scale_y = 0; scale_y < scale; scale_y++) {
-            for (uint8_t qrx = 0; qrx < qrcode.size; qrx++) {
-                for (uint8_t scale_x = 0; scale_x < scale; scale_x++) {
-                    if (qrcode_getModule(&qrcode, qrx, qry)) {
-                        // Calculate the position in the framebuffer for the scaled pixel
-                        uint8_t scaled_qrx = (qrx * scale) + scale_x;
-                        uint8_t scaled_qry = (qry * scale) + scale_y;
+    size_t arenaMark = drawArenaUsed;
+    uint8_t *modules = (uint8_t *)drawArenaCalloc(moduleBytes * size);
+    if (modules == nullptr) {
+        delete di;
+        return;
+    }
 
-                        // Calculate the byte and bit positions in the framebuffer
-                        uint8_t fb_byte = scaled_qrx / 8;
-                        uint8_t fb_bit = 7 - (scaled_qrx % 8);
+    // The qrcode library needs its working buffer for the whole encode. It's taken from the
+    // arena behind the module matrix, and handed back as soon as the matrix is extracted.
+    QRCode qrcode;
+    size_t qrcodeMark = drawArenaUsed;
+    uint8_t *qrcodeBytes = (uint8_t *)drawArenaAlloc(qrcode_getBufferSize(version));
+    if (qrcodeBytes == nullptr || qrcode_initText(&qrcode, qrcodeBytes, version, ECC_LOW, out_buffer) < 0 || qrcode.size != size) {
+        if (qrcodeBytes != nullptr) drawArenaFree(qrcodeBytes);
+        drawArenaFree(modules);
+        drawArenaRewind(arenaMark, false);
+        delete di;
+        return;
+    }
 
-                        // Set the bit in the framebuffer
-                        qrbuf[fb_byte + (scaled_qry * xbytes)] |= (1 << fb_bit);
-                    }
-                }
-            }
+    // Keep just the module matrix, one bit per module. On panels scanning in Y direction it's
+    // stored transposed, so every scanline still comes from a single matrix row.
+    for (uint8_t row = 0; row < qrcode.size; row++) {
+        for (uint8_t col = 0; col < qrcode.size; col++) {
+            bool dark = drawDirectionRight ? qrcode_getModule(&qrcode, row, col) : qrcode_getModule(&qrcode, col, row);
+            if (dark) modules[(col / 8) + (row * moduleBytes)] |= (0x80 >> (col % 8));
         }
     }
-
-    di->addItem(im, xbytes * 8, qrcode.size * scale);
-
-    di->xpos = x;
-    di->ypos = y;
+    // Arena memory is only given back by rewinding, drawArenaFree covers a buffer that spilled
+    drawArenaFree(qrcodeBytes);
+    drawArenaRewind(qrcodeMark, false);
+
+    di->direction = false;
+    di->mirrorH = false;
+    // The width is padded to whole expanded module bytes, the code itself is height pixels square
+    di->addItem(modules, moduleBytes * 8 * scale, qrcode.size * scale);
+    di->moduleScale = scale;
+    di->xpos = drawDirectionRight ? y : x;
+    di->ypos = drawDirectionRight ? x : y;
     di->color = 0;
-    di->type = drawItem::drawType::DRAW_BUFFERED_1BPP;
+    di->type = drawItem::drawType::DRAW_QR;
 
     di->checkBounds();
     di->addToList();
 }
 
+static uint8_t imageCodec(uint8_t type) {
+#if OEPL_EXPERIMENTAL_IMAGE_TYPES
+    if (type == DATATYPE_IMG_HEATSHRINK) return CODEC_HEATSHRINK;
+#endif
+    return CODEC_ZLIB;
+}
+
+static bool imagePlanesInterleaved(uint8_t type) {
+#if OEPL_EXPERIMENTAL_IMAGE_TYPES
+    return type == DATATYPE_IMG_ZLIB_INTERLEAVED;
+#else
+    (void)type;
+    return false;
+#endif
+}
+
 void drawImageWithType(uint32_t addr, uint8_t type, uint32_t filesize) {
 #ifdef DEBUG_DRAWING
     printf("Drawing image of type 0x%02X from location 0x%08X\n", eih.dataType, addr);
@@ -247,11 +474,12 @@ void drawImageWithType(uint32_t addr, uint8_t type, uint32_t filesize) {
     switch (type) {
         case DATATYPE_IMG_RAW_1BPP: {
             drawItem *di = new drawItem;
+            if (di == nullptr) return;
             // di->setRotation(ro);
             di->xpos = 0;
             di->ypos = 0;
             di->color = 0;
-            di->addItem((uint8_t *)addr, effectiveXRes, effectiveYRes);
+            di->addItem((uint8_t *)(uintptr_t)addr, effectiveXRes, effectiveYRes);
             di->type = drawItem::drawType::DRAW_EEPROM_1BPP;
             di->direction = false;
             if (di->mirrorH) {
@@ -264,11 +492,12 @@ void drawImageWithType(uint32_t addr, uint8_t type, uint32_t filesize) {
         } break;
         case DATATYPE_IMG_RAW_2BPP: {
             drawItem *di = new drawItem;
+            if (di == nullptr) return;
             // di->setRotation(ro);
             di->xpos = 0;
             di->ypos = 0;
             di->color = 0;
-            di->addItem((uint8_t *)addr, effectiveXRes, effectiveYRes);
+            di->addItem((uint8_t *)(uintptr_t)addr, effectiveXRes, effectiveYRes);
             di->type = drawItem::drawType::DRAW_EEPROM_2BPP;
             di->direction = false;
             if (di->mirrorH) {
@@ -279,22 +508,60 @@ void drawImageWithType(uint32_t addr, uint8_t type, uint32_t filesize) {
             di->checkBounds();
             di->addToList();
         } break;
+#if OEPL_EXPERIMENTAL_IMAGE_TYPES
+        case DATATYPE_IMG_RLE_1BPP: {
+            drawItem *di = new drawItem;
+            if (di == nullptr) return;
+            oepl_flash_session_begin();
+            uint8_t headerSize;
+            struct imageHeader imgheader;
+            HAL_flashRead(addr, &headerSize, 1);
+            HAL_flashRead(addr + 1, (uint8_t *)&imgheader, sizeof(struct imageHeader));
+            oepl_flash_session_end();
+            if (imgheader.bpp != 1) {
+                printf("DRAW: RLE image with %d bpp not supported\n", imgheader.bpp);
+                delete di;
+                return;
+            }
+
+            // Rows are decoded straight from flash, the buffer points at the row table
+            di->addItem((uint8_t *)(uintptr_t)(addr + headerSize), imgheader.width, imgheader.height);
+            di->type = drawItem::drawType::DRAW_RLE_1BPP;
+            di->xpos = 0;
+            di->ypos = 0;
+            di->color = 0;
+            di->direction = false;
+            if (di->mirrorH) {
+                di->mirrorH = 0;
+                di->mirrorV = !di->mirrorV;
+            }
+            di->cleanUp = false;
+            di->checkBounds();
+            di->addToList();
+        } break;
+        case DATATYPE_IMG_ZLIB_INTERLEAVED:
+        case DATATYPE_IMG_HEATSHRINK:
+#endif
         case DATATYPE_IMG_ZLIB: {
 #ifdef DEBUG_DRAWING
             printf("DRAW: drawing compressed image\n");
 #endif
             drawItem *di = new drawItem;
-            decompress **decomp = (decompress **)calloc(sizeof(decompress *) * 2, 1);
+            if (di == nullptr) return;
+            oepl_flash_session_begin();
+            decompress **decomp = (decompress **)drawArenaCalloc(sizeof(decompress *) * 2);
             decomp[0] = new decompress;
+            uint8_t codec = imageCodec(type);
 
             di->type = drawItem::drawType::DRAW_COMPRESSED;
 
             // try to see if we can open the decompression stream
-            if (!decomp[0]->openFromFlash(addr, filesize)) {
+            if (!decomp[0]->openFromFlash(addr, filesize, codec)) {
                 printf("DRAW: failed to open\n");
                 delete di;
                 delete decomp[0];
-                free(decomp);
+                drawArenaFree(decomp);
+                oepl_flash_session_end();
                 return;
             }
 
@@ -313,89 +580,248 @@ void drawImageWithType(uint32_t addr, uint8_t type, uint32_t filesize) {
                 di->mirrorV = !di->mirrorV;
             }
             if (imgheader.bpp == 1) di->color = 0;
+            // seek points for mirrored scans go on row boundaries
+            uint16_t rowBytes = (imgheader.width + 7) / 8;
             if (imgheader.bpp == 2) {
                 di->color = 2;
-                // open a second decompress stream
-                decomp[1] = new decompress;
-                decomp[1]->openFromFlash(addr, filesize);
+                if (imagePlanesInterleaved(type)) {
+                    // both planes come out of the same stream, row by row
+                    di->planesInterleaved = true;
+                } else {
+                    // the second plane starts a whole plane later, so it gets its own stream
+                    decomp[1] = new decompress;
+                    decomp[1]->openFromFlash(addr, filesize, codec);
+                    decomp[1]->setSeekRows(di->imageHeaderOffset + ((uint32_t)rowBytes * imgheader.height), rowBytes);
+                }
             }
+            decomp[0]->setSeekRows(di->imageHeaderOffset, di->planesInterleaved ? rowBytes * 2 : rowBytes);
             di->cleanUp = true;
             di->checkBounds();
             di->addToList();
+            oepl_flash_session_end();
         } break;
     }
 }
 
-void drawRoundedRectangle(uint16_t xpos, uint16_t ypos, uint16_t width, uint16_t height, uint8_t color) {
-    uint16_t widthBytes = width / 8;
-    if (width % 8) widthBytes++;
-    uint32_t framebufferSize = widthBytes * height;
-    uint8_t *framebuffer = (uint8_t *)calloc(framebufferSize + 4, 1);
-    if (framebuffer == NULL) {
-        return;
-    }
-    uint8_t frameBufferZerosize = width;
-    if ((width % 8) != 0) {
-        frameBufferZerosize++;
+bool inflateFlashImage(uint32_t addr, uint32_t filesize, uint32_t maxsize, uint8_t *rawtype, C_imageWriter_t writer, void *ctx) {
+    // The stream buffers come out of the arena, behind whatever the current frame holds.
+    // Outside of a frame the arena isn't allocated, and shouldn't stay allocated after this.
+    size_t arenaMark = drawArenaUsed;
+    bool arenaTaken = (drawArena == nullptr);
+    oepl_flash_session_begin();
+    decompress *decomp = new decompress;
+    if (!decomp->openFromFlash(addr, filesize, imageCodec(*rawtype))) {
+        printf("DRAW: failed to open\n");
+        delete decomp;
+        drawArenaRewind(arenaMark, arenaTaken);
+        oepl_flash_session_end();
+        return false;
     }
-    ((uint16_t *)framebuffer)[0] = frameBufferZerosize;
-    ((uint16_t *)framebuffer)[1] = height;
 
-    framebuffer += 4;
-    uint16_t w = width - 1;
-    uint16_t x = 1;
-    while (w--) {
-        framebuffer[(x / 8)] |= (uint8_t)(1 << (7 - ((uint8_t)x % 8)));
-        x++;
+    uint8_t headerOffset = decomp->readByte(0);
+    struct imageHeader imgheader;
+    decomp->getBlock(1, (uint8_t *)&imgheader, sizeof(struct imageHeader));
+
+    // the raw layout is fullscreen, byte-aligned rows with the bitplanes stacked, which is
+    // exactly what follows the header in the compressed stream when the dimensions match.
+    // Interleaved 2bpp rows are sorted into their planes on the way.
+    uint32_t rowBytes = imgheader.width / 8;
+    uint32_t planeSize = rowBytes * imgheader.height;
+    uint32_t rawSize = planeSize * imgheader.bpp;
+    bool interleaved = imagePlanesInterleaved(*rawtype) && (imgheader.bpp == 2);
+    if (imgheader.width != effectiveXRes || imgheader.height != effectiveYRes || (imgheader.width % 8) ||
+        (imgheader.bpp != 1 && imgheader.bpp != 2) || rawSize > maxsize || (2 * rowBytes) > OUT_CACHE_SIZE) {
+#ifdef DEBUG_DRAWING
+        printf("DRAW: can't store %dx%d %dbpp image as raw\n", imgheader.width, imgheader.height, imgheader.bpp);
+#endif
+        delete decomp;
+        drawArenaRewind(arenaMark, arenaTaken);
+        oepl_flash_session_end();
+        return false;
     }
-    for (uint16_t curY = 1; curY < (height - 1); curY++) {
-        framebuffer[widthBytes * curY] = 0x80;
-        if (width % 8)
-            framebuffer[(widthBytes * curY) + widthBytes - 1] = (uint8_t)(1 << (7 - ((uint8_t)width % 8)));
-        else
-            framebuffer[(widthBytes * curY) + widthBytes - 1] = 0x01;
+
+    uint8_t *chunk = (uint8_t *)drawArenaAlloc(OUT_CACHE_SIZE);
+    if (!chunk) {
+        delete decomp;
+        drawArenaRewind(arenaMark, arenaTaken);
+        oepl_flash_session_end();
+        return false;
     }
-    w = width - 1;
-    x = 1;
-    while (w--) {
-        framebuffer[(x / 8) + ((height - 1) * widthBytes)] |= (uint8_t)(1 << (7 - ((uint8_t)x % 8)));
-        x++;
+
+    bool success = true;
+    if (interleaved) {
+        // Fill the chunk's halves with as many BW and R/Y rows as fit, reading the stream in order
+        uint32_t rowsPerChunk = OUT_CACHE_SIZE / (2 * rowBytes);
+        uint8_t *chunk_r = chunk + (rowsPerChunk * rowBytes);
+        for (uint32_t row = 0; success && row < imgheader.height; row += rowsPerChunk) {
+            uint32_t rows = imgheader.height - row;
+            if (rows > rowsPerChunk) rows = rowsPerChunk;
+            for (uint32_t i = 0; i < rows; i++) {
+                uint32_t offset = headerOffset + ((row + i) * 2 * rowBytes);
+                if (decomp->getBlock(offset, &chunk[i * rowBytes], rowBytes) != rowBytes ||
+                    decomp->getBlock(offset + rowBytes, &chunk_r[i * rowBytes], rowBytes) != rowBytes) {
+                    success = false;
+                    break;
+                }
+            }
+            if (!success || !writer(ctx, row * rowBytes, chunk, rows * rowBytes) ||
+                !writer(ctx, planeSize + (row * rowBytes), chunk_r, rows * rowBytes)) {
+                success = false;
+            }
+        }
+    } else {
+        for (uint32_t offset = 0; offset < rawSize; offset += OUT_CACHE_SIZE) {
+            uint32_t len = rawSize - offset;
+            if (len > OUT_CACHE_SIZE) len = OUT_CACHE_SIZE;
+            if (decomp->getBlock(headerOffset + offset, chunk, len) != len || !writer(ctx, offset, chunk, len)) {
+                success = false;
+                break;
+            }
+        }
     }
-    framebuffer -= 4;
-    addBufferedImage(xpos, ypos, color, rotation::ROTATE_0, framebuffer, DRAW_NORMAL);
-    free(framebuffer);
+
+    drawArenaFree(chunk);
+    delete decomp;
+    drawArenaRewind(arenaMark, arenaTaken);
+    oepl_flash_session_end();
+    if (success) *rawtype = (imgheader.bpp == 2) ? DATATYPE_IMG_RAW_2BPP : DATATYPE_IMG_RAW_1BPP;
+    return success;
+}
+
+void drawRoundedRectangle(uint16_t xpos, uint16_t ypos, uint16_t width, uint16_t height, uint8_t color) {
+    // the smallest radius that takes the corner pixel off, and only that
+    drawRectangle(xpos, ypos, width, height, 2, 1, color);
 }
 
 void drawMask(uint16_t xpos, uint16_t ypos, uint16_t width, uint16_t height, uint8_t color) {
-    uint16_t widthBytes = width / 8;
-    if (width % 8) widthBytes++;
-    uint32_t framebufferSize = widthBytes * height;
-    uint8_t *framebuffer = (uint8_t *)calloc(framebufferSize + 4, 1);
-    if (framebuffer == NULL) {
-        return;
-    }
+    drawItem *di = addShape(drawItem::drawType::DRAW_RECT, xpos, ypos, width, height, color);
+    if (di == nullptr) return;
+    di->erase = true;
+    di->addToList();
+}
+
+void drawRectangle(int16_t xpos, int16_t ypos, uint16_t width, uint16_t height, uint8_t radius, uint8_t thickness, uint8_t color) {
+    drawItem *di = addShape(drawItem::drawType::DRAW_RECT, xpos, ypos, width, height, color);
+    if (di == nullptr) return;
+    di->cornerDiameter = radius * 2;
+    di->thickness = thickness;
+    di->addToList();
+}
 
-    ((uint16_t *)framebuffer)[0] = width;
-    ((uint16_t *)framebuffer)[1] = height;
+void drawCircle(int16_t xpos, int16_t ypos, uint16_t radius, uint8_t thickness, uint8_t color) {
+    // a rectangle rounded all the way, centered on the given pixel
+    uint16_t diameter = (radius * 2) + 1;
+    drawItem *di = addShape(drawItem::drawType::DRAW_RECT, xpos - radius, ypos - radius, diameter, diameter, color);
+    if (di == nullptr) return;
+    di->cornerDiameter = diameter;
+    di->thickness = thickness;
+    di->addToList();
+}
+
+void drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint8_t color) {
+    // stored as its bounding box, running to the lower left instead of the lower right if mirrored
+    int16_t x = (x0 < x1) ? x0 : x1;
+    int16_t y = (y0 < y1) ? y0 : y1;
+    uint16_t width = ((x0 < x1) ? (x1 - x0) : (x0 - x1)) + 1;
+    uint16_t height = ((y0 < y1) ? (y1 - y0) : (y0 - y1)) + 1;
+    drawItem *di = addShape(drawItem::drawType::DRAW_LINE, x, y, width, height, color);
+    if (di == nullptr) return;
+    di->mirrorV = ((x1 < x0) != (y1 < y0)) && (x0 != x1) && (y0 != y1);
+    di->addToList();
+}
 
-    framebuffer += 4;
+static drawItem *addShape(enum drawItem::drawType type, int16_t x, int16_t y, uint16_t width, uint16_t height, uint8_t color) {
+    drawItem *di = new drawItem;
+    if (di == nullptr) return nullptr;
 
-    for (uint16_t curY = 0; curY < height; curY++) {
-        uint16_t w = width;
-        uint16_t x = 0;
-        while (w--) {
-            framebuffer[(x / 8) + (curY * widthBytes)] |= (uint8_t)(1 << (7 - ((uint8_t)x % 8)));
-            x++;
-        }
+    // Shapes look the same transposed, so on panels scanning in Y direction only their
+    // coordinates are swapped, and they're always rendered as X lines
+    di->direction = false;
+    di->mirrorH = false;
+    if (drawDirectionRight) {
+        int16_t temp = x;
+        x = y;
+        y = temp;
+        uint16_t tempSize = width;
+        width = height;
+        height = tempSize;
     }
 
-    framebuffer -= 4;
-    addBufferedImage(xpos, ypos, color, rotation::ROTATE_0, framebuffer, DRAW_INVERTED);
-    free(framebuffer);
+    di->xpos = x;
+    di->ypos = y;
+    di->width = width;
+    di->height = height;
+    di->color = color;
+    di->type = type;
+    di->cleanUp = false;
+    return di;
+}
+
+// Word-wide helpers for the bit-blit kernels. Scan lines are MSB-first, so
+// words are loaded big-endian to keep pixel order within a 32-bit register.
+static inline uint32_t load32(const uint8_t *src) {
+    uint32_t word;
+    memcpy(&word, src, sizeof(word));
+    return word;
+}
+
+static inline void store32(uint8_t *dst, uint32_t word) {
+    memcpy(dst, &word, sizeof(word));
+}
+
+static inline uint32_t load_be32(const uint8_t *src) {
+    return __builtin_bswap32(load32(src));
+}
+
+static inline void store_be32(uint8_t *dst, uint32_t word) {
+    store32(dst, __builtin_bswap32(word));
+}
+
+// Reverses all 32 bits of a word, which reverses both the byte order and the bits
+// within each byte of the 4 bytes it was loaded from
+static inline uint32_t reverseBits32(uint32_t word) {
+#if defined(__ARM_ARCH) && (__ARM_ARCH >= 7) && !defined(__ARM_ARCH_6M__)
+    uint32_t result;
+    __asm__("rbit %0, %1" : "=r"(result) : "r"(word));
+    return result;
+#else
+    word = ((word >> 1) & 0x55555555UL) | ((word & 0x55555555UL) << 1);
+    word = ((word >> 2) & 0x33333333UL) | ((word & 0x33333333UL) << 2);
+    word = ((word >> 4) & 0x0F0F0F0FUL) | ((word & 0x0F0F0F0FUL) << 4);
+    return __builtin_bswap32(word);
+#endif
+}
+
+// Transposes an 8x8 bit matrix: in[j] is row j, out[i] is column i, both MSB-first
+static void transpose8x8(const uint8_t *in, uint8_t *out) {
+    uint32_t x = ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 8) | in[3];
+    uint32_t y = ((uint32_t)in[4] << 24) | ((uint32_t)in[5] << 16) | ((uint32_t)in[6] << 8) | in[7];
+    uint32_t t;
+
+    t = (x ^ (x >> 7)) & 0x00AA00AAUL;
+    x = x ^ t ^ (t << 7);
+    t = (y ^ (y >> 7)) & 0x00AA00AAUL;
+    y = y ^ t ^ (t << 7);
+
+    t = (x ^ (x >> 14)) & 0x0000CCCCUL;
+    x = x ^ t ^ (t << 14);
+    t = (y ^ (y >> 14)) & 0x0000CCCCUL;
+    y = y ^ t ^ (t << 14);
+
+    t = (x & 0xF0F0F0F0UL) | ((y >> 4) & 0x0F0F0F0FUL);
+    y = ((x << 4) & 0xF0F0F0F0UL) | (y & 0x0F0F0F0FUL);
+    x = t;
+
+    store_be32(&out[0], x);
+    store_be32(&out[4], y);
 }
 
 void invert_bytes(uint8_t *array, uint16_t length) {
-    for (uint16_t i = 0; i < length; i++) {
+    uint16_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        store32(&array[i], ~load32(&array[i]));
+    }
+    for (; i < length; i++) {
         array[i] ^= 0xFF;  // ^ array[i];
     }
 }
@@ -413,32 +839,162 @@ void invert_reverse_bytes(uint8_t *array, size_t length) {
 }
 
 void and_array(uint8_t *array1, uint8_t *array2, uint16_t length) {
-    for (uint16_t i = 0; i < length; i++) {
+    uint16_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        store32(&array1[i], load32(&array1[i]) & load32(&array2[i]));
+    }
+    for (; i < length; i++) {
         array1[i] &= array2[i];
     }
 }
 
-// drawItem (sprite) functions
-void drawItem::shiftBytesRight(uint8_t *data, uint8_t shift, uint8_t len) {
-    // Ensure the shift value is within bounds (0 to 7)
-    shift = shift % 8;
+// Splits one color out of a pair of B/W and R/Y plane rows
+// color table:
+//   | color  | BW | RY |
+//   | white  | 0  | 0  |
+//   | black  | 1  | 0  |
+//   | red    | 0  | 1  |
+//   | yellow | 1  | 1  |
+static void combine_planes(uint8_t *dst, const uint8_t *bw, const uint8_t *ry, uint8_t c, uint16_t length) {
+    uint32_t invertBW = (c == COLOR_RED) ? 0xFFFFFFFFUL : 0;
+    uint32_t invertRY = (c == COLOR_BLACK) ? 0xFFFFFFFFUL : 0;
+    uint16_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        store32(&dst[i], (load32(&bw[i]) ^ invertBW) & (load32(&ry[i]) ^ invertRY));
+    }
+    for (; i < length; i++) {
+        dst[i] = (bw[i] ^ (uint8_t)invertBW) & (ry[i] ^ (uint8_t)invertRY);
+    }
+}
 
-    // Handle the case where shift is 0 or len is 0
-    if (shift == 0 || len == 0) {
-        return;
+static uint32_t isqrt(uint32_t value) {
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+    while (bit > value) bit >>= 2;
+    while (bit) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
     }
+    return root;
+}
+
+// Columns a rounded corner takes off the given row of a w x h shape, for a corner circle of the
+// given diameter in pixels. A pixel is inside if its center is inside the circle. The math is
+// in half pixels, where the diameter is the radius, so circles with an odd diameter are exact.
+static uint16_t roundedInset(uint16_t w, uint16_t h, uint16_t diameter, uint16_t row) {
+    if (diameter > w) diameter = w;
+    if (diameter > h) diameter = h;
+    uint16_t fromEdge = (row < h - 1 - row) ? row : (h - 1 - row);
+    int32_t center = (2 * fromEdge) + 1;
+    if (center >= diameter) return 0;
+    int32_t dy = diameter - center;
+    int32_t dx = isqrt((diameter * diameter) - (dy * dy));
+    return (diameter - dx) / 2;
+}
 
-    // Loop through the array from right to left
-    for (int i = len - 1; i > 0; i--) {
-        // Perform the shift by combining bits from the current byte
-        // and the next byte to its right
-        data[i] = (data[i] >> shift) | (data[i - 1] << (8 - shift));
+// Byte replication for the common QR scales: a nibble doubled, and two bits quadrupled
+static const uint8_t expandBy2[16] = {0x00, 0x03, 0x0C, 0x0F, 0x30, 0x33, 0x3C, 0x3F, 0xC0, 0xC3, 0xCC, 0xCF, 0xF0, 0xF3, 0xFC, 0xFF};
+static const uint8_t expandBy4[4] = {0x00, 0x0F, 0xF0, 0xFF};
+
+// Expands a row of 1bpp modules into a scanline where every module is 'scale' pixels wide.
+// dst has to hold scale bytes for every byte of modules.
+static void expandModules(uint8_t *dst, const uint8_t *modules, uint8_t count, uint8_t scale) {
+    uint8_t moduleBytes = (count + 7) / 8;
+    switch (scale) {
+        case 1:
+            memcpy(dst, modules, moduleBytes);
+            break;
+        case 2:
+            for (uint8_t i = 0; i < moduleBytes; i++) {
+                dst[(2 * i) + 0] = expandBy2[modules[i] >> 4];
+                dst[(2 * i) + 1] = expandBy2[modules[i] & 0x0F];
+            }
+            break;
+        case 4:
+            for (uint8_t i = 0; i < moduleBytes; i++) {
+                for (uint8_t k = 0; k < 4; k++) {
+                    dst[(4 * i) + k] = expandBy4[(modules[i] >> (6 - (2 * k))) & 0x03];
+                }
+            }
+            break;
+        case 8:
+            for (uint8_t i = 0; i < moduleBytes; i++) {
+                for (uint8_t k = 0; k < 8; k++) {
+                    dst[(8 * i) + k] = (modules[i] & (0x80 >> k)) ? 0xFF : 0x00;
+                }
+            }
+            break;
+        default:
+            memset(dst, 0, moduleBytes * scale);
+            for (uint16_t i = 0; i < count; i++) {
+                if (!(modules[i / 8] & (0x80 >> (i % 8)))) continue;
+                uint16_t pos = i * scale;
+                for (uint8_t k = 0; k < scale; k++, pos++) {
+                    dst[pos / 8] |= (0x80 >> (pos % 8));
+                }
+            }
+            break;
     }
+}
+
+// Reads the runs of an RLE row from flash, a chunk at a time
+struct rleReader {
+    uint32_t addr;
+    uint8_t pos;
+    uint8_t buf[RLE_READ_CHUNK];
+};
+
+static uint8_t rleNextByte(rleReader *reader) {
+    if (reader->pos == RLE_READ_CHUNK) {
+        HAL_flashRead(reader->addr, reader->buf, RLE_READ_CHUNK);
+        reader->addr += RLE_READ_CHUNK;
+        reader->pos = 0;
+    }
+    return reader->buf[reader->pos++];
+}
+
+static uint32_t rleNextRun(rleReader *reader) {
+    uint32_t run = 0;
+    for (uint8_t shift = 0; shift < 32; shift += 7) {
+        uint8_t b = rleNextByte(reader);
+        run |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) break;
+    }
+    return run;
+}
+
+// Sets or clears pixels [start, end) of a scanline, a byte at a time
+static void fillSpan(uint8_t *line, int32_t start, int32_t end, bool erase) {
+    if (start < 0) start = 0;
+    if (end > (int32_t)effectiveXRes) end = effectiveXRes;
+    if (start >= end) return;
 
-    // For the leftmost byte, simply shift it to the right
-    data[0] >>= shift;
+    int32_t firstByte = start / 8;
+    int32_t lastByte = (end - 1) / 8;
+    uint8_t firstMask = 0xFF >> (start % 8);
+    uint8_t lastMask = 0xFF << (7 - ((end - 1) % 8));
+    if (firstByte == lastByte) firstMask &= lastMask;
+
+    if (erase) {
+        line[firstByte] &= ~firstMask;
+    } else {
+        line[firstByte] |= firstMask;
+    }
+    if (firstByte == lastByte) return;
+    memset(&line[firstByte + 1], erase ? 0x00 : 0xFF, lastByte - firstByte - 1);
+    if (erase) {
+        line[lastByte] &= ~lastMask;
+    } else {
+        line[lastByte] |= lastMask;
+    }
 }
 
+// drawItem (sprite) functions
 uint8_t drawItem::bitReverse(uint8_t byte) {
     byte = ((byte >> 1) & 0x55) | ((byte << 1) & 0xAA);
     byte = ((byte >> 2) & 0x33) | ((byte << 2) & 0xCC);
@@ -452,52 +1008,312 @@ void drawItem::reverseBytes(uint8_t *src, uint8_t src_len) {
         return;
     }
 
-    // Reverse the entire source array
-    for (uint8_t i = 0; i < src_len / 2; i++) {
-        uint8_t temp = src[i];
-        src[i] = src[src_len - i - 1];
-        src[src_len - i - 1] = temp;
+    // Reverse the entire bit string, a word from each end at a time
+    uint8_t head = 0;
+    uint8_t tail = src_len;
+    while (tail - head >= 8) {
+        tail -= 4;
+        uint32_t front = load32(&src[head]);
+        uint32_t back = load32(&src[tail]);
+        store32(&src[head], reverseBits32(back));
+        store32(&src[tail], reverseBits32(front));
+        head += 4;
+    }
+
+    // Reverse what's left in the middle byte by byte
+    for (uint8_t i = 0; i < (tail - head) / 2; i++) {
+        uint8_t temp = src[head + i];
+        src[head + i] = src[tail - i - 1];
+        src[tail - i - 1] = temp;
     }
-    // Reverse the bits within the bytes
-    for (uint8_t i = 0; i < src_len; i++) {
+    for (uint8_t i = head; i < tail; i++) {
         src[i] = bitReverse(src[i]);
     }
 }
 
-void drawItem::copyWithByteShift(uint8_t *dst, uint8_t *src, uint8_t src_len, uint8_t offset) {
-    switch (type) {
-        case DRAW_MASK:
-            for (uint8_t i = 0; i < src_len; i++) {
-                dst[i + offset] &= ~(src[i]);
+void drawItem::copyWithBitShift(uint8_t *dst, const uint8_t *src, uint8_t src_len, int16_t offset) {
+    // Composite src into dst starting at pixel 'offset'. Every output word is
+    // funnel-shifted together from two consecutive source words.
+    int32_t dstByte = offset >> 3;  // floor, also for negative offsets
+    uint8_t shift = offset & 7;
+    int32_t dstLen = effectiveXRes / 8;
+    bool mask = (type == DRAW_MASK);
+    uint32_t carry = 0;
+    uint16_t i = 0;
+
+    for (; i + 4 <= src_len; i += 4) {
+        uint32_t word = load_be32(&src[i]);
+        uint32_t out = shift ? ((word >> shift) | carry) : word;
+        carry = shift ? (word << (32 - shift)) : 0;
+
+        int32_t d = dstByte + i;
+        if (d >= 0 && d + 4 <= dstLen) {
+            uint32_t cur = load_be32(&dst[d]);
+            store_be32(&dst[d], mask ? (cur & ~out) : (cur | out));
+        } else {
+            for (uint8_t b = 0; b < 4; b++) {
+                compositeByte(dst, d + b, dstLen, (uint8_t)(out >> (24 - (8 * b))), mask);
             }
-            break;
-        default:
-            for (uint8_t i = 0; i < src_len; i++) {
-                dst[i + offset] |= src[i];
-            }
-            break;
+        }
+    }
+
+    for (; i < src_len; i++) {
+        uint8_t out = shift ? ((src[i] >> shift) | (uint8_t)(carry >> 24)) : src[i];
+        carry = shift ? ((uint32_t)src[i] << (32 - shift)) : 0;
+        compositeByte(dst, dstByte + i, dstLen, out, mask);
+    }
+
+    // Bits shifted out of the last source byte
+    if (shift) {
+        compositeByte(dst, dstByte + src_len, dstLen, (uint8_t)(carry >> 24), mask);
+    }
+}
+
+void drawItem::compositeByte(uint8_t *dst, int32_t index, int32_t dstLen, uint8_t src, bool mask) {
+    if (index < 0 || index >= dstLen) return;
+    if (mask) {
+        dst[index] &= ~src;
+    } else {
+        dst[index] |= src;
     }
 }
 
 void drawItem::renderDrawLine(uint8_t *line, uint16_t number, uint8_t c) {
-    drawItem *curDrawItem;
-    for (uint8_t i = 0; i < DRAWITEM_LIST_SIZE; i++) {
-        curDrawItem = drawItems[i];
-        if (curDrawItem != nullptr) {
-            curDrawItem->getDrawLine(line, number, c);
+    uint8_t *planes[DRAWITEM_COLOR_COUNT] = {nullptr};
+    if (c >= DRAWITEM_COLOR_COUNT) return;
+    planes[c] = line;
+    renderDrawLinePlanes(number, planes, c + 1);
+}
+
+void drawItem::renderDrawLinePlanes(uint16_t number, uint8_t **planes, uint8_t nplanes) {
+    if (drawIndexDirty) buildIndex();
+    if (drawBandCount == 0) return;
+    if (nplanes > DRAWITEM_COLOR_COUNT) nplanes = DRAWITEM_COLOR_COUNT;
+
+    // Scans run line by line, so the band is almost always the last one or its neighbour
+    uint16_t band = drawLastBand;
+    while (band > 0 && number < drawBandStart[band]) band--;
+    while (band + 1 < drawBandCount && number >= drawBandStart[band + 1]) band++;
+    drawLastBand = band;
+
+    const uint32_t *bandItems = &drawBandItems[band * drawIndexWords];
+    for (uint16_t w = 0; w < drawIndexWords; w++) {
+        uint32_t colorItems = 0;
+        for (uint8_t c = 0; c < nplanes; c++) {
+            if (planes[c] != nullptr) colorItems |= drawColorItems[(c * drawIndexWords) + w];
+        }
+        uint32_t items = bandItems[w] & colorItems;
+
+        // Lowest slot first, masks have to be applied on top of earlier items
+        while (items) {
+            uint8_t bit = __builtin_ctz(items);
+            items &= items - 1;
+            drawItem *curDrawItem = drawItems[(w * DRAWITEM_MASK_BITS) + bit];
+
+            // Multi-plane sources fetch their line once and split it into all colors
+            if (!curDrawItem->direction && curDrawItem->getXLinePlanes(planes, nplanes, number)) continue;
+
+            for (uint8_t c = 0; c < nplanes; c++) {
+                if (planes[c] != nullptr && (drawColorItems[(c * drawIndexWords) + w] & (1UL << bit))) {
+                    curDrawItem->getDrawLine(planes[c], number, c);
+                }
+            }
         }
     }
 }
 
 void drawItem::flushDrawItems() {
-    drawItem *curDrawItem;
-    for (uint8_t i = 0; i < DRAWITEM_LIST_SIZE; i++) {
-        curDrawItem = drawItems[i];
-        if (curDrawItem != nullptr) {
-            delete curDrawItem;
-            drawItems[i] = nullptr;
+    for (uint16_t i = 0; i < drawItemCount; i++) {
+        delete drawItems[i];
+    }
+    drawArenaFree(drawItems);
+    drawItems = nullptr;
+    drawItemCount = 0;
+    drawItemCapacity = 0;
+
+    while (drawItemChunks != nullptr) {
+        drawItemChunk *next = drawItemChunks->next;
+        drawArenaFree(drawItemChunks);
+        drawItemChunks = next;
+    }
+    drawItemFreeSlots = nullptr;
+
+    drawArenaFree(drawIndex);
+    drawIndex = nullptr;
+    drawIndexCapacity = 0;
+    drawIndexWords = 0;
+    drawBandCount = 0;
+    drawIndexDirty = true;
+
+    drawArenaFree(glyphCache);
+    glyphCache = nullptr;
+    glyphCachePool = nullptr;
+    glyphCacheCount = 0;
+    glyphCacheUsed = 0;
+    drawArenaReset();
+#ifdef DEBUG_DRAWING
+    printf("DRAW: arena high water %d of %d bytes\n", drawArenaHighWater, drawArenaSize);
+#endif
+}
+
+void *drawItem::operator new(size_t size) noexcept {
+    (void)size;  // every item takes one pool slot
+    // The list is full, so the item couldn't be drawn anyway
+    if (drawItemCount >= drawItemBudget) {
+        drawItemsDropped++;
+#ifdef DEBUG_DRAWING
+        printf("DRAW: draw list full at %d items, dropping item\n", drawItemCount);
+#endif
+        return nullptr;
+    }
+
+    if (drawItemFreeSlots == nullptr) {
+        drawItemChunk *chunk = (drawItemChunk *)drawArenaAlloc(sizeof(drawItemChunk));
+        if (chunk == nullptr) return nullptr;
+        chunk->next = drawItemChunks;
+        drawItemChunks = chunk;
+        for (uint8_t i = 0; i < DRAWITEM_POOL_CHUNK; i++) {
+            chunk->slots[i].next = drawItemFreeSlots;
+            drawItemFreeSlots = &chunk->slots[i];
         }
     }
+
+    drawItemSlot *slot = drawItemFreeSlots;
+    drawItemFreeSlots = slot->next;
+    return slot;
+}
+
+void drawItem::operator delete(void *ptr) {
+    if (ptr == nullptr) return;
+    drawItemSlot *slot = (drawItemSlot *)ptr;
+    slot->next = drawItemFreeSlots;
+    drawItemFreeSlots = slot;
+}
+
+void drawItem::buildIndex() {
+    drawBandCount = 0;
+    drawLastBand = 0;
+    drawIndexDirty = false;
+
+    // Sized for the capacity of the list, which only doubles, so it's rarely reallocated
+    if (drawItemCount > drawIndexCapacity) {
+        drawArenaFree(drawIndex);
+        uint16_t words = (drawItemCapacity + DRAWITEM_MASK_BITS - 1) / DRAWITEM_MASK_BITS;
+        uint32_t bands = (2 * drawItemCapacity) + 1;
+        uint32_t size = (bands * (1 + words)) + (DRAWITEM_COLOR_COUNT * words) + (2 * drawItemCapacity);
+        drawIndex = (uint32_t *)drawArenaAlloc(size * sizeof(uint32_t));
+        if (drawIndex == nullptr) {
+            drawIndexCapacity = 0;
+            drawIndexWords = 0;
+#ifdef DEBUG_DRAWING
+            printf("DRAW: no memory to index %d items\n", drawItemCount);
+#endif
+            return;
+        }
+        drawIndexCapacity = drawItemCapacity;
+        drawIndexWords = words;
+        drawBandStart = drawIndex;
+        drawBandItems = &drawBandStart[bands];
+        drawColorItems = &drawBandItems[bands * words];
+        drawItemFirst = &drawColorItems[DRAWITEM_COLOR_COUNT * words];
+        drawItemLast = &drawItemFirst[drawItemCapacity];
+    }
+    if (drawIndex == nullptr) return;
+
+    uint32_t *first = drawItemFirst;
+    uint32_t *last = drawItemLast;
+    memset(drawColorItems, 0, DRAWITEM_COLOR_COUNT * drawIndexWords * sizeof(uint32_t));
+
+    // Collect the sorted, unique band boundaries
+    drawBandStart[drawBandCount++] = 0;
+    for (uint16_t i = 0; i < drawItemCount; i++) {
+        first[i] = last[i] = 0;
+        drawItems[i]->getLineRange(&first[i], &last[i]);
+        if (first[i] >= last[i]) continue;
+
+        uint16_t word = i / DRAWITEM_MASK_BITS;
+        uint32_t bit = 1UL << (i % DRAWITEM_MASK_BITS);
+        for (uint8_t c = 0; c < DRAWITEM_COLOR_COUNT; c++) {
+            if (drawItems[i]->contributesToColor(c)) drawColorItems[(c * drawIndexWords) + word] |= bit;
+        }
+
+        uint32_t bounds[2] = {first[i], last[i]};
+        for (uint8_t b = 0; b < 2; b++) {
+            if (bounds[b] >= DRAWITEM_LINE_END) continue;
+            uint16_t pos = drawBandCount;
+            while (pos > 0 && drawBandStart[pos - 1] > bounds[b]) pos--;
+            if (pos > 0 && drawBandStart[pos - 1] == bounds[b]) continue;
+            memmove(&drawBandStart[pos + 1], &drawBandStart[pos], (drawBandCount - pos) * sizeof(drawBandStart[0]));
+            drawBandStart[pos] = bounds[b];
+            drawBandCount++;
+        }
+    }
+
+    for (uint16_t band = 0; band < drawBandCount; band++) {
+        uint32_t *bandItems = &drawBandItems[band * drawIndexWords];
+        memset(bandItems, 0, drawIndexWords * sizeof(uint32_t));
+        for (uint16_t i = 0; i < drawItemCount; i++) {
+            if (first[i] <= drawBandStart[band] && drawBandStart[band] < last[i]) {
+                bandItems[i / DRAWITEM_MASK_BITS] |= (1UL << (i % DRAWITEM_MASK_BITS));
+            }
+        }
+    }
+
+    // Size the line buffers for the widest item, they're reused for every line of the frame
+    uint16_t scratchSize = 0;
+    for (uint16_t i = 0; i < drawItemCount; i++) {
+        if (drawItems[i]->widthBytes > scratchSize) scratchSize = drawItems[i]->widthBytes;
+    }
+    if (scratchSize > drawScratchSize) {
+        for (uint8_t i = 0; i < DRAWITEM_SCRATCH_LINES; i++) {
+            drawArenaFree(drawScratch[i]);
+            drawScratch[i] = (uint8_t *)drawArenaAlloc(scratchSize);
+        }
+        drawScratchSize = scratchSize;
+    }
+
+#ifdef DEBUG_DRAWING
+    printf("DRAW: indexed draw list into %d bands\n", drawBandCount);
+#endif
+}
+
+void drawItem::getLineRange(uint32_t *first, uint32_t *last) {
+    int32_t start = 0;
+    int32_t end = 0;
+    switch (type) {
+        case DRAW_EEPROM_1BPP:
+        case DRAW_EEPROM_2BPP:
+            // Fullscreen images ignore their position and are only drawn in X direction
+            if (direction) break;
+            start = 0;
+            end = DRAWITEM_LINE_END;
+            break;
+        default:
+            if (direction) {
+                start = xpos;
+                end = xpos + width;
+            } else {
+                start = ypos;
+                end = ypos + height;
+            }
+            break;
+    }
+    if (start < 0) start = 0;
+    if (end < start) end = start;
+    *first = start;
+    *last = end;
+}
+
+bool drawItem::contributesToColor(uint8_t c) {
+    switch (type) {
+        case DRAW_COMPRESSED:
+            // 2bpp images contribute to every color
+            return (color == 2) || (c == color);
+        case DRAW_EEPROM_2BPP:
+            return true;
+        default:
+            return c == color;
+    }
 }
 
 void drawItem::getXLine(uint8_t *line, uint16_t y, uint8_t c) {
@@ -510,16 +1326,16 @@ void drawItem::getXLine(uint8_t *line, uint16_t y, uint8_t c) {
                 // y = height-y;
                 if (mirrorV) {
                     if (mirrorH) {
-                        reverseBytes(&buffer[((height - (y - ypos)) * widthBytes)], widthBytes);
+                        reverseBytes(&buffer[((height - 1 - (y - ypos)) * widthBytes)], widthBytes);
                         // reverseBytes(&buffer[((y - ypos) * widthBytes)], widthBytes);
                     } else {
                         reverseBytes(&buffer[((y - ypos) * widthBytes)], widthBytes);
                     }
                 }
                 if (mirrorH) {
-                    copyWithByteShift(line, &buffer[((height - (y - ypos)) * widthBytes)], drawnWidthBytes, xpos / 8);
+                    copyWithBitShift(line, &buffer[((height - 1 - (y - ypos)) * widthBytes)], drawnWidthBytes, xpos);
                 } else {
-                    copyWithByteShift(line, &buffer[((y - ypos) * widthBytes)], drawnWidthBytes, xpos / 8);
+                    copyWithBitShift(line, &buffer[((y - ypos) * widthBytes)], drawnWidthBytes, xpos);
                 }
             }
             break;
@@ -528,72 +1344,68 @@ void drawItem::getXLine(uint8_t *line, uint16_t y, uint8_t c) {
             if (color == 2) {
                 // decompress 2bpp
                 if ((y >= ypos) && (y < height + ypos)) {
-                    uint32_t offset = this->imageHeaderOffset;
+                    uint8_t *dbuffer_b = drawScratch[0];
+                    if (!dbuffer_b) return;
 
-                    // get the offset for the second bitplane
-                    uint32_t offset_r = offset + (1 * height * widthBytes);
-
-                    decompress **decomp = (decompress **)this->buffer;
-                    uint8_t *dbuffer_b = (uint8_t *)malloc(widthBytes);
-                    uint8_t *dbuffer_r = (uint8_t *)malloc(widthBytes);
-
-                    // Read the requested line of B/W from the first frame
-                    // Read the requested line of R/Y from the second frame
-                    if (mirrorH) {
-                        decomp[0]->getBlock(offset + (height - (y - ypos)) * widthBytes, dbuffer_b, widthBytes);
-                        decomp[1]->getBlock(offset_r + (height - (y - ypos)) * widthBytes, dbuffer_r, widthBytes);
-                    } else {
-                        decomp[0]->getBlock(offset + (y - ypos) * widthBytes, dbuffer_b, widthBytes);
-                        decomp[1]->getBlock(offset_r + (y - ypos) * widthBytes, dbuffer_r, widthBytes);
-                    }
-
-                    // Do bitwise operations to get different color planes
-                    // color table:
-                    //   | color  | BW | RY |
-                    //   | white  | 0  | 0  |
-                    //   | black  | 1  | 0  |
-                    //   | red    | 0  | 1  |
-                    //   | yellow | 1  | 1  |
-                    switch (c) {
-                        case COLOR_BLACK:
-                            invert_bytes(dbuffer_r, widthBytes);
-                            and_array(dbuffer_b, dbuffer_r, widthBytes);
-                            break;
-                        case COLOR_RED:
-                            invert_bytes(dbuffer_b, widthBytes);
-                            and_array(dbuffer_b, dbuffer_r, widthBytes);
-                            break;
-                        case COLOR_YELLOW:
-                            and_array(dbuffer_b, dbuffer_r, widthBytes);
-                            break;
-                    }
+                    // Combine the requested line of B/W and R/Y straight out of the decompressor cache
+                    uint16_t row = mirrorH ? (height - 1 - (y - ypos)) : (y - ypos);
+                    const uint8_t *src_b;
+                    const uint8_t *src_r;
+                    if (!compressedRowSpans(row, &src_b, &src_r)) return;
+                    combine_planes(dbuffer_b, src_b, src_r, c, widthBytes);
 
                     if (mirrorV) {
                         reverseBytes(dbuffer_b, widthBytes);
                     }
 
-                    copyWithByteShift(line, dbuffer_b, drawnWidthBytes, xpos / 8);
-                    free(dbuffer_b);
-                    free(dbuffer_r);
+                    copyWithBitShift(line, dbuffer_b, drawnWidthBytes, xpos);
                 }
             } else {
                 // 1bpp (black/white)
                 if ((y >= ypos) && (y < height + ypos)) {
-                    uint32_t offset = this->imageHeaderOffset;
-                    decompress **decomp = (decompress **)this->buffer;
-                    uint8_t *dbuffer_b = (uint8_t *)malloc(widthBytes);
-
-                    if (mirrorH) {
-                        decomp[0]->getBlock(offset + (height - (y - ypos)) * widthBytes, dbuffer_b, widthBytes);
-                    } else {
-                        decomp[0]->getBlock(offset + (y - ypos) * widthBytes, dbuffer_b, widthBytes);
-                    }
+                    uint16_t row = mirrorH ? (height - 1 - (y - ypos)) : (y - ypos);
+                    const uint8_t *src = compressedPlane(0)->getSpan(compressedRowOffset(0, row), widthBytes);
+                    if (!src) return;
 
+                    // the span points into the decompressor cache, only copy it if it needs reversing
                     if (mirrorV) {
+                        uint8_t *dbuffer_b = drawScratch[0];
+                        if (!dbuffer_b) return;
+                        memcpy(dbuffer_b, src, widthBytes);
                         reverseBytes(dbuffer_b, widthBytes);
+                        src = dbuffer_b;
                     }
-                    copyWithByteShift(line, dbuffer_b, drawnWidthBytes, xpos / 8);
-                    free(dbuffer_b);
+                    copyWithBitShift(line, src, drawnWidthBytes, xpos);
+                }
+            }
+            break;
+        case DRAW_RLE_1BPP:
+            if (c != color) return;
+            if ((y >= ypos) && (y < height + ypos)) {
+                // Every row can be found through the offset table, so there's nothing to rewind
+                uint16_t row = mirrorH ? (height - 1 - (y - ypos)) : (y - ypos);
+                uint32_t rowOffset;
+                HAL_flashRead((uint32_t)(uintptr_t)buffer + (row * sizeof(rowOffset)), (uint8_t *)&rowOffset, sizeof(rowOffset));
+                rleReader reader;
+                reader.addr = (uint32_t)(uintptr_t)buffer + (height * sizeof(rowOffset)) + rowOffset;
+                reader.pos = RLE_READ_CHUNK;
+
+                // Only the black runs are drawn. There are at most width + 1 runs in a valid
+                // row, which also stops a corrupt one from looping forever
+                uint16_t x = 0;
+                bool black = false;
+                for (uint32_t runs = 0; x < width && runs <= width; runs++) {
+                    uint32_t run = rleNextRun(&reader);
+                    if (run > (uint32_t)(width - x)) run = width - x;
+                    if (black && run) {
+                        if (mirrorV) {
+                            fillSpan(line, xpos + width - x - run, xpos + width - x, false);
+                        } else {
+                            fillSpan(line, xpos + x, xpos + x + run, false);
+                        }
+                    }
+                    x += run;
+                    black = !black;
                 }
             }
             break;
@@ -602,13 +1414,13 @@ void drawItem::getXLine(uint8_t *line, uint16_t y, uint8_t c) {
             if (mirrorH)
                 y = effectiveYRes - 1 - y;
             if (mirrorV) {
-                uint8_t *dbuffer = (uint8_t *)malloc(widthBytes);
-                HAL_flashRead((uint32_t)buffer + (y * (effectiveXRes / 8)), dbuffer, (effectiveXRes / 8));
+                uint8_t *dbuffer = drawScratch[0];
+                if (!dbuffer) return;
+                HAL_flashRead((uint32_t)(uintptr_t)buffer + (y * (effectiveXRes / 8)), dbuffer, (effectiveXRes / 8));
                 reverseBytes(dbuffer, widthBytes);
                 memcpy(line, dbuffer, widthBytes);
-                free(dbuffer);
             } else {
-                HAL_flashRead((uint32_t)buffer + (y * (effectiveXRes / 8)), line, (effectiveXRes / 8));
+                HAL_flashRead((uint32_t)(uintptr_t)buffer + (y * (effectiveXRes / 8)), line, (effectiveXRes / 8));
             }
             break;
         case DRAW_EEPROM_2BPP:
@@ -617,12 +1429,13 @@ void drawItem::getXLine(uint8_t *line, uint16_t y, uint8_t c) {
             }
             {
                 // Inline declaration of variables in a case statement can only happen inside a block
-                uint8_t *dbuffer_r = (uint8_t *)malloc(widthBytes);
-                uint8_t *dbuffer_b = (uint8_t *)malloc(widthBytes);
+                uint8_t *dbuffer_r = drawScratch[1];
+                uint8_t *dbuffer_b = drawScratch[0];
+                if (!dbuffer_b || !dbuffer_r) return;
                 // Read the requested line of B/W from the first frame
-                HAL_flashRead((uint32_t)(buffer + ((y + (0 * effectiveYRes)) * (effectiveXRes / 8))), dbuffer_b, (effectiveXRes / 8));
+                HAL_flashRead((uint32_t)(uintptr_t)(buffer + ((y + (0 * effectiveYRes)) * (effectiveXRes / 8))), dbuffer_b, (effectiveXRes / 8));
                 // Read the requested line of R/Y from the second frame
-                HAL_flashRead((uint32_t)(buffer + ((y + (1 * effectiveYRes)) * (effectiveXRes / 8))), dbuffer_r, (effectiveXRes / 8));
+                HAL_flashRead((uint32_t)(uintptr_t)(buffer + ((y + (1 * effectiveYRes)) * (effectiveXRes / 8))), dbuffer_r, (effectiveXRes / 8));
                 switch (c) {
                     // color table:
                     //   | color  | BW | RY |
@@ -645,17 +1458,114 @@ void drawItem::getXLine(uint8_t *line, uint16_t y, uint8_t c) {
                 if (mirrorV) {
                     reverseBytes(dbuffer_b, widthBytes);
                 }
-                copyWithByteShift(line, dbuffer_b, drawnWidthBytes, xpos / 8);
-                free(dbuffer_b);
-                free(dbuffer_r);
+                copyWithBitShift(line, dbuffer_b, drawnWidthBytes, xpos);
             }   
             break;
+        case DRAW_RECT:
+            if (c != color) return;
+            if ((y >= ypos) && (y < height + ypos)) {
+                uint16_t row = y - ypos;
+                uint16_t inset = roundedInset(width, height, cornerDiameter, row);
+                int32_t left = xpos + inset;
+                int32_t right = xpos + width - inset;
+                if (thickness == 0 || row < thickness || (row + thickness) >= height || (2 * thickness) >= width) {
+                    fillSpan(line, left, right, erase);
+                } else {
+                    // an outline is the outer shape minus the inner one, which has smaller corners
+                    uint16_t innerDiameter = (cornerDiameter > (2 * thickness)) ? (cornerDiameter - (2 * thickness)) : 0;
+                    uint16_t innerInset = roundedInset(width - (2 * thickness), height - (2 * thickness), innerDiameter, row - thickness);
+                    fillSpan(line, left, xpos + thickness + innerInset, erase);
+                    fillSpan(line, xpos + width - thickness - innerInset, right, erase);
+                }
+            }
+            break;
+        case DRAW_LINE:
+            if (c != color) return;
+            if ((y >= ypos) && (y < height + ypos)) {
+                // Pixels of row k are the ones whose rounded position along the line lands on it
+                int32_t k = y - ypos;
+                int32_t dx = width - 1;
+                int32_t dy = height - 1;
+                int32_t start, end;
+                if (dy == 0) {
+                    start = 0;
+                    end = dx + 1;
+                } else if (dx <= dy) {
+                    start = ((2 * k * dx) + dy) / (2 * dy);
+                    end = start + 1;
+                } else {
+                    start = (k == 0) ? 0 : ((((2 * k) - 1) * dx) + (2 * dy) - 1) / (2 * dy);
+                    end = ((((2 * k) + 1) * dx) + (2 * dy) - 1) / (2 * dy);
+                    if (end > dx + 1) end = dx + 1;
+                }
+                if (mirrorV) {
+                    int32_t temp = start;
+                    start = dx + 1 - end;
+                    end = dx + 1 - temp;
+                }
+                fillSpan(line, xpos + start, xpos + end, erase);
+            }
+            break;
+        case DRAW_QR:
+            if (c != color) return;
+            if ((y >= ypos) && (y < height + ypos)) {
+                uint8_t *dbuffer = drawScratch[0];
+                if (dbuffer == nullptr) return;
+                uint8_t count = height / moduleScale;
+                uint16_t row = (y - ypos) / moduleScale;
+                expandModules(dbuffer, &buffer[row * ((count + 7) / 8)], count, moduleScale);
+                copyWithBitShift(line, dbuffer, drawnWidthBytes, xpos);
+            }
+            break;
         default:
             printf("DRAW: Not supported mode!\n");
             break;
     }
 }
 
+bool drawItem::getXLinePlanes(uint8_t **planes, uint8_t nplanes, uint16_t y) {
+    if (type != DRAW_EEPROM_2BPP && !(type == DRAW_COMPRESSED && color == 2)) return false;
+    if (type == DRAW_COMPRESSED && !((y >= ypos) && (y < height + ypos))) return true;
+
+    uint8_t *dbuffer_b = drawScratch[0];
+    uint8_t *dbuffer_r = drawScratch[1];
+    uint8_t *dbuffer_c = drawScratch[2];
+    if (!dbuffer_b || !dbuffer_r || !dbuffer_c) {
+        // fall back to fetching per color
+        return false;
+    }
+
+    const uint8_t *src_b = dbuffer_b;
+    const uint8_t *src_r = dbuffer_r;
+    if (type == DRAW_EEPROM_2BPP) {
+        if (mirrorH) {
+            y = effectiveYRes - 1 - y;
+        }
+        // Read the requested line of B/W from the first frame, and R/Y from the second frame
+        HAL_flashRead((uint32_t)(uintptr_t)(buffer + ((y + (0 * effectiveYRes)) * (effectiveXRes / 8))), dbuffer_b, (effectiveXRes / 8));
+        HAL_flashRead((uint32_t)(uintptr_t)(buffer + ((y + (1 * effectiveYRes)) * (effectiveXRes / 8))), dbuffer_r, (effectiveXRes / 8));
+    } else {
+        // compressed rows are used straight out of the decompressor cache
+        uint16_t row = mirrorH ? (height - 1 - (y - ypos)) : (y - ypos);
+        if (!compressedRowSpans(row, &src_b, &src_r)) return true;
+    }
+
+    for (uint8_t c = 0; c < nplanes; c++) {
+        if (planes[c] == nullptr) continue;
+        if (c > COLOR_YELLOW) {
+            memcpy(dbuffer_c, src_b, widthBytes);
+        } else {
+            combine_planes(dbuffer_c, src_b, src_r, c, widthBytes);
+        }
+        if (mirrorV) {
+            reverseBytes(dbuffer_c, widthBytes);
+        }
+        copyWithBitShift(planes[c], dbuffer_c, drawnWidthBytes, xpos);
+    }
+
+    return true;
+}
+
 void drawItem::getYLine(uint8_t *line, uint16_t x, uint8_t c) {
     switch (type) {
         case DRAW_FONT:
@@ -667,7 +1577,7 @@ void drawItem::getYLine(uint8_t *line, uint16_t x, uint8_t c) {
                     uint16_t curYMirrored = curY;
                     if (!mirrorH) curYMirrored = height - 1 - curY;
                     if (mirrorV) {
-                        if (buffer[((width - x) / 8) + (curYMirrored * widthBytes)] & (1 << (7 - ((width - x) % 8)))) {
+                        if (buffer[((width - 1 - x) / 8) + (curYMirrored * widthBytes)] & (1 << (7 - ((width - 1 - x) % 8)))) {
                             line[(curY + ypos) / 8] |= (1 << (7 - ((curY + ypos) % 8)));
                         }
                     } else {
@@ -686,7 +1596,7 @@ void drawItem::getYLine(uint8_t *line, uint16_t x, uint8_t c) {
                     uint16_t curYMirrored = curY;
                     if (!mirrorH) curYMirrored = height - 1 - curY;
                     if (mirrorV) {
-                        if (buffer[((width - x) / 8) + (curYMirrored * widthBytes)] & (1 << (7 - ((width - x) % 8)))) {
+                        if (buffer[((width - 1 - x) / 8) + (curYMirrored * widthBytes)] & (1 << (7 - ((width - 1 - x) % 8)))) {
                             line[(curY + ypos) / 8] &= ~(1 << (7 - ((curY + ypos) % 8)));
                         }
                     } else {
@@ -698,26 +1608,12 @@ void drawItem::getYLine(uint8_t *line, uint16_t x, uint8_t c) {
             }
             break;
         case DRAW_COMPRESSED:
-            // this is incredibly slow, and very naive. Just don't. Maybe if you want to test if everything works. It'll decompress about 50% of the file *PER PIXEL*. Good for load testing
+            // Columns are streamed out of the image a strip at a time and transposed, so the
+            // image is inflated once per strip instead of once per pixel
             if ((color < 2) && (c != color)) return;
             if ((x >= xpos) && (x < width + xpos)) {
-                uint32_t offset = this->imageHeaderOffset;
-                offset += c * height * widthBytes;
-                decompress *decomp = (decompress *)this->buffer;
-                x -= xpos;
-                for (uint16_t curY = 0; curY < height; curY++) {
-                    uint16_t curYMirrored = curY;
-                    if (!mirrorH) curYMirrored = height - 1 - curY;
-                    if (mirrorV) {
-                        if (decomp->readByte(offset + ((width - x) / 8) + (curYMirrored * widthBytes)) & (1 << (7 - ((width - x) % 8)))) {
-                            line[(curY + ypos) / 8] |= (1 << (7 - ((curY + ypos) % 8)));
-                        }
-                    } else {
-                        if (decomp->readByte(offset + (x / 8) + (curYMirrored * widthBytes)) & (1 << (7 - (x % 8)))) {
-                            line[(curY + ypos) / 8] |= (1 << (7 - ((curY + ypos) % 8)));
-                        }
-                    }
-                }
+                uint8_t *column = getCompressedColumn(x - xpos, c);
+                if (column != nullptr) copyWithBitShift(line, column, (height + 7) / 8, ypos);
             }
             break;
 
@@ -743,13 +1639,182 @@ void drawItem::addItem(uint8_t *data, uint16_t w, uint16_t h) {
 }
 
 bool drawItem::addToList() {
-    for (uint8_t i = 0; i < DRAWITEM_LIST_SIZE; i++) {
-        if (drawItems[i] == nullptr) {
-            drawItems[i] = this;
-            return true;
-        };
+    // The list takes ownership, so an item that doesn't fit is deleted here
+    if (drawItemCount >= drawItemCapacity) {
+        uint16_t capacity = drawItemCapacity ? (drawItemCapacity * 2) : DRAWITEM_POOL_CHUNK;
+        if (capacity > drawItemBudget) capacity = drawItemBudget;
+        drawItem **list = nullptr;
+        if (capacity > drawItemCount) list = (drawItem **)drawArenaAlloc(capacity * sizeof(drawItem *));
+        if (list == nullptr) {
+            drawItemsDropped++;
+#ifdef DEBUG_DRAWING
+            printf("DRAW: draw list full at %d items, dropping item\n", drawItemCount);
+#endif
+            delete this;
+            return false;
+        }
+        if (drawItemCount) memcpy(list, drawItems, drawItemCount * sizeof(drawItem *));
+        drawArenaFree(drawItems);
+        drawItems = list;
+        drawItemCapacity = capacity;
     }
-    return false;
+
+    // Rotated sprites are turned once here, so they render through getXLine.
+    // If there's no memory for the copy, getYLine still draws them pixel by pixel
+    if (direction) transposeToXLines();
+    drawItems[drawItemCount++] = this;
+    if (drawItemCount > drawItemHighWater) drawItemHighWater = drawItemCount;
+    drawIndexDirty = true;
+    return true;
+}
+
+bool drawItem::transposeToXLines() {
+    switch (type) {
+        case DRAW_FONT:
+        case DRAW_BUFFERED_1BPP:
+        case DRAW_MASK:
+            break;
+        default:
+            return false;
+    }
+
+    // Every source column becomes a row, in the order and orientation getYLine would draw it
+    uint8_t outWidthBytes = (height + 7) / 8;
+    uint8_t *out = (uint8_t *)drawArenaCalloc(width * outWidthBytes);
+    if (out == nullptr) return false;
+
+    uint8_t rows[8];
+    uint8_t cols[8];
+    for (uint16_t k = 0; k < outWidthBytes; k++) {
+        for (uint16_t m = 0; m < widthBytes; m++) {
+            for (uint8_t j = 0; j < 8; j++) {
+                uint16_t curY = (k * 8) + j;
+                uint16_t curYMirrored = mirrorH ? curY : (height - 1 - curY);
+                rows[j] = (curY < height) ? buffer[m + (curYMirrored * widthBytes)] : 0;
+            }
+            transpose8x8(rows, cols);
+            for (uint8_t i = 0; i < 8; i++) {
+                uint16_t srcX = (m * 8) + i;
+                if (srcX >= width) break;
+                uint16_t x = mirrorV ? (width - 1 - srcX) : srcX;
+                out[k + (x * outWidthBytes)] = cols[i];
+            }
+        }
+    }
+
+    if (cleanUp) drawArenaFree(buffer);
+    cleanUp = true;
+
+    int16_t temp = xpos;
+    xpos = ypos;
+    ypos = temp;
+    addItem(out, height, width);
+    direction = false;
+    mirrorH = false;
+    mirrorV = false;
+    checkBounds();
+    return true;
+}
+
+// Stream position of a row of one bitplane of a compressed image
+uint32_t drawItem::compressedRowOffset(uint8_t plane, uint16_t row) {
+    if (planesInterleaved) return this->imageHeaderOffset + ((((uint32_t)row * 2) + plane) * widthBytes);
+    return this->imageHeaderOffset + ((((uint32_t)plane * height) + row) * widthBytes);
+}
+
+decompress *drawItem::compressedPlane(uint8_t plane) {
+    decompress **decomp = (decompress **)this->buffer;
+    return planesInterleaved ? decomp[0] : decomp[plane];
+}
+
+// Finds both plane rows of a compressed 2bpp image in the decompressor cache. Interleaved rows
+// come from the same stream, so they're fetched as one span to keep the first one valid
+bool drawItem::compressedRowSpans(uint16_t row, const uint8_t **bw, const uint8_t **ry) {
+    if (planesInterleaved) {
+        *bw = compressedPlane(0)->getSpan(compressedRowOffset(0, row), 2 * widthBytes);
+        *ry = *bw ? *bw + widthBytes : nullptr;
+    } else {
+        *bw = compressedPlane(0)->getSpan(compressedRowOffset(0, row), widthBytes);
+        *ry = compressedPlane(1)->getSpan(compressedRowOffset(1, row), widthBytes);
+    }
+    return (*bw != nullptr) && (*ry != nullptr);
+}
+
+uint8_t *drawItem::getCompressedColumn(uint16_t x, uint8_t c) {
+    uint8_t outWidthBytes = (height + 7) / 8;
+    uint8_t planes = (color == 2) ? 2 : 1;
+    uint16_t stripLen = DRAWITEM_COLUMN_STRIP_BYTES * 8;
+    uint16_t srcX = mirrorV ? (width - 1 - x) : x;
+    int32_t strip = srcX / stripLen;
+
+    // Layout: transposed columns for every plane, the untransposed strip, and one output column
+    uint32_t columnsSize = planes * stripLen * outWidthBytes;
+    uint32_t rawSize = DRAWITEM_COLUMN_STRIP_BYTES * outWidthBytes * 8;
+    if (columnCache == nullptr) {
+        columnCache = (uint8_t *)drawArenaAlloc(columnsSize + rawSize + outWidthBytes);
+        if (columnCache == nullptr) return nullptr;
+        columnCacheStrip = -1;
+    }
+    uint8_t *columns = columnCache;
+    uint8_t *raw = columns + columnsSize;
+    uint8_t *out = raw + rawSize;
+
+    if (strip != columnCacheStrip) {
+        // Fetch the strip with one forward pass per plane, rows in ascending order so the
+        // stream never has to rewind, then transpose it 8x8 at a time
+        uint16_t stripStart = strip * DRAWITEM_COLUMN_STRIP_BYTES;
+        uint16_t stripBytes = DRAWITEM_COLUMN_STRIP_BYTES;
+        if (stripStart + stripBytes > widthBytes) stripBytes = widthBytes - stripStart;
+
+        for (uint8_t p = 0; p < planes; p++) {
+            memset(raw, 0, rawSize);
+            for (uint16_t row = 0; row < height; row++) {
+                uint16_t curY = mirrorH ? row : (height - 1 - row);
+                compressedPlane(p)->getBlock(compressedRowOffset(p, row) + stripStart, &raw[curY * DRAWITEM_COLUMN_STRIP_BYTES], stripBytes);
+            }
+
+            uint8_t *dst = columns + (p * stripLen * outWidthBytes);
+            uint8_t rows[8];
+            uint8_t cols[8];
+            for (uint16_t k = 0; k < outWidthBytes; k++) {
+                for (uint8_t m = 0; m < stripBytes; m++) {
+                    for (uint8_t j = 0; j < 8; j++) {
+                        rows[j] = raw[m + (((k * 8) + j) * DRAWITEM_COLUMN_STRIP_BYTES)];
+                    }
+                    transpose8x8(rows, cols);
+                    for (uint8_t i = 0; i < 8; i++) {
+                        dst[k + (((m * 8) + i) * outWidthBytes)] = cols[i];
+                    }
+                }
+            }
+        }
+        columnCacheStrip = strip;
+    }
+
+    uint8_t *col_b = columns + ((srcX % stripLen) * outWidthBytes);
+    if (planes == 1) return col_b;
+    uint8_t *col_r = col_b + (stripLen * outWidthBytes);
+
+    // color table:
+    //   | color  | BW | RY |
+    //   | white  | 0  | 0  |
+    //   | black  | 1  | 0  |
+    //   | red    | 0  | 1  |
+    //   | yellow | 1  | 1  |
+    for (uint16_t i = 0; i < outWidthBytes; i++) {
+        switch (c) {
+            case COLOR_BLACK:
+                out[i] = col_b[i] & ~col_r[i];
+                break;
+            case COLOR_RED:
+                out[i] = ~col_b[i] & col_r[i];
+                break;
+            default:
+                out[i] = col_b[i] & col_r[i];
+                break;
+        }
+    }
+    return out;
 }
 
 void drawItem::checkBounds() {
@@ -763,16 +1828,17 @@ void drawItem::checkBounds() {
 }
 
 drawItem::~drawItem() {
+    drawArenaFree(columnCache);
     if (cleanUp) {
         switch (this->type) {
             case drawItem::drawType::DRAW_COMPRESSED: {
                 decompress **dec = (decompress **)this->buffer;
                 if (dec[0]) delete dec[0];
                 if (dec[1]) delete dec[1];
-                free(dec);
+                drawArenaFree(dec);
             } break;
             default:
-                free(buffer);
+                drawArenaFree(buffer);
                 break;
         }
     }
@@ -823,13 +1889,61 @@ void fontrender::fillRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
 }
 
 // 'regular' font rendering functions
-uint8_t fontrender::getCharWidth(uint16_t c) {
-    if ((c >= gfxFont->first) && (c <= gfxFont->last)) {
-        c -= gfxFont->first;
-        GFXglyph *glyph = &(gfxFont->glyph[c]);
-        return glyph->xAdvance;
+const uint8_t *fontrender::getGlyphRows(uint16_t c) {
+    for (uint8_t i = 0; i < glyphCacheCount; i++) {
+        if (glyphCache[i].font == gfxFont && glyphCache[i].c == c) return &glyphCachePool[glyphCache[i].offset];
+    }
+
+    GFXglyph *glyph = &(gfxFont->glyph[c]);
+    uint8_t rowBytes = (glyph->width + 7) / 8;
+    uint16_t size = rowBytes * glyph->height;
+    if (size > GLYPH_CACHE_POOL_SIZE) return nullptr;
+    if (glyphCache == nullptr) {
+        glyphCache = (glyphCacheEntry *)drawArenaAlloc(GLYPH_CACHE_ENTRIES * sizeof(glyphCacheEntry) + GLYPH_CACHE_POOL_SIZE);
+        if (glyphCache == nullptr) return nullptr;
+        glyphCachePool = (uint8_t *)&glyphCache[GLYPH_CACHE_ENTRIES];
+    }
+    if (glyphCacheCount == GLYPH_CACHE_ENTRIES || glyphCacheUsed + size > GLYPH_CACHE_POOL_SIZE) {
+        glyphCacheCount = 0;
+        glyphCacheUsed = 0;
+    }
+
+    uint8_t *rows = &glyphCachePool[glyphCacheUsed];
+    memset(rows, 0, size);
+    const uint8_t *bitmap = &gfxFont->bitmap[glyph->bitmapOffset];
+    uint8_t bits = 0, bit = 0;
+    for (uint8_t yy = 0; yy < glyph->height; yy++) {
+        for (uint8_t xx = 0; xx < glyph->width; xx++) {
+            if (bit == 0) {
+                bits = *bitmap++;
+                bit = 0x80;
+            }
+            if (bits & bit) rows[(yy * rowBytes) + (xx / 8)] |= (0x80 >> (xx % 8));
+            bit >>= 1;
+        }
+    }
+
+    glyphCache[glyphCacheCount].font = gfxFont;
+    glyphCache[glyphCacheCount].c = c;
+    glyphCache[glyphCacheCount].offset = glyphCacheUsed;
+    glyphCacheCount++;
+    glyphCacheUsed += size;
+    return rows;
+}
+
+void fontrender::blitGlyphRows(const uint8_t *rows, uint8_t rowBytes, uint8_t h, int32_t x, int32_t y) {
+    int32_t startByte = x >> 3;  // floor, also for negative offsets
+    uint8_t shift = x & 7;
+    for (uint8_t yy = 0; yy < h; yy++, rows += rowBytes) {
+        if ((y + yy) < 0 || (y + yy) >= bufferHeight) continue;
+        uint8_t *dst = &fb[(y + yy) * bufferByteWidth];
+        for (uint8_t i = 0; i < rowBytes; i++) {
+            if (rows[i] == 0) continue;
+            int32_t d = startByte + i;
+            if (d >= 0 && d < bufferByteWidth) dst[d] |= rows[i] >> shift;
+            if (shift && d + 1 >= 0 && d + 1 < bufferByteWidth) dst[d + 1] |= (uint8_t)(rows[i] << (8 - shift));
+        }
     }
-    return 0;
 }
 
 fontrender::fontrender(const GFXfont *font) {
@@ -852,6 +1966,14 @@ uint8_t fontrender::drawChar(int32_t x, int32_t y, uint16_t c, uint8_t size) {
         int8_t xo = glyph->xOffset,
                yo = glyph->yOffset;
 
+        if (size == 1) {
+            const uint8_t *rows = getGlyphRows(c);
+            if (rows != nullptr) {
+                blitGlyphRows(rows, (w + 7) / 8, h, x + xo, y + yo);
+                return glyph->xAdvance;
+            }
+        }
+
         uint8_t xx, yy, bits = 0, bit = 0;
         int16_t xo16 = 0, yo16 = 0;
 
@@ -914,19 +2036,8 @@ void fontrender::epdPrintf(uint16_t x, uint16_t y, uint8_t color, enum rotation
     uint8_t len = vsnprintf(out_buffer, 255, c, lst);
     va_end(lst);
 
-    // account for offset in font rendering
-    if (!di->direction) {
-        Xpixels = x % 8;  // total drawing width increased by x%8
-    } else {
-        Xpixels = 0;
-    }
-
-    // find out the total length of the string
-    for (uint8_t c = 0; c < len; c++) {
-        Xpixels += (uint16_t)getCharWidth(out_buffer[c]);
-    }
-
-    // find out the high and low points for given font
+    // find out the total length of the string, and the high and low points for given font
+    Xpixels = 0;
     int8_t high = 0;
     int8_t low = 0;
     for (uint8_t curchar = 0; curchar < len; curchar++) {
@@ -934,6 +2045,7 @@ void fontrender::epdPrintf(uint16_t x, uint16_t y, uint8_t color, enum rotation
 
         if ((c >= gfxFont->first) && (c <= gfxFont->last)) {
             c -= gfxFont->first;
+            Xpixels += gfxFont->glyph[c].xAdvance;
             int8_t glyphUL = gfxFont->glyph[c].yOffset;
             if (glyphUL < high) high = glyphUL;
             int8_t glyphHeight = gfxFont->glyph[c].height;
@@ -949,7 +2061,8 @@ void fontrender::epdPrintf(uint16_t x, uint16_t y, uint8_t color, enum rotation
     if (Xpixels % 8) bufferByteWidth++;
 
     // allocate framebuffer
-    fb = (uint8_t *)calloc(bufferByteWidth * height, 1);
+    bufferHeight = height;
+    fb = (uint8_t *)drawArenaCalloc(bufferByteWidth * height);
 
     if (!fb) {
         printf("DRAW: Tried to allocate a buffer %d x %d\n and failed...", bufferByteWidth, height);
@@ -957,12 +2070,8 @@ void fontrender::epdPrintf(uint16_t x, uint16_t y, uint8_t color, enum rotation
         return;
     }
 
-    uint16_t curX;
-    if (!di->direction) {
-        curX = x % 8;  // start drawing at x%8s
-    } else {
-        curX = 0;
-    }
+    // the text is rendered unshifted, sub-byte x positions are handled when compositing
+    uint16_t curX = 0;
     for (uint8_t c = 0; c < len; c++) {
         curX += (uint16_t)drawChar(curX, height - low, out_buffer[c], 1);
     }
@@ -2,24 +2,33 @@
 
 #define FILENAME_LENGTH 32
 
+class decompress;
+
 void addBufferedImage(uint16_t x, uint16_t y, uint8_t color, enum rotation ro, const uint8_t *image, bool mask);
 void addFlashImage(uint16_t x, uint16_t y, uint8_t color, enum rotation ro, const uint8_t *image);
 void drawImageWithType(uint32_t addr, uint8_t type, uint32_t filesize);
+bool inflateFlashImage(uint32_t addr, uint32_t filesize, uint32_t maxsize, uint8_t *rawtype, C_imageWriter_t writer, void *ctx);
 void addQR(uint16_t x, uint16_t y, uint8_t version, uint8_t scale, const char *c, ...);
 void drawRoundedRectangle(uint16_t xpos, uint16_t ypos, uint16_t width, uint16_t height, uint8_t color);
 void drawMask(uint16_t xpos, uint16_t ypos, uint16_t width, uint16_t height, uint8_t color);
+void drawRectangle(int16_t xpos, int16_t ypos, uint16_t width, uint16_t height, uint8_t radius, uint8_t thickness, uint8_t color);
+void drawCircle(int16_t xpos, int16_t ypos, uint16_t radius, uint8_t thickness, uint8_t color);
+void drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint8_t color);
 
 class drawItem {
    public:
     drawItem();
     ~drawItem();
+    static void *operator new(size_t size) noexcept;
+    static void operator delete(void *ptr);
     void setRotation(enum rotation ro);
     void addItem(uint8_t *data, uint16_t width, uint16_t height);
     bool addToList();
 
-    static void shiftBytesRight(uint8_t *data, uint8_t shift, uint8_t len);
     static void renderDrawLine(uint8_t *line, uint16_t number, uint8_t c);
+    static void renderDrawLinePlanes(uint16_t number, uint8_t **planes, uint8_t nplanes);
     static void flushDrawItems();
+    static void buildIndex();
 
     void checkBounds();
 
@@ -34,8 +43,12 @@ class drawItem {
         DRAW_EEPROM_1BPP,
         DRAW_EEPROM_2BPP,
         DRAW_COMPRESSED,
+        DRAW_RLE_1BPP,
         DRAW_OEPLFS_1BPP,
-        DRAW_OEPLFS_2BPP
+        DRAW_OEPLFS_2BPP,
+        DRAW_RECT,
+        DRAW_LINE,
+        DRAW_QR
     } type;
 
     int16_t xpos;
@@ -53,19 +66,40 @@ class drawItem {
     uint16_t height;
 
     uint8_t imageHeaderOffset = 0;
+    // compressed 2bpp rows alternate between the planes in a single stream
+    bool planesInterleaved = false;
 
     // if this is true, clean up the reference (free memory).
     bool cleanUp = true;
 
+    // shapes (DRAW_RECT, DRAW_LINE) are described by these instead of a buffer
+    uint16_t cornerDiameter = 0;  // of the circle the corners are cut from, in pixels
+    uint16_t thickness = 0;     // outline width, 0 fills the shape
+    bool erase = false;         // clear the covered pixels instead of setting them
+
+    // DRAW_QR keeps the unscaled module matrix in buffer, each module is this many pixels
+    uint8_t moduleScale = 1;
+
    protected:
-    void copyWithByteShift(uint8_t *dst, uint8_t *src, uint8_t src_len, uint8_t offset);
+    void copyWithBitShift(uint8_t *dst, const uint8_t *src, uint8_t src_len, int16_t offset);
+    static void compositeByte(uint8_t *dst, int32_t index, int32_t dstLen, uint8_t src, bool mask);
 
     void getDrawLine(uint8_t *line, uint16_t number, uint8_t c);
     void getXLine(uint8_t *line, uint16_t yPos, uint8_t color);
     void getYLine(uint8_t *line, uint16_t xPos, uint8_t color);
+    bool getXLinePlanes(uint8_t **planes, uint8_t nplanes, uint16_t yPos);
+    void getLineRange(uint32_t *first, uint32_t *last);
+    bool contributesToColor(uint8_t c);
+    bool transposeToXLines();
+    uint8_t *getCompressedColumn(uint16_t x, uint8_t c);
+    uint32_t compressedRowOffset(uint8_t plane, uint16_t row);
+    decompress *compressedPlane(uint8_t plane);
+    bool compressedRowSpans(uint16_t row, const uint8_t **bw, const uint8_t **ry);
     uint8_t widthBytes = 0;
     uint8_t drawnWidthBytes = 0;
     uint8_t *buffer = nullptr;
+    uint8_t *columnCache = nullptr;
+    int32_t columnCacheStrip = -1;
 };
 
 class fontrender {
@@ -78,10 +112,12 @@ class fontrender {
     GFXfont *gfxFont;  // = &FreeSansBold18pt7b;
 
     uint16_t bufferByteWidth = 0;
+    uint16_t bufferHeight = 0;
     uint8_t *fb = nullptr;
     uint16_t Xpixels;
     uint8_t drawChar(int32_t x, int32_t y, uint16_t c, uint8_t size);
-    uint8_t getCharWidth(uint16_t c);
+    const uint8_t *getGlyphRows(uint16_t c);
+    void blitGlyphRows(const uint8_t *rows, uint8_t rowBytes, uint8_t h, int32_t x, int32_t y);
     void drawFastHLine(uint16_t x, uint16_t y, uint16_t w);
     void fillRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h);
 };
\ No newline at end of file
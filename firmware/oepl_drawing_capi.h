@@ -23,6 +23,36 @@ extern "C" {
 #define DRAW_INVERTED 1
 #define DRAW_NORMAL 0
 
+// Image formats which don't have a datatype or capability bit allocated in the shared OEPL
+// definitions yet. The values below are placeholders. Only the decoders exist, built in on
+// request for the host tests in test/; the application doesn't accept these types from the
+// AP until they are allocated and can be advertised.
+#ifndef OEPL_EXPERIMENTAL_IMAGE_TYPES
+#define OEPL_EXPERIMENTAL_IMAGE_TYPES 0
+#endif
+
+#if OEPL_EXPERIMENTAL_IMAGE_TYPES
+// Compressed image where the BW and R/Y rows of a 2bpp image alternate line by line, so a
+// single inflate stream produces both planes. Same header as DATATYPE_IMG_ZLIB.
+#ifndef DATATYPE_IMG_ZLIB_INTERLEAVED
+#define DATATYPE_IMG_ZLIB_INTERLEAVED 0x32
+#endif
+// Image compressed with heatshrink (LZSS) instead of zlib, for a window of a few hundred bytes
+// instead of up to 8 KB and a cheaper decode. Same 4-byte size prefix and image header as
+// DATATYPE_IMG_ZLIB, the stream starts with a byte holding window bits << 4 | lookahead bits.
+#ifndef DATATYPE_IMG_HEATSHRINK
+#define DATATYPE_IMG_HEATSHRINK 0x33
+#endif
+// Run-length coded 1bpp image, decoded straight into the scanlines. A header size byte and
+// the image header as for DATATYPE_IMG_ZLIB, then a table with a little-endian uint32 per
+// row pointing at its runs, relative to the end of the table. A row is a list of run lengths
+// alternating between white and black, starting with white, each a little-endian base-128
+// varint, until they add up to the width.
+#ifndef DATATYPE_IMG_RLE_1BPP
+#define DATATYPE_IMG_RLE_1BPP 0x34
+#endif
+#endif
+
 typedef enum rotation {
     ROTATE_0,
     ROTATE_90,
@@ -30,6 +60,9 @@ typedef enum rotation {
     ROTATE_270
 } rotation_t;
 
+// Sink for C_inflateFlashImage, returns false to abort
+typedef bool (*C_imageWriter_t)(void *ctx, uint32_t offset, const uint8_t *data, size_t length);
+
 typedef struct __attribute__((packed)) {
     uint16_t bitmapOffset;  ///< Pointer into GFXfont->bitmap
     uint8_t width;          ///< Bitmap dimensions in pixels
@@ -62,10 +95,43 @@ void C_addQR(uint16_t x, uint16_t y, uint8_t version, uint8_t scale, const char
 void C_drawRoundedRectangle(uint16_t xpos, uint16_t ypos, uint16_t width, uint16_t height, uint8_t color);
 void C_drawMask(uint16_t xpos, uint16_t ypos, uint16_t width, uint16_t height, uint8_t color);
 
+// C functions to add shapes to the current canvas, rendered straight into the scanlines without a bitmap.
+// radius rounds the corners and is in pixels: 0 and 1 keep them square, 2 takes the corner pixel off
+// (as C_drawRoundedRectangle does). A thickness of 0 fills the shape. Circles are centered on x/y and
+// are 2 * radius + 1 pixels across.
+void C_drawRectangle(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint8_t radius, uint8_t thickness, uint8_t color);
+void C_drawCircle(uint16_t x, uint16_t y, uint16_t radius, uint8_t thickness, uint8_t color);
+void C_drawLine(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t color);
+
+// C function to inflate a compressed fullscreen image into the raw 1bpp/2bpp flash layout.
+// rawtype holds the compressed image's type on entry, and the raw type it was stored as on return.
+bool C_inflateFlashImage(uint32_t addr, uint32_t filesize, uint32_t maxsize, uint8_t *rawtype, C_imageWriter_t writer, void *ctx);
+
 // C function for the display driver to get a drawline
 void C_renderDrawLine(uint8_t *line, uint16_t number, uint8_t c);
+// Same, for all colors at once: planes[c] receives color c, NULL entries are skipped
+void C_renderDrawLinePlanes(uint16_t number, uint8_t **planes, uint8_t nplanes);
 void C_flushDrawItems(void);
 
+// Per-frame memory arena of the drawing engine, everything in it is released by C_flushDrawItems.
+// Allocations that don't fit are taken from the heap instead, so C_drawArenaFree works on both.
+void C_setDrawArenaSize(size_t size);
+// Flushes the draw list and gives the arena back to the heap until the next frame needs it
+void C_releaseDrawArena(void);
+void* C_drawArenaAlloc(size_t size);
+void C_drawArenaFree(void* ptr);
+// Buffer for the display driver's frame scan. Taken from the arena with the first scan of a frame
+// and handed out again to the scans after it, NULL if there is no room for it
+void* C_getDrawScanBuffer(size_t size);
+// Bytes in the arena and spilled to the heap this frame, and the most the arena would have needed so far
+void C_getDrawArenaUsage(size_t* used, size_t* spilled, size_t* high_water);
+// Bytes still free in the arena this frame
+size_t C_getDrawArenaFree(void);
+// Most draw items a frame can hold, 0 for the default. Items added beyond that are dropped.
+void C_setDrawItemBudget(uint16_t budget);
+// Items in the current frame, the most any frame has held so far, and the number of items dropped since boot
+void C_getDrawItemUsage(uint16_t* count, uint16_t* high_water, uint16_t* dropped);
+
 #ifdef __cplusplus
 }
 #endif
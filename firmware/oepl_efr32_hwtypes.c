@@ -4,6 +4,32 @@
 
 #define GPIO_UNUSED {.port = gpioPortInvalid, .pin = 0, .idle_state = 0}
 
+// Draw arena per frame. These are estimates, not measurements on a tag: they come
+// from test/arena_report, a host build with 8 byte pointers and stand-ins for the
+// uzlib, QR code and font submodules. A fullscreen image takes one zlib stream with
+// a 4k window per plane, a rendered screen takes its text and QR code, plus a column
+// cache of about 49 bytes per byte of line width on swapped panels. Panels scanned
+// bottom to top read images backwards, and get room for seek points on top. The
+// display driver takes its two scan buffers from the arena as well. All of it has
+// to fit the heap next to the decompressor contexts, so the arena is capped.
+// The frame log reports what spilled to the heap, which is where to correct them.
+#define DRAW_ARENA_IMAGE_BW       7168
+#define DRAW_ARENA_IMAGE_COLOR    12288
+#define DRAW_ARENA_SCREEN         9216
+#define DRAW_ARENA_COLUMN_BYTES   49
+#define DRAW_ARENA_SEEK_POINTS    2048
+#define DRAW_ARENA_SCAN_PIPELINE  1024
+#define DRAW_ARENA_MAX_SIZE       13312
+
+// Draw items per frame. The firmware's own screens take up to about 16 plus up to
+// 9 for the overlays, AP content comes as one image plus the overlays. The items
+// live in the arena, so panels with a smaller arena get a shorter list, and large
+// panels leave room for longer layouts.
+#define DRAW_ITEM_BUDGET_BW       32
+#define DRAW_ITEM_BUDGET_COLOR    48
+#define DRAW_ITEM_BUDGET_LARGE    64
+#define DRAW_ITEM_LARGE_PIXELS    (640UL * 384UL)
+
 // -----------------------------------------------------------------------------
 //                              Flash pinouts
 // -----------------------------------------------------------------------------
@@ -467,13 +493,38 @@ uint8_t oepl_efr32xg22_get_oepl_hwcapa(void)
   }
 }
 
+static size_t get_draw_arena_size(const oepl_efr32xg22_displayparams_t* displayparams)
+{
+  size_t size = displayparams->have_thirdcolor ? DRAW_ARENA_IMAGE_COLOR : DRAW_ARENA_IMAGE_BW;
+  size_t screen = DRAW_ARENA_SCREEN;
+  if(displayparams->swapXY) {
+    screen += DRAW_ARENA_COLUMN_BYTES * ((displayparams->xres_working + 7) / 8);
+  }
+  if(screen > size) {
+    size = screen;
+  }
+  size += DRAW_ARENA_SCAN_PIPELINE;
+  if(displayparams->mirrorY) {
+    size += DRAW_ARENA_SEEK_POINTS;
+  }
+  return size > DRAW_ARENA_MAX_SIZE ? DRAW_ARENA_MAX_SIZE : size;
+}
+
+static uint16_t get_draw_item_budget(const oepl_efr32xg22_displayparams_t* displayparams)
+{
+  if((uint32_t)displayparams->xres_working * displayparams->yres_working >= DRAW_ITEM_LARGE_PIXELS) {
+    return DRAW_ITEM_BUDGET_LARGE;
+  }
+  return displayparams->have_thirdcolor ? DRAW_ITEM_BUDGET_COLOR : DRAW_ITEM_BUDGET_BW;
+}
+
 bool oepl_efr32xg22_get_displayparams(oepl_efr32xg22_displayparams_t* displayparams)
 {
   const oepl_efr32xg22_tagconfig_t* tagcfg = oepl_efr32xg22_get_config();
   if(tagcfg == NULL || tagcfg->display == NULL) {
     return false;
   }
-  
+
   if(tagcfg->display->type == EPD_SOLUM_AUTODETECT) {
     uint8_t solum_ctrltype = *((uint8_t*) (USERDATA_BASE + 0x09));
     uint8_t solum_colortype = *((uint8_t*) (USERDATA_BASE + 0x0A));
@@ -654,6 +705,8 @@ bool oepl_efr32xg22_get_displayparams(oepl_efr32xg22_displayparams_t* displaypar
       displayparams->yres_working = solum_xres;
     }
 
+    displayparams->draw_arena_size = get_draw_arena_size(displayparams);
+    displayparams->draw_item_budget = get_draw_item_budget(displayparams);
     return true;
   } else if(tagcfg->display->type == EPD_SEEED_264_176_BWR) {
     displayparams->xres = 264;
@@ -668,6 +721,8 @@ bool oepl_efr32xg22_get_displayparams(oepl_efr32xg22_displayparams_t* displaypar
     displayparams->mirrorX = false;
     displayparams->mirrorY = false;
     displayparams->ctrl = CTRL_IL91874;
+    displayparams->draw_arena_size = get_draw_arena_size(displayparams);
+    displayparams->draw_item_budget = get_draw_item_budget(displayparams);
     return true;
   } else if(tagcfg->display->type == WSTK_MEMLCD) {
     displayparams->xres = 128;
@@ -682,6 +737,8 @@ bool oepl_efr32xg22_get_displayparams(oepl_efr32xg22_displayparams_t* displaypar
     displayparams->mirrorX = false;
     displayparams->mirrorY = false;
     displayparams->ctrl = CTRL_MEMLCD;
+    displayparams->draw_arena_size = get_draw_arena_size(displayparams);
+    displayparams->draw_item_budget = get_draw_item_budget(displayparams);
     return true;
   } else if(tagcfg->display->type == EPD_HD150) {
     displayparams->xres = 648;
@@ -696,6 +753,8 @@ bool oepl_efr32xg22_get_displayparams(oepl_efr32xg22_displayparams_t* displaypar
     displayparams->mirrorX = false;
     displayparams->mirrorY = false;
     displayparams->ctrl = CTRL_GDEW0583Z83;
+    displayparams->draw_arena_size = get_draw_arena_size(displayparams);
+    displayparams->draw_item_budget = get_draw_item_budget(displayparams);
     return true;
   // ----- Add new HW types here ----
 
@@ -221,6 +221,8 @@ typedef struct {
   bool mirrorX;
   bool mirrorY;
   oepl_efr32xg22_displaydriver_t ctrl;
+  size_t draw_arena_size;     // Bytes reserved for rendering a frame, 0 for the default
+  uint16_t draw_item_budget;  // Most draw items in a frame, per panel class
 } oepl_efr32xg22_displayparams_t;
 
 // Get the config structure for the hardware we're running on.
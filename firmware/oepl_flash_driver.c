@@ -7,7 +7,9 @@
 #include "oepl_efr32_hwtypes.h"
 #include <spidrv.h>
 #include "string.h"
+#include <stdlib.h>
 #include "sl_udelay.h"
+#include "sl_sleeptimer.h"
 
 // -----------------------------------------------------------------------------
 //                              Configuration values
@@ -16,6 +18,27 @@
 #define FLASH_DEBUG_PRINT 1
 #endif
 
+// SPI clock for the legacy READ (0x03) command, and for FAST_READ (0x0B) on
+// SFDP-compliant parts. SPIDRV clamps the latter to what the USART can do.
+#define FLASH_SPI_BITRATE_LEGACY    10000000
+#define FLASH_SPI_BITRATE_FAST      20000000
+
+// SPIDRV transfers go through a single DMA descriptor, capped at 2k
+#define FLASH_MAX_DMA_XFER          2048
+
+// Read cache geometry. The cache gets as many pages as fit in the heap while
+// leaving FLASH_CACHE_HEAP_RESERVE bytes for the draw path's line buffers.
+#define FLASH_CACHE_PAGE_SIZE       256
+#define FLASH_CACHE_MAX_PAGES       16
+#define FLASH_CACHE_MIN_PAGES       2
+#define FLASH_CACHE_HEAP_RESERVE    2048
+
+// Sequential streams tracked by the cache at once: the two planes of a
+// compressed image, both before and after they restart. Under plain LRU, a
+// stream longer than the cache flushes it completely before a restart gets back
+// to its start, so once a stream runs out of cache it recycles a single page.
+#define FLASH_CACHE_STREAMS         4
+
 // -----------------------------------------------------------------------------
 //                              Macros and Typedefs
 // -----------------------------------------------------------------------------
@@ -25,6 +48,20 @@
 #define DPRINTF(...)
 #endif
 
+typedef struct {
+  uint32_t address;
+  uint32_t last_use;
+  bool valid;
+} cache_entry_t;
+
+typedef struct {
+  uint32_t next_page;   // Page address which continues the stream
+  uint32_t last_use;
+  size_t length;        // Pages read in sequence so far, 0 for an unused tracker
+  size_t entry;         // Cache entry the stream recycles once it has its share
+  bool recycling;
+} cache_stream_t;
+
 // -----------------------------------------------------------------------------
 //                          Static Function Declarations
 // -----------------------------------------------------------------------------
@@ -32,6 +69,13 @@ static void init_flashdriver(void);
 static void setup_spi(void);
 static void teardown_spi(void);
 static void read_bytes(uint32_t address, uint8_t* buffer, size_t bytes);
+static bool session_allowed(void);
+static bool probe_sfdp(void);
+static void read_uncached(uint32_t address, uint8_t* buffer, size_t bytes);
+static const uint8_t* cache_get_page(uint32_t page_address);
+static cache_stream_t* cache_track_stream(uint32_t page_address);
+static bool cache_in_stream(uint32_t page_address);
+static void cache_release(void);
 
 // -----------------------------------------------------------------------------
 //                                Global Variables
@@ -44,25 +88,166 @@ static const oepl_efr32xg22_tagconfig_t* cfg = NULL;
 static SPIDRV_HandleData_t handledata;
 static SPIDRV_Handle_t handle = &handledata;
 
+/// Nesting depth of open sessions
+static size_t session_refcount = 0;
+/// Whether the SPI bus is currently set up and the flash awake
+static bool spi_active = false;
+/// Whether the SFDP probe ran, and if FAST_READ at the higher clock can be used
+static bool sfdp_probed = false;
+static bool use_fast_read = false;
+
+static uint32_t stat_spi_opens = 0;
+static uint32_t stat_reads = 0;
+static uint32_t stat_bytes_read = 0;
+static uint32_t stat_busy_ticks = 0;
+static uint32_t stat_cache_hits = 0;
+static uint32_t stat_cache_misses = 0;
+
+/// Page cache storage, only allocated while a session has it enabled
+static uint8_t* cache_data = NULL;
+static size_t cache_pages = 0;
+static uint32_t cache_tick = 0;
+static cache_entry_t cache_entries[FLASH_CACHE_MAX_PAGES];
+static cache_stream_t cache_streams[FLASH_CACHE_STREAMS];
+
 // -----------------------------------------------------------------------------
 //                          Public Function Definitions
 // -----------------------------------------------------------------------------
 
 uint32_t HAL_flashRead(uint32_t address, uint8_t *buffer, uint32_t num)
 {
+  uint32_t start_ticks = sl_sleeptimer_get_tick_count();
   init_flashdriver();
 
   if(cfg == NULL || cfg->flash == NULL) {
     oepl_hw_crash(DBG_FLASH, false, "Unknown flash configuration\n");
   }
 
-  setup_spi();
-  read_bytes(address, buffer, num);
-  teardown_spi();
+  if(cache_pages == 0 || num > cache_pages * FLASH_CACHE_PAGE_SIZE / 2) {
+    // Large reads would only churn the cache
+    read_uncached(address, buffer, num);
+  } else {
+    uint32_t read_address = address;
+    uint8_t* buffer_ptr = buffer;
+    size_t remaining = num;
+    while(remaining > 0) {
+      uint32_t page_address = read_address & ~(FLASH_CACHE_PAGE_SIZE - 1);
+      size_t page_offset = read_address - page_address;
+      size_t chunk = FLASH_CACHE_PAGE_SIZE - page_offset;
+      if(chunk > remaining) {
+        chunk = remaining;
+      }
+      memcpy(buffer_ptr, cache_get_page(page_address) + page_offset, chunk);
+      read_address += chunk;
+      buffer_ptr += chunk;
+      remaining -= chunk;
+    }
+  }
+
+  if(spi_active && (session_refcount == 0 || !session_allowed())) {
+    teardown_spi();
+  }
+
+  stat_reads++;
+  stat_bytes_read += num;
+  stat_busy_ticks += sl_sleeptimer_get_tick_count() - start_ticks;
 
   return num;
 }
 
+void oepl_flash_session_begin(void)
+{
+  session_refcount++;
+}
+
+void oepl_flash_session_end(void)
+{
+  if(session_refcount == 0) {
+    DPRINTF("Unbalanced flash session end\n");
+    return;
+  }
+
+  session_refcount--;
+  if(session_refcount == 0) {
+    oepl_flash_session_suspend();
+    cache_release();
+    DPRINTF("Flash stats: %ld opens, %ld reads, %ld bytes, %ld ms, cache %ld hit / %ld miss\n",
+            stat_spi_opens, stat_reads, stat_bytes_read,
+            sl_sleeptimer_tick_to_ms(stat_busy_ticks),
+            stat_cache_hits, stat_cache_misses);
+  }
+}
+
+void oepl_flash_cache_enable(void)
+{
+  if(session_refcount == 0) {
+    DPRINTF("Flash cache needs an open session\n");
+    return;
+  }
+
+  if(cache_data != NULL) {
+    return;
+  }
+
+  // Probe how much heap is left by trying the allocation plus the reserve
+  for(size_t pages = FLASH_CACHE_MAX_PAGES; pages >= FLASH_CACHE_MIN_PAGES; pages /= 2) {
+    void* probe = malloc(pages * FLASH_CACHE_PAGE_SIZE + FLASH_CACHE_HEAP_RESERVE);
+    if(probe == NULL) {
+      continue;
+    }
+    free(probe);
+
+    cache_data = malloc(pages * FLASH_CACHE_PAGE_SIZE);
+    if(cache_data != NULL) {
+      cache_pages = pages;
+      memset(cache_entries, 0, sizeof(cache_entries));
+      memset(cache_streams, 0, sizeof(cache_streams));
+      DPRINTF("Flash cache enabled with %d pages\n", cache_pages);
+    }
+    return;
+  }
+
+  DPRINTF("No heap for flash cache\n");
+}
+
+void oepl_flash_cache_invalidate(uint32_t address, uint32_t length)
+{
+  for(size_t i = 0; i < cache_pages; i++) {
+    if(cache_entries[i].valid &&
+       cache_entries[i].address < address + length &&
+       cache_entries[i].address + FLASH_CACHE_PAGE_SIZE > address) {
+      cache_entries[i].valid = false;
+    }
+  }
+}
+
+void oepl_flash_session_suspend(void)
+{
+  if(spi_active) {
+    teardown_spi();
+  }
+}
+
+void oepl_flash_get_stats(oepl_flash_stats_t* stats)
+{
+  stats->spi_opens = stat_spi_opens;
+  stats->reads = stat_reads;
+  stats->bytes_read = stat_bytes_read;
+  stats->busy_ms = sl_sleeptimer_tick_to_ms(stat_busy_ticks);
+  stats->cache_hits = stat_cache_hits;
+  stats->cache_misses = stat_cache_misses;
+}
+
+void oepl_flash_reset_stats(void)
+{
+  stat_spi_opens = 0;
+  stat_reads = 0;
+  stat_bytes_read = 0;
+  stat_busy_ticks = 0;
+  stat_cache_hits = 0;
+  stat_cache_misses = 0;
+}
+
 // -----------------------------------------------------------------------------
 //                          Static Function Definitions
 // -----------------------------------------------------------------------------
@@ -75,6 +260,13 @@ static void init_flashdriver(void)
   cfg = oepl_efr32xg22_get_config();
 }
 
+static bool session_allowed(void)
+{
+  // When the display sits on the same USART (e.g. the devkit memory LCD), the
+  // bus can't be held on to in between reads.
+  return cfg->display == NULL || cfg->display->usart != cfg->flash->usart;
+}
+
 static void setup_spi(void)
 {
   SPIDRV_Init_t spi_init = SPIDRV_MASTER_DEFAULT;
@@ -85,7 +277,7 @@ static void setup_spi(void)
   spi_init.pinRx = cfg->flash->MISO.pin;
   spi_init.portClk = cfg->flash->SCK.port;
   spi_init.pinClk = cfg->flash->SCK.pin;
-  spi_init.bitRate = 10000000;
+  spi_init.bitRate = use_fast_read ? FLASH_SPI_BITRATE_FAST : FLASH_SPI_BITRATE_LEGACY;
   spi_init.csControl = spidrvCsControlApplication;
 
   if(cfg->flash->EN.port != gpioPortInvalid) {
@@ -94,6 +286,8 @@ static void setup_spi(void)
 
   GPIO_PinModeSet(cfg->flash->nCS.port, cfg->flash->nCS.pin, gpioModePushPull, 1);
   SPIDRV_Init(handle, &spi_init);
+  spi_active = true;
+  stat_spi_opens++;
 
   // Wake the flash
   // If it's an MX25 in deep sleep, use CS assert to wake it
@@ -129,6 +323,29 @@ static void setup_spi(void)
     GPIO_PinOutSet(cfg->flash->nCS.port, cfg->flash->nCS.pin);
     jedec_id[0] = 0x05;
   }
+
+  // Find out once whether we can speed up
+  if(!sfdp_probed) {
+    sfdp_probed = true;
+    use_fast_read = probe_sfdp();
+    if(use_fast_read) {
+      SPIDRV_SetBitrate(handle, FLASH_SPI_BITRATE_FAST);
+    }
+    DPRINTF("Flash %s SFDP, using %s read\n", use_fast_read ? "supports" : "doesn't support", use_fast_read ? "fast" : "legacy");
+  }
+}
+
+static bool probe_sfdp(void)
+{
+  // SFDP header: signature "SFDP", minor revision, major revision
+  uint8_t sfdp[5 + 6] = {0x5A, 0x00, 0x00, 0x00, 0x00};
+  GPIO_PinOutClear(cfg->flash->nCS.port, cfg->flash->nCS.pin);
+  SPIDRV_MTransferB(handle, sfdp, sfdp, sizeof(sfdp));
+  GPIO_PinOutSet(cfg->flash->nCS.port, cfg->flash->nCS.pin);
+
+  // Parts implementing JESD216 also implement FAST_READ, and are rated well
+  // above our USART's maximum clock for it
+  return memcmp(&sfdp[5], "SFDP", 4) == 0 && sfdp[10] == 0x01;
 }
 
 static void teardown_spi(void)
@@ -141,6 +358,7 @@ static void teardown_spi(void)
 
   GPIO_PinModeSet(cfg->flash->nCS.port, cfg->flash->nCS.pin, gpioModeInputPull, 1);
   SPIDRV_DeInit(handle);
+  spi_active = false;
 
   if(cfg->flash->EN.port != gpioPortInvalid) {
     GPIO_PinModeSet(cfg->flash->EN.port, cfg->flash->EN.pin, gpioModeInputPull, cfg->flash->EN.idle_state);
@@ -150,24 +368,116 @@ static void teardown_spi(void)
 
 static void read_bytes(uint32_t address, uint8_t* buffer, size_t bytes)
 {
-  uint8_t* buffer_ptr = buffer;
+  // FAST_READ takes a dummy byte after the address
+  uint8_t readcmd[] = {use_fast_read ? 0x0B : 0x03, address >> 16, address >> 8, address, 0x00};
 
-  // Chunk the transfer in 2k blocks, as the EFR32 DMA maxes out at 2k
-  for(size_t i = 0; i < bytes / 2048; i++) {
-    GPIO_PinOutClear(cfg->flash->nCS.port, cfg->flash->nCS.pin);
-    uint8_t readcmd[] = {0x03, address >> 16, address >> 8, address};
-    SPIDRV_MTransmitB(handle, readcmd, sizeof(readcmd));
-    SPIDRV_MReceiveB(handle, buffer_ptr, 2048);
-    GPIO_PinOutSet(cfg->flash->nCS.port, cfg->flash->nCS.pin);
-    address += 2048;
-    buffer_ptr += 2048;
+  GPIO_PinOutClear(cfg->flash->nCS.port, cfg->flash->nCS.pin);
+  SPIDRV_MTransmitB(handle, readcmd, use_fast_read ? 5 : 4);
+
+  // The flash keeps clocking out sequential bytes for as long as CS is held,
+  // so only the DMA transfers need chunking, not the read command.
+  while(bytes > 0) {
+    size_t chunk = bytes > FLASH_MAX_DMA_XFER ? FLASH_MAX_DMA_XFER : bytes;
+    SPIDRV_MReceiveB(handle, buffer, chunk);
+    buffer += chunk;
+    bytes -= chunk;
   }
-  
-  if((size_t)(buffer_ptr - buffer) < bytes) {
-    GPIO_PinOutClear(cfg->flash->nCS.port, cfg->flash->nCS.pin);
-    uint8_t readcmd[] = {0x03, address >> 16, address >> 8, address};
-    SPIDRV_MTransmitB(handle, readcmd, sizeof(readcmd));
-    SPIDRV_MReceiveB(handle, buffer_ptr, bytes - (buffer_ptr - buffer));
-    GPIO_PinOutSet(cfg->flash->nCS.port, cfg->flash->nCS.pin);
+  GPIO_PinOutSet(cfg->flash->nCS.port, cfg->flash->nCS.pin);
+}
+
+static void read_uncached(uint32_t address, uint8_t* buffer, size_t bytes)
+{
+  if(!spi_active) {
+    setup_spi();
   }
-}
\ No newline at end of file
+  read_bytes(address, buffer, bytes);
+}
+
+static const uint8_t* cache_get_page(uint32_t page_address)
+{
+  size_t victim = 0;
+  cache_tick++;
+  cache_stream_t* stream = cache_track_stream(page_address);
+
+  for(size_t i = 0; i < cache_pages; i++) {
+    if(cache_entries[i].valid && cache_entries[i].address == page_address) {
+      stat_cache_hits++;
+      cache_entries[i].last_use = cache_tick;
+      return &cache_data[i * FLASH_CACHE_PAGE_SIZE];
+    }
+
+    // Fill empty entries first, then evict the least recently used one
+    if(cache_entries[victim].valid &&
+       (!cache_entries[i].valid || cache_entries[i].last_use < cache_entries[victim].last_use)) {
+      victim = i;
+    }
+  }
+
+  // Once a stream would evict pages of a stream, it's longer than what's left of the
+  // cache. It recycles one page from then on, so the pages it started with are still
+  // there when it restarts.
+  if(stream->recycling) {
+    victim = stream->entry;
+  } else if(cache_in_stream(cache_entries[victim].address) && cache_entries[victim].valid) {
+    stream->recycling = true;
+    stream->entry = victim;
+  }
+
+  stat_cache_misses++;
+  read_uncached(page_address, &cache_data[victim * FLASH_CACHE_PAGE_SIZE], FLASH_CACHE_PAGE_SIZE);
+  cache_entries[victim].address = page_address;
+  cache_entries[victim].last_use = cache_tick;
+  cache_entries[victim].valid = true;
+  return &cache_data[victim * FLASH_CACHE_PAGE_SIZE];
+}
+
+static cache_stream_t* cache_track_stream(uint32_t page_address)
+{
+  cache_stream_t* oldest = &cache_streams[0];
+  for(size_t i = 0; i < FLASH_CACHE_STREAMS; i++) {
+    cache_stream_t* stream = &cache_streams[i];
+    if(stream->length > 0 && stream->next_page == page_address + FLASH_CACHE_PAGE_SIZE) {
+      // Another read from the page the stream is on
+      stream->last_use = cache_tick;
+      return stream;
+    }
+    if(stream->length > 0 && stream->next_page == page_address) {
+      stream->next_page += FLASH_CACHE_PAGE_SIZE;
+      stream->length++;
+      stream->last_use = cache_tick;
+      return stream;
+    }
+    if(stream->last_use < oldest->last_use) {
+      oldest = stream;
+    }
+  }
+
+  // Not a continuation, so this starts a new stream in the tracker used longest ago
+  oldest->next_page = page_address + FLASH_CACHE_PAGE_SIZE;
+  oldest->length = 1;
+  oldest->recycling = false;
+  oldest->last_use = cache_tick;
+  return oldest;
+}
+
+static bool cache_in_stream(uint32_t page_address)
+{
+  for(size_t i = 0; i < FLASH_CACHE_STREAMS; i++) {
+    const cache_stream_t* stream = &cache_streams[i];
+    if(stream->length > 0 &&
+       page_address < stream->next_page &&
+       page_address >= stream->next_page - stream->length * FLASH_CACHE_PAGE_SIZE) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void cache_release(void)
+{
+  if(cache_data != NULL) {
+    free(cache_data);
+    cache_data = NULL;
+  }
+  cache_pages = 0;
+}
@@ -9,6 +9,14 @@
 // -----------------------------------------------------------------------------
 //                              Macros and Typedefs
 // -----------------------------------------------------------------------------
+typedef struct {
+  uint32_t spi_opens;     // Amount of times the SPI bus was set up and the flash woken
+  uint32_t reads;         // Amount of HAL_flashRead calls
+  uint32_t bytes_read;    // Total amount of bytes read
+  uint32_t busy_ms;       // Time spent in HAL_flashRead, including setup and teardown
+  uint32_t cache_hits;    // Pages served from the read cache
+  uint32_t cache_misses;  // Pages fetched from flash into the read cache
+} oepl_flash_stats_t;
 
 // -----------------------------------------------------------------------------
 //                                Global Variables
@@ -23,4 +31,27 @@
 // Returns the amount of bytes read (but callers really just expect this to work)
 uint32_t HAL_flashRead(uint32_t address, uint8_t *buffer, uint32_t num);
 
+// Keep the flash awake and the SPI bus set up between HAL_flashRead calls until
+// the matching oepl_flash_session_end. Sessions nest (reference counted).
+void oepl_flash_session_begin(void);
+void oepl_flash_session_end(void);
+
+// Put the flash back to sleep and release the SPI bus while keeping the
+// session count, for when something else (e.g. the bootloader) needs the flash.
+// The next HAL_flashRead in the session sets the bus up again.
+void oepl_flash_session_suspend(void);
+
+// Cache flash pages in RAM for the rest of the current session, sized by the
+// amount of heap left at the time of the call. The cache is freed when the
+// outermost session ends.
+void oepl_flash_cache_enable(void);
+
+// Drop cached pages overlapping the given range, to be called when it gets
+// written or erased
+void oepl_flash_cache_invalidate(uint32_t address, uint32_t length);
+
+// Retrieve or clear the read statistics
+void oepl_flash_get_stats(oepl_flash_stats_t* stats);
+void oepl_flash_reset_stats(void);
+
 #endif
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include "oepl_app.h"
 #include "oepl_radio.h"
 #include "oepl_display.h"
+#include "oepl_flash_driver.h"
 
 #include "em_cmu.h"
 #include "em_gpio.h"
@@ -93,7 +94,7 @@ bool app_is_ok_to_sleep(void)
   if(oepl_display_is_drawing()) {
     //DPRINTF("$");
     return true;
-  } else if(oepl_radio_is_event_pending() || oepl_app_is_event_pending()) {
+  } else if(oepl_radio_is_event_pending() || oepl_app_is_event_pending() || oepl_display_is_event_pending()) {
     DPRINTF("@");
     return false;
   } else {
@@ -110,8 +111,9 @@ sl_power_manager_on_isr_exit_t app_sleep_on_isr_exit(void)
   // - radio event
   // - button press
   // - application timer (todo)
-  // - other subtask event, e.g. display SPI (todo)
-  if(oepl_radio_is_event_pending() || oepl_app_is_event_pending() || oepl_display_is_drawing()) {
+  // - display refresh completion
+  if(oepl_radio_is_event_pending() || oepl_app_is_event_pending() ||
+     oepl_display_is_drawing() || oepl_display_is_event_pending()) {
     return SL_POWER_MANAGER_WAKEUP;
   } else {
     return SL_POWER_MANAGER_SLEEP;
@@ -910,6 +912,10 @@ void oepl_hw_flash_deepsleep(void)
 
 void oepl_hw_flash_wake(void)
 {
+  // Whoever wakes the flash here talks to it through its own driver, so get
+  // an open read session off the bus first.
+  oepl_flash_session_suspend();
+
   if(is_devkit) {
     CMU_ClockEnable(cmuClock_GPIO, true);
     GPIO_PinModeSet(SL_MX25_FLASH_SHUTDOWN_CS_PORT, SL_MX25_FLASH_SHUTDOWN_CS_PIN, gpioModePushPull, 1);
@@ -22,14 +22,30 @@
 #define NVM_DEBUG_PRINT 1
 #endif
 
+// Set to 1 to always verify downloads by reading them back from flash, instead of
+// trusting the MD5 which was accumulated while the bytes were being written.
+#ifndef NVM_VERIFY_MD5_BY_READBACK
+#define NVM_VERIFY_MD5_BY_READBACK 0
+#endif
+
+// Number of 4 KB blocks between writes of a download's MD5 state to NVM3 (~130 bytes a
+// write, it's also saved when the download stops). A reboot loses at most this many blocks
+// of resume progress, or falls back to a readback of the firmware update.
+#ifndef NVM_DOWNLOAD_PROGRESS_INTERVAL
+#define NVM_DOWNLOAD_PROGRESS_INTERVAL 8
+#endif
+
 #define NVM3_OBJECT_ID_CONFIG               0x0000
 #define NVM3_OBJECT_ID_SETTINGS_START       0x0001
 #define NVM3_OBJECT_ID_SETTINGS_MAX         0x0100
 
 #define NVM3_OBJECT_ID_FWU_METADATA         0x1000
 #define NVM3_OBJECT_ID_FWU_BLOCK_COUNTER    0x1001
+#define NVM3_OBJECT_ID_FWU_HASH             0x1002
 #define NVM3_OBJECT_ID_IMAGE_METADATA_BASE  0x2000
 #define NVM3_OBJECT_ID_IMAGE_METADATA_MAX   0x2010
+#define NVM3_OBJECT_ID_IMAGE_PROGRESS_BASE  0x2100
+#define NVM3_OBJECT_ID_IMAGE_PROGRESS_MAX   0x2110
 
 #define NVM3_MARKER_VALUE                   0xCAFEFACEUL
 
@@ -60,10 +76,23 @@ typedef struct {
   size_t staged_size;
 } device_fwu_meta_t;
 
+// Running MD5 over the first 'length' bytes of a download in progress. Persisted
+// on block boundaries only, which makes 'length' the contiguous progress to resume from.
+typedef struct {
+  uint32_t marker;
+  size_t img_idx;
+  size_t length;
+  MD5Context md5;
+} download_hash_t;
+
 // -----------------------------------------------------------------------------
 //                          Static Function Declarations
 // -----------------------------------------------------------------------------
 static oepl_nvm_status_t check_fwu_md5(void);
+static bool continue_download_hash(nvm3_ObjectKey_t key, download_hash_t* hash, const download_hash_t* accepted, size_t img_idx, size_t offset);
+static oepl_nvm_status_t readback_md5(MD5Context* md5, uint32_t address, size_t length);
+static oepl_nvm_status_t erase_image_tail(size_t img_idx, size_t offset);
+static oepl_nvm_status_t compare_md5(MD5Context* md5, uint64_t expected);
 
 // -----------------------------------------------------------------------------
 //                                Global Variables
@@ -90,6 +119,19 @@ const oepl_stored_tagsettings_t oepl_default_tagsettings = {
 
 static oepl_stored_tagsettings_t tag_settings;
 
+// Image downloads hash per page when streamed, so keep the running hash in RAM.
+// Streamed pages reach flash before their block checksum is known, so the hash is
+// only copied to 'accepted' (and persisted) once the application accepted the block.
+static download_hash_t image_hash;
+static download_hash_t image_hash_accepted;
+static bool image_progress_unsaved = false;
+// Firmware updates are written per block after their checksum passed
+static download_hash_t fwu_hash;
+static bool fwu_progress_unsaved = false;
+// Where the last appended bytes ended, to tell a download going back in its slot
+static size_t image_append_idx = 0;
+static size_t image_append_end = 0;
+
 // -----------------------------------------------------------------------------
 //                          Public Function Definitions
 // -----------------------------------------------------------------------------
@@ -476,6 +518,7 @@ oepl_nvm_status_t oepl_nvm_setting_set_default(oepl_setting_entry_t entry)
 oepl_nvm_status_t oepl_fwu_erase(void)
 {
   int32_t status;
+  oepl_nvm_status_t retval = NVM_ERROR;
   oepl_hw_flash_wake();
   if((status = bootloader_init()) != BOOTLOADER_OK)
   {
@@ -489,7 +532,10 @@ oepl_nvm_status_t oepl_fwu_erase(void)
     goto done;
   }
 
-  oepl_nvm_status_t retval = oepl_fwu_set_metadata(0, 0, 0);
+  retval = oepl_fwu_set_metadata(0, 0, 0);
+  nvm3_deleteObject(nvm3_defaultHandle, NVM3_OBJECT_ID_FWU_HASH);
+  fwu_hash.marker = 0;
+  fwu_progress_unsaved = false;
 
   done:
   if((status = bootloader_deinit()) != BOOTLOADER_OK)
@@ -597,6 +643,16 @@ oepl_nvm_status_t oepl_fwu_write(size_t block_idx, const uint8_t bytes[4096], si
       DPRINTF("Couldn't match FWU block write counter\n");
       return NVM_ERROR;
     }
+
+    // Keep the MD5 of the staged file up to date, so checking it doesn't need a full readback
+    if(continue_download_hash(NVM3_OBJECT_ID_FWU_HASH, &fwu_hash, NULL, 0, block_idx * 4096)) {
+      md5Update(&fwu_hash.md5, (uint8_t*)bytes, actual_length);
+      fwu_hash.length += actual_length;
+      fwu_progress_unsaved = true;
+      if((block_idx + 1) % NVM_DOWNLOAD_PROGRESS_INTERVAL == 0) {
+        oepl_nvm_save_download_progress();
+      }
+    }
     return NVM_SUCCESS;
   } else {
     DPRINTF("Failed storage write with %ld\n", btl_status);
@@ -874,10 +930,10 @@ oepl_nvm_status_t oepl_nvm_get_image_by_type(uint8_t image_type, size_t* img_idx
   return found ? NVM_SUCCESS : NVM_NOT_FOUND;
 }
 
-oepl_nvm_status_t oepl_nvm_get_free_image_slot(size_t* img_idx, uint8_t image_type)
+oepl_nvm_status_t oepl_nvm_get_free_image_slot(size_t* img_idx, uint8_t image_type, bool allow_evict)
 {
-  size_t num_slots, slot_size, candidate_seq = 0, candidate_idx = 0;
-  bool found_candidate = false;
+  size_t num_slots, slot_size, candidate_seq = 0, candidate_idx = 0, resumable_idx = 0;
+  bool found_candidate = false, found_resumable = false;
   oepl_nvm_status_t retval = oepl_nvm_get_num_img_slots(&num_slots, &slot_size);
   if(retval != NVM_SUCCESS) {
     return retval;
@@ -895,6 +951,15 @@ oepl_nvm_status_t oepl_nvm_get_free_image_slot(size_t* img_idx, uint8_t image_ty
       // Hardware / application error?
       return NVM_ERROR;
     } else if(!imgmeta.is_valid) {
+      size_t progress;
+      if(oepl_nvm_get_image_progress(i, &progress) == NVM_SUCCESS && progress > 0) {
+        // A download that can still be resumed, only give it up when there's nothing else
+        if(!found_resumable) {
+          resumable_idx = i;
+        }
+        found_resumable = true;
+        continue;
+      }
       // Clean up and release this slot back for use
       DPRINTF("Image slot 0x%x not made valid, freeing it for use\n", i);
       oepl_nvm_erase_image(i);
@@ -913,13 +978,23 @@ oepl_nvm_status_t oepl_nvm_get_free_image_slot(size_t* img_idx, uint8_t image_ty
     }
   }
 
+  if(!allow_evict) {
+    return NVM_NOT_FOUND;
+  }
+
   if(found_candidate) {
     // Erase candidate to free up space for new one
-    DPRINTF("Image of type 0x%x has oldest seq 0x%x in slot 0x%x, freeing and reusing\n", image_type, candidate_seq, img_idx);
+    DPRINTF("Image of type 0x%x has oldest seq 0x%x in slot 0x%x, freeing and reusing\n", image_type, candidate_seq, candidate_idx);
     *img_idx = candidate_idx;
     return oepl_nvm_erase_image(candidate_idx);
   }
 
+  if(found_resumable) {
+    DPRINTF("Giving up unfinished download in slot 0x%x\n", resumable_idx);
+    *img_idx = resumable_idx;
+    return oepl_nvm_erase_image(resumable_idx);
+  }
+
   // If we exited the for loop, we haven't found an open slot
   return NVM_NOT_FOUND;
 }
@@ -945,12 +1020,21 @@ oepl_nvm_status_t oepl_nvm_erase_image(size_t img_idx)
     goto exit;
   }
 
+  oepl_flash_cache_invalidate(devconfig.bulk_storage_base_address + img_idx * slot_size, slot_size);
   btl_status = bootloader_eraseRawStorage(devconfig.bulk_storage_base_address + img_idx * slot_size, slot_size);
   if(btl_status != BOOTLOADER_OK) {
     goto done;
   }
 
-  // Then erase the accompanying metadata
+  // Then erase the accompanying metadata and download progress
+  if(image_hash.img_idx == img_idx) {
+    image_hash.marker = 0;
+  }
+  if(image_hash_accepted.img_idx == img_idx) {
+    image_hash_accepted.marker = 0;
+    image_progress_unsaved = false;
+  }
+  nvm3_deleteObject(nvm3_defaultHandle, NVM3_OBJECT_ID_IMAGE_PROGRESS_BASE + img_idx);
   Ecode_t nvm_status = nvm3_deleteObject(nvm3_defaultHandle, NVM3_OBJECT_ID_IMAGE_METADATA_BASE + img_idx);
   if(nvm_status == ECODE_NVM3_OK ||
      nvm_status == ECODE_NVM3_ERR_KEY_NOT_FOUND) {
@@ -1050,6 +1134,11 @@ oepl_nvm_status_t oepl_nvm_write_image_metadata(size_t img_idx, oepl_stored_imag
 
   nvm_status = nvm3_writeData(nvm3_defaultHandle, NVM3_OBJECT_ID_IMAGE_METADATA_BASE + img_idx, metadata, sizeof(oepl_stored_image_hdr_t));
 
+  // A complete image has no use for its download progress anymore
+  if(nvm_status == ECODE_NVM3_OK && metadata->is_valid) {
+    nvm3_deleteObject(nvm3_defaultHandle, NVM3_OBJECT_ID_IMAGE_PROGRESS_BASE + img_idx);
+  }
+
   return nvm_status == ECODE_NVM3_OK ? NVM_SUCCESS : NVM_ERROR;
 }
 
@@ -1092,6 +1181,8 @@ oepl_nvm_status_t oepl_nvm_write_image_bytes(size_t img_idx, size_t offset, cons
 
   DPRINTF("Write %d to addr 0x%08x\n", length, devconfig.bulk_storage_base_address + img_idx * slot_size + offset);
 
+  oepl_flash_cache_invalidate(devconfig.bulk_storage_base_address + img_idx * slot_size + offset, length);
+
   // Todo: does the bootloader really modify its input byte buffer?
   btl_status = bootloader_writeRawStorage(devconfig.bulk_storage_base_address + img_idx * slot_size + offset, (uint8_t*)bytes, length);
 
@@ -1106,6 +1197,115 @@ oepl_nvm_status_t oepl_nvm_write_image_bytes(size_t img_idx, size_t offset, cons
   }
 }
 
+oepl_nvm_status_t oepl_nvm_append_image_bytes(size_t img_idx, size_t offset, const uint8_t* bytes, size_t length)
+{
+  oepl_nvm_status_t retval;
+  if(offset != 0 && (image_append_idx != img_idx || image_append_end != offset)) {
+    // Resuming or going back after a failed block. What's in flash past this point may be
+    // a streamed block which failed its checksum, and flash can't be overwritten in place.
+    retval = erase_image_tail(img_idx, offset);
+    if(retval != NVM_SUCCESS) {
+      return retval;
+    }
+  }
+
+  retval = oepl_nvm_write_image_bytes(img_idx, offset, bytes, length);
+  if(retval != NVM_SUCCESS) {
+    return retval;
+  }
+  image_append_idx = img_idx;
+  image_append_end = offset + length;
+
+  // Bytes which don't continue the running hash leave it behind, and the image
+  // will get verified by reading it back instead.
+  if(continue_download_hash(NVM3_OBJECT_ID_IMAGE_PROGRESS_BASE + img_idx, &image_hash, &image_hash_accepted, img_idx, offset)) {
+    md5Update(&image_hash.md5, (uint8_t*)bytes, length);
+    image_hash.length += length;
+  }
+
+  return NVM_SUCCESS;
+}
+
+oepl_nvm_status_t oepl_nvm_accept_image_bytes(size_t img_idx, size_t length)
+{
+  if(image_hash.marker != NVM3_MARKER_VALUE || image_hash.img_idx != img_idx || image_hash.length != length) {
+    // The running hash doesn't cover exactly these bytes, nothing to vouch for
+    return NVM_NOT_FOUND;
+  }
+
+  image_hash_accepted = image_hash;
+  if(length % 4096 == 0) {
+    image_progress_unsaved = true;
+    if((length / 4096) % NVM_DOWNLOAD_PROGRESS_INTERVAL == 0) {
+      oepl_nvm_save_download_progress();
+    }
+  }
+  return NVM_SUCCESS;
+}
+
+void oepl_nvm_save_download_progress(void)
+{
+  if(image_progress_unsaved && image_hash_accepted.marker == NVM3_MARKER_VALUE && image_hash_accepted.length % 4096 == 0) {
+    nvm3_writeData(nvm3_defaultHandle, NVM3_OBJECT_ID_IMAGE_PROGRESS_BASE + image_hash_accepted.img_idx,
+                   &image_hash_accepted, sizeof(image_hash_accepted));
+  }
+  image_progress_unsaved = false;
+
+  if(fwu_progress_unsaved && fwu_hash.marker == NVM3_MARKER_VALUE) {
+    nvm3_writeData(nvm3_defaultHandle, NVM3_OBJECT_ID_FWU_HASH, &fwu_hash, sizeof(fwu_hash));
+  }
+  fwu_progress_unsaved = false;
+}
+
+oepl_nvm_status_t oepl_nvm_get_image_progress(size_t img_idx, size_t* length)
+{
+  download_hash_t progress;
+  *length = 0;
+  Ecode_t nvm_status = nvm3_readData(nvm3_defaultHandle, NVM3_OBJECT_ID_IMAGE_PROGRESS_BASE + img_idx, &progress, sizeof(progress));
+  if(nvm_status == ECODE_NVM3_ERR_KEY_NOT_FOUND) {
+    return NVM_NOT_FOUND;
+  } else if(nvm_status != ECODE_NVM3_OK) {
+    return NVM_ERROR;
+  }
+
+  if(progress.marker != NVM3_MARKER_VALUE || progress.img_idx != img_idx) {
+    return NVM_NOT_FOUND;
+  }
+
+  *length = progress.length;
+  return NVM_SUCCESS;
+}
+
+oepl_nvm_status_t oepl_nvm_check_image_md5(size_t img_idx, uint64_t md5, size_t size)
+{
+  size_t num_slots, slot_size;
+  oepl_nvm_status_t retval = oepl_nvm_get_num_img_slots(&num_slots, &slot_size);
+  if(retval != NVM_SUCCESS) {
+    return retval;
+  }
+
+  if(img_idx >= num_slots) {
+    return NVM_NOT_SUPPORTED;
+  }
+
+  MD5Context ctx;
+#if !NVM_VERIFY_MD5_BY_READBACK
+  if(continue_download_hash(NVM3_OBJECT_ID_IMAGE_PROGRESS_BASE + img_idx, &image_hash_accepted, NULL, img_idx, size) && size != 0) {
+    DPRINTF("Using MD5 accumulated during download of %d bytes\n", size);
+    ctx = image_hash_accepted.md5;
+  } else
+#endif
+  {
+    DPRINTF("Verifying MD5 on %d bytes by readback\n", size);
+    retval = readback_md5(&ctx, devconfig.bulk_storage_base_address + img_idx * slot_size, size);
+    if(retval != NVM_SUCCESS) {
+      return retval;
+    }
+  }
+
+  return compare_md5(&ctx, md5);
+}
+
 oepl_nvm_status_t oepl_nvm_read_image_bytes(size_t img_idx, size_t offset, uint8_t* bytes, size_t length)
 {
   size_t num_slots, slot_size;
@@ -1133,11 +1333,8 @@ oepl_nvm_status_t oepl_nvm_read_image_bytes(size_t img_idx, size_t offset, uint8
 // Split this in a separate subroutine as the call stack blows up otherwise
 static oepl_nvm_status_t check_fwu_md5(void)
 {
-  uint8_t read_buffer[512];
-  size_t offset;
   MD5Context md5;
   device_fwu_meta_t meta;
-  oepl_nvm_status_t retval = NVM_SUCCESS;
   Ecode_t status = nvm3_readData(nvm3_defaultHandle, NVM3_OBJECT_ID_FWU_METADATA, &meta, sizeof(meta));
   if(status != ECODE_NVM3_OK) {
     DPRINTF("No staged upgrade found in NVM\n");
@@ -1148,36 +1345,131 @@ static oepl_nvm_status_t check_fwu_md5(void)
     return NVM_NOT_FOUND;
   }
 
+#if !NVM_VERIFY_MD5_BY_READBACK
+  if(continue_download_hash(NVM3_OBJECT_ID_FWU_HASH, &fwu_hash, NULL, 0, meta.staged_size)) {
+    DPRINTF("Using MD5 accumulated during download of %d bytes\n", meta.staged_size);
+    md5 = fwu_hash.md5;
+    return compare_md5(&md5, meta.staged_md5);
+  }
+#endif
+
+  DPRINTF("Verifying MD5 on %d bytes by readback\n", meta.staged_size);
+  oepl_nvm_status_t retval = readback_md5(&md5, 0, meta.staged_size);
+  if(retval != NVM_SUCCESS) {
+    return retval;
+  }
+  return compare_md5(&md5, meta.staged_md5);
+}
+
+// Get the running hash of download 'img_idx' ready to take bytes at 'offset'.
+// Offset 0 starts a new hash, anything else needs to pick up where the hash
+// in RAM, the 'accepted' copy (if any) or the copy in NVM3 left off.
+static bool continue_download_hash(nvm3_ObjectKey_t key, download_hash_t* hash, const download_hash_t* accepted, size_t img_idx, size_t offset)
+{
+  if(offset == 0) {
+    hash->marker = NVM3_MARKER_VALUE;
+    hash->img_idx = img_idx;
+    hash->length = 0;
+    md5Init(&hash->md5);
+    return true;
+  }
+
+  if(hash->marker == NVM3_MARKER_VALUE && hash->img_idx == img_idx && hash->length == offset) {
+    return true;
+  }
+
+  // Rewind, e.g. when a block is fetched again after it failed its checksum
+  if(accepted != NULL && accepted->marker == NVM3_MARKER_VALUE && accepted->img_idx == img_idx && accepted->length == offset) {
+    *hash = *accepted;
+    return true;
+  }
+
+  if(nvm3_readData(nvm3_defaultHandle, key, hash, sizeof(*hash)) != ECODE_NVM3_OK) {
+    hash->marker = 0;
+    return false;
+  }
+
+  return hash->marker == NVM3_MARKER_VALUE && hash->img_idx == img_idx && hash->length == offset;
+}
+
+static oepl_nvm_status_t erase_image_tail(size_t img_idx, size_t offset)
+{
+  size_t num_slots, slot_size;
+  oepl_nvm_status_t retval = oepl_nvm_get_num_img_slots(&num_slots, &slot_size);
+  if(retval != NVM_SUCCESS) {
+    return retval;
+  }
+
+  if(img_idx >= num_slots || offset >= slot_size) {
+    return NVM_NOT_SUPPORTED;
+  }
+
+  if(offset % devconfig.bulk_storage_pagesize != 0) {
+    DPRINTF("Can't continue image at 0x%x, not on a flash page boundary\n", offset);
+    return NVM_NOT_SUPPORTED;
+  }
+
+  uint32_t address = devconfig.bulk_storage_base_address + img_idx * slot_size + offset;
+  DPRINTF("Erasing image idx 0x%x from offset 0x%x\n", img_idx, offset);
+
+  int32_t btl_status;
+  oepl_hw_flash_wake();
+  if((btl_status = bootloader_init()) != BOOTLOADER_OK) {
+    DPRINTF("Failed BTL init with %08lx\n", btl_status);
+    goto exit;
+  }
+
+  oepl_flash_cache_invalidate(address, slot_size - offset);
+  btl_status = bootloader_eraseRawStorage(address, slot_size - offset);
+
+  bootloader_deinit();
+
+  exit:
+  oepl_hw_flash_deepsleep();
+  return btl_status == BOOTLOADER_OK ? NVM_SUCCESS : NVM_ERROR;
+}
+
+static oepl_nvm_status_t readback_md5(MD5Context* md5, uint32_t address, size_t length)
+{
+  uint8_t read_buffer[256];
+  oepl_nvm_status_t retval = NVM_SUCCESS;
+
   oepl_hw_flash_wake();
+  oepl_flash_session_begin();
 
-  size_t read_size = meta.staged_size - 0 > sizeof(read_buffer) ? sizeof(read_buffer) : meta.staged_size - offset;
-  DPRINTF("Verifying MD5 on %d bytes in chunks of %d\n", meta.staged_size, read_size);
-  md5Init(&md5);
-  for(size_t offset = 0; offset < meta.staged_size;) {
-    read_size = meta.staged_size - offset > sizeof(read_buffer) ? sizeof(read_buffer) : meta.staged_size - offset;
-    if(read_size != HAL_flashRead(offset, read_buffer, read_size)) {
-      DPRINTF("Failed FWU read\n");
+  md5Init(md5);
+  for(size_t offset = 0; offset < length;) {
+    size_t read_size = length - offset > sizeof(read_buffer) ? sizeof(read_buffer) : length - offset;
+    if(read_size != HAL_flashRead(address + offset, read_buffer, read_size)) {
+      DPRINTF("Failed readback at 0x%08x\n", address + offset);
       retval = NVM_ERROR;
-      goto exit;
+      break;
     }
-    md5Update(&md5, read_buffer, read_size);
+    md5Update(md5, read_buffer, read_size);
     offset += read_size;
   }
-  md5Finalize(&md5);
 
-  if(memcmp(&md5.digest[0], &meta.staged_md5, sizeof(meta.staged_md5) != 0)) {
+  oepl_flash_session_end();
+  oepl_hw_flash_deepsleep();
+  return retval;
+}
+
+static oepl_nvm_status_t compare_md5(MD5Context* md5, uint64_t expected)
+{
+  md5Finalize(md5);
+
+  if(memcmp(&md5->digest[0], &expected, sizeof(expected)) != 0) {
     DPRINTF("MD5 failed, got [ ");
     for(size_t i = 0; i < 8; i++) {
-      DPRINTF("%02X", md5.digest[i]);
+      DPRINTF("%02X", md5->digest[i]);
     }
     DPRINTF(" ] expected [ ");
     for(size_t i = 0; i < 8; i++) {
-      DPRINTF("%02X", ((uint8_t*)&meta.staged_md5)[i]);
+      DPRINTF("%02X", ((uint8_t*)&expected)[i]);
     }
-    retval = NVM_NOT_FOUND;
-    goto exit;
+    DPRINTF(" ]\n");
+    return NVM_NOT_FOUND;
   }
-  exit:
-  oepl_hw_flash_deepsleep();
-  return retval;
+
+  return NVM_SUCCESS;
 }
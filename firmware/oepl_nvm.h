@@ -81,13 +81,26 @@ oepl_nvm_status_t oepl_nvm_get_num_img_slots(size_t *num_slots, size_t* slot_siz
 oepl_nvm_status_t oepl_nvm_get_image_raw_address(size_t img_idx, uint32_t* address);
 oepl_nvm_status_t oepl_nvm_get_image_by_hash(uint64_t md5, uint32_t size, size_t* img_idx, oepl_stored_image_hdr_t* metadata);
 oepl_nvm_status_t oepl_nvm_get_image_by_type(uint8_t image_type, size_t* img_idx, size_t* seqno);
-oepl_nvm_status_t oepl_nvm_get_free_image_slot(size_t* img_idx, uint8_t image_type);
+// Find a slot for a new image. Unoccupied slots and unfinished downloads that can't be resumed
+// come first; with allow_evict, the oldest image of the same type and then resumable downloads
+// are given up to make room.
+oepl_nvm_status_t oepl_nvm_get_free_image_slot(size_t* img_idx, uint8_t image_type, bool allow_evict);
 oepl_nvm_status_t oepl_nvm_erase_image(size_t img_idx);
 oepl_nvm_status_t oepl_nvm_erase_image_cache(uint8_t image_type);
 oepl_nvm_status_t oepl_nvm_write_image_metadata(size_t img_idx, oepl_stored_image_hdr_t* metadata);
 oepl_nvm_status_t oepl_nvm_read_image_metadata(size_t img_idx, oepl_stored_image_hdr_t* metadata);
 oepl_nvm_status_t oepl_nvm_write_image_bytes(size_t img_idx, size_t offset, const uint8_t* bytes, size_t length);
 oepl_nvm_status_t oepl_nvm_read_image_bytes(size_t img_idx, size_t offset, uint8_t* bytes, size_t length);
+// Write bytes of an image download in order, keeping a running MD5 over them
+oepl_nvm_status_t oepl_nvm_append_image_bytes(size_t img_idx, size_t offset, const uint8_t* bytes, size_t length);
+// Mark the first 'length' appended bytes as checked (block checksum passed), which makes them resumable progress
+oepl_nvm_status_t oepl_nvm_accept_image_bytes(size_t img_idx, size_t length);
+// Write the MD5 state of the image or firmware download in progress to NVM3, it's otherwise only saved every few blocks
+void oepl_nvm_save_download_progress(void);
+// Bytes of an unfinished download in the slot which are safely in flash, always a multiple of 4096
+oepl_nvm_status_t oepl_nvm_get_image_progress(size_t img_idx, size_t* length);
+// Returns NVM_SUCCESS when the first 'size' bytes of the slot match 'md5', NVM_NOT_FOUND when they don't
+oepl_nvm_status_t oepl_nvm_check_image_md5(size_t img_idx, uint64_t md5, size_t size);
 
 // ------------------------ OTA upgrade functionality --------------------------
 oepl_nvm_status_t oepl_fwu_erase(void);
@@ -49,6 +49,11 @@
 #define FORCED_SCAN_ROUNDS 4
 #define QUICK_SCAN_ROUNDS 2
 #define LONG_POLL_INTERVAL 300     // How often to do a long poll (including temperature and voltage measurements)
+#define DATABLOCK_BUFFER_COUNT 2   // Block buffers in total (delivered and in flight), so the next block can be received while the application processes the previous
+#define RX_RING_SIZE 8             // Received packets held between the RAIL IRQ and the event loop (power of two)
+#define STREAM_PAGE_SIZE 256       // Streamed blocks are handed to the sink in flash pages of this size
+#define STREAM_WINDOW_PAGES 4      // Pages of a streamed block which can be assembled at the same time
+#define STREAM_WINDOW_SIZE (STREAM_PAGE_SIZE * STREAM_WINDOW_PAGES)
 
 
 
@@ -112,6 +117,13 @@ typedef struct {
   uint8_t remaining_parts_mask[6];
   // Did we receive an ACK for our block request?
   bool ack_recv;
+  // Amount of data bytes in the requested block
+  size_t block_size;
+  // Streamed blocks: header, running checksum, and the offset of the first page not handed to the sink yet
+  uint8_t stream_header[sizeof(struct blockData)];
+  uint16_t stream_checksum;
+  size_t stream_offset;
+  bool stream_failed;
 } blockreq_data_t;
 
 typedef struct {
@@ -138,6 +150,8 @@ typedef union {
 static void start_rx(uint8_t channel);
 /// Turn off the radio
 static void stop_rx(void);
+/// Run the state machine once, consuming at most one received frame
+static void process_rx_state(void);
 /// Try to parse a packet from the RX queue
 /// Returns true if a packet matching one of the expected packet types has been
 /// received, in which case the data for the pointers will be valid
@@ -164,6 +178,15 @@ static void get_mac_le(uint8_t* mac);
 static bool is_packet_unicast(const void *buffer);
 /// Check whether the packet has been unicast to our hardware MAC address
 static const struct MacFrameNormal* is_packet_for_us(const void *buffer);
+/// Hand the completed block buffer over to the application
+static void deliver_datablock(void);
+/// Store a received block part and clear it from the mask. Returns false if it
+/// can't be stored yet, in which case it will be requested again.
+static bool store_block_part(uint8_t part, const uint8_t* data);
+/// Validate a block of which all parts have been received, and describe it
+static bool finish_datablock(oepl_radio_blockrecv_t* blockdesc);
+/// Free the buffers of the block being received
+static void free_block_buffers(void);
 /// Reset the radio state
 static void reset_radio(void);
 /// Set the radio to idle state
@@ -196,8 +219,25 @@ static uint8_t rx_buffer[128];
 static uint8_t tx_buffer[128];
 /// Block buffer to assemble a data block which is received in parts from the AP
 static uint8_t* datablock_buffer = NULL;
-/// Packet handle (written by IRQ, cleared by the event loop)
-static volatile RAIL_RxPacketHandle_t phandle = NULL;
+/// Completed block buffers handed to the application, oldest first, until it releases them
+static uint8_t* datablock_delivered[DATABLOCK_BUFFER_COUNT];
+/// Number of entries in \p datablock_delivered
+static size_t num_datablocks_delivered = 0;
+/// Destination for streamed blocks, NULL to assemble blocks in \p datablock_buffer
+static oepl_radio_block_sink_t block_sink = NULL;
+/// Ring of pages in which a streamed block is assembled until they can be handed to the sink
+static uint8_t* stream_window = NULL;
+/// Ring of packets held in the RAIL receive FIFO until the event loop copies them out, so
+/// the FIFO size rather than the ring bounds how many full block parts can queue up. Only
+/// the IRQ advances the head and only the event loop advances the tail, both free running
+/// and wrapped on access, so it needs no locking.
+static RAIL_RxPacketHandle_t rx_ring[RX_RING_SIZE];
+static volatile uint8_t rx_ring_head = 0;
+static volatile uint8_t rx_ring_tail = 0;
+/// Packets dropped because the ring was full
+static volatile uint32_t rx_ring_drops = 0;
+/// Highest number of packets queued in the ring
+static volatile uint8_t rx_ring_high_water = 0;
 /// State tracking for the radio state machine (internal)
 static rx_state_t rx_state = OFF;
 /// State tracking for the outside-visible radio process state
@@ -375,6 +415,17 @@ void oepl_radio_init(oepl_radio_event_cb_t cb, uint8_t reason, uint8_t channel)
  * each iteration of the main event loop such that it can process events.
  *****************************************************************************/
 void oepl_radio_process(void)
+{
+  // Drain all frames which were queued up during a burst, as long as the
+  // current state keeps consuming them
+  uint8_t tail;
+  do {
+    tail = rx_ring_tail;
+    process_rx_state();
+  } while(rx_ring_tail != tail && rx_ring_tail != rx_ring_head);
+}
+
+static void process_rx_state(void)
 {
   RAIL_RxPacketInfo_t packet_info;
   RAIL_RxPacketDetails_t packet_details;
@@ -618,9 +669,9 @@ void oepl_radio_process(void)
           } else if (bp->blockPart < 8 * sizeof(current_state_data.blockreq.remaining_parts_mask)) {
             if((current_state_data.blockreq.remaining_parts_mask[bp->blockPart/8] & (1 << (bp->blockPart % 8))) != 0) {
               DPRINTF("unseen part %d\n", bp->blockPart);
-              size_t size_to_copy = bp->blockPart == 41 ? 41 : 99;
-              memcpy(&datablock_buffer[bp->blockPart * 99], &payload[sizeof(struct blockPart)], size_to_copy);
-              current_state_data.blockreq.remaining_parts_mask[bp->blockPart/8] &= ~(1 << (bp->blockPart % 8));
+              if(!store_block_part(bp->blockPart, &payload[sizeof(struct blockPart)])) {
+                DPRINTF("Part %d is outside of the stream window\n", bp->blockPart);
+              }
               for(size_t i = 0; i < sizeof(current_state_data.blockreq.remaining_parts_mask); i++) {
                 if(current_state_data.blockreq.remaining_parts_mask[i] != 0) {
                   DPRINTF("Rem [");
@@ -632,24 +683,7 @@ void oepl_radio_process(void)
                 }
                 if(i == sizeof(current_state_data.blockreq.remaining_parts_mask) - 1) {
                   oepl_radio_blockrecv_t blockdesc;
-                  bool blockvalid = false;
-                  struct blockData * bd = (struct blockData *)datablock_buffer;
-                  blockdesc.block_index = current_state_data.blockreq.requested_block.idx;
-                  blockdesc.block_size = bd->size;
-                  blockdesc.block_data = &datablock_buffer[sizeof(struct blockData)];
-
-                  if (bd->size > BLOCK_XFER_BUFFER_SIZE - sizeof(struct blockData)) {
-                    DPRINTF("PROTO: Impossible data size; size = %d\n", bd->size);
-                  } else {
-                    uint16_t t = 0;
-                    for (uint16_t c = 0; c < bd->size; c++) {
-                      t += bd->data[c];
-                    }
-                    blockvalid = t == bd->checksum;
-                    if(!blockvalid) {
-                      DPRINTF("Checksum on block invalid, expected 0x%04x but calculated %04x\n", bd->checksum, t);
-                    }
-                  }
+                  bool blockvalid = finish_datablock(&blockdesc);
 
                   idle_radio();
                   radio_state = IDLE;
@@ -657,22 +691,12 @@ void oepl_radio_process(void)
                   oepl_radio_action_t cb_result;
                   if(blockvalid) {
                     DPRINTF("Complete\n");
+                    deliver_datablock();
                     cb_result = cb_fptr(BLOCK_COMPLETE, &blockdesc);
                   } else {
-                    DPRINTF("Header bytes 0x%02x 0x%02x 0x%02x 0x%02x\n", datablock_buffer[0], datablock_buffer[1], datablock_buffer[2], datablock_buffer[3]);
-                    DPRINTF("Checksummed bytes:");
-                    for(size_t i = 0; i < SL_MIN(bd->size, BLOCK_XFER_BUFFER_SIZE - sizeof(struct blockData)); i++) {
-                      if((i & 0x7) == 0) {
-                        DPRINTF("\n");
-                      }
-                      DPRINTF("%02x ", bd->data[i]);
-                    }
                     cb_result = cb_fptr(BLOCK_CANCELED, NULL);
                     if(rx_state != AWAIT_BLOCK && rx_state != AWAIT_BLOCKREQ_ACK) {
-                      if(datablock_buffer) {
-                        free(datablock_buffer);
-                        datablock_buffer = NULL;
-                      }
+                      free_block_buffers();
                     }
                   }
                   if(cb_result == ACTION_COMPLETED) {
@@ -698,10 +722,7 @@ void oepl_radio_process(void)
           oepl_radio_request_datablock(current_state_data.blockreq.requested_block);
         } else {
           radio_state = IDLE;
-          if(datablock_buffer) {
-            free(datablock_buffer);
-            datablock_buffer = NULL;
-          }
+          free_block_buffers();
           cb_fptr(BLOCK_TIMEOUT, NULL);
         }
       }
@@ -753,9 +774,9 @@ void oepl_radio_process(void)
                 } else if (bp->blockPart < 42) {
                   if((current_state_data.blockreq.remaining_parts_mask[bp->blockPart/8] & (1 << (bp->blockPart % 8))) != 0) {
                     DPRINTF("unseen part %d\n", bp->blockPart);
-                    size_t size_to_copy = bp->blockPart == 41 ? 41 : 99;
-                    memcpy(&datablock_buffer[bp->blockPart * 99], &payload[sizeof(struct blockPart)], size_to_copy);
-                    current_state_data.blockreq.remaining_parts_mask[bp->blockPart/8] &= ~(1 << (bp->blockPart % 8));
+                    if(!store_block_part(bp->blockPart, &payload[sizeof(struct blockPart)])) {
+                      DPRINTF("Part %d is outside of the stream window\n", bp->blockPart);
+                    }
                     for(size_t i = 0; i < sizeof(current_state_data.blockreq.remaining_parts_mask); i++) {
                       if(current_state_data.blockreq.remaining_parts_mask[i] != 0) {
                         DPRINTF("Rem [");
@@ -768,24 +789,7 @@ void oepl_radio_process(void)
                       if(i == sizeof(current_state_data.blockreq.remaining_parts_mask) - 1) {
                         expect_more_blocks = false;
                         oepl_radio_blockrecv_t blockdesc;
-                        bool blockvalid = false;
-                        struct blockData * bd = (struct blockData *)datablock_buffer;
-                        blockdesc.block_index = current_state_data.blockreq.requested_block.idx;
-                        blockdesc.block_size = bd->size;
-                        blockdesc.block_data = &datablock_buffer[sizeof(struct blockData)];
-
-                        if (bd->size > BLOCK_XFER_BUFFER_SIZE - sizeof(struct blockData)) {
-                          DPRINTF("PROTO: Impossible data size; size = %d\n", bd->size);
-                        } else {
-                          uint16_t t = 0;
-                          for (uint16_t c = 0; c < bd->size; c++) {
-                            t += bd->data[c];
-                          }
-                          blockvalid = t == bd->checksum;
-                          if(!blockvalid) {
-                            DPRINTF("Checksum on block invalid, expected 0x%04x but calculated %04x\n", bd->checksum, t);
-                          }
-                        }
+                        bool blockvalid = finish_datablock(&blockdesc);
 
                         idle_radio();
                         radio_state = IDLE;
@@ -793,23 +797,13 @@ void oepl_radio_process(void)
                         oepl_radio_action_t cb_result;
                         if(blockvalid) {
                           DPRINTF("Complete\n");
+                          deliver_datablock();
                           cb_result = cb_fptr(BLOCK_COMPLETE, &blockdesc);
                         } else {
                           DPRINTF("Checksum on block invalid after skipping blockreq ack\n");
-                          DPRINTF("Header bytes 0x%02x 0x%02x 0x%02x 0x%02x\n", datablock_buffer[0], datablock_buffer[1], datablock_buffer[2], datablock_buffer[3]);
-                          DPRINTF("Checksummed bytes:");
-                          for(size_t i = 0; i < SL_MIN(bd->size, BLOCK_XFER_BUFFER_SIZE - sizeof(struct blockData)); i++) {
-                            if((i & 0x7) == 0) {
-                              DPRINTF("\n");
-                            }
-                            DPRINTF("%02x ", bd->data[i]);
-                          }
                           cb_result = cb_fptr(BLOCK_CANCELED, NULL);
                           if(rx_state != AWAIT_BLOCK && rx_state != AWAIT_BLOCKREQ_ACK) {
-                            if(datablock_buffer) {
-                              free(datablock_buffer);
-                              datablock_buffer = NULL;
-                            }
+                            free_block_buffers();
                           }
                         }
                         if(cb_result == ACTION_COMPLETED) {
@@ -863,10 +857,7 @@ void oepl_radio_process(void)
             oepl_radio_request_datablock(current_state_data.blockreq.requested_block);
           } else {
             radio_state = IDLE;
-            if(datablock_buffer) {
-              free(datablock_buffer);
-              datablock_buffer = NULL;
-            }
+            free_block_buffers();
             cb_fptr(BLOCK_TIMEOUT, NULL);
           }
         }
@@ -1036,13 +1027,35 @@ oepl_radio_error_t oepl_radio_request_datablock(oepl_datablock_descriptor_t db)
   memcpy(&blockreq->ver, db.file.id, 8);
 
   if(rx_state != AWAIT_BLOCKREQ_ACK && rx_state != AWAIT_BLOCK) {
-    if(datablock_buffer == NULL) {
-      datablock_buffer = malloc(sizeof(struct blockData) + 4096);
-      if(datablock_buffer == NULL) {
-        DPRINTF("Error: couldn't allocate buffer\n");
+    if(block_sink != NULL) {
+      // Streamed blocks only need a few pages of RAM, they end up at the sink
+      if(stream_window == NULL) {
+        stream_window = malloc(STREAM_WINDOW_SIZE);
+        if(stream_window == NULL) {
+          DPRINTF("Error: couldn't allocate stream window\n");
+          return ERROR;
+        }
+      }
+      memset(current_state_data.blockreq.stream_header, 0, sizeof(current_state_data.blockreq.stream_header));
+      current_state_data.blockreq.stream_checksum = 0;
+      current_state_data.blockreq.stream_offset = 0;
+      current_state_data.blockreq.stream_failed = false;
+    } else {
+      size_t buffers_in_use = num_datablocks_delivered + (datablock_buffer != NULL ? 1 : 0);
+      if(datablock_buffer == NULL && buffers_in_use >= DATABLOCK_BUFFER_COUNT) {
+        // Back-pressure: the application has to release a block before the next can be received
+        DPRINTF("No free block buffer, release a block first\n");
         return ERROR;
       }
+      if(datablock_buffer == NULL) {
+        datablock_buffer = malloc(sizeof(struct blockData) + 4096);
+        if(datablock_buffer == NULL) {
+          DPRINTF("Error: couldn't allocate buffer\n");
+          return ERROR;
+        }
+      }
     }
+    current_state_data.blockreq.block_size = blocksize;
     radio_state = DOWNLOADING;
     rx_state = AWAIT_BLOCKREQ_ACK;
 
@@ -1113,15 +1126,46 @@ oepl_radio_error_t oepl_radio_request_datablock(oepl_datablock_descriptor_t db)
 
 oepl_radio_error_t oepl_radio_release_datablock(void)
 {
+  if(num_datablocks_delivered > 0) {
+    // Delivered blocks aren't touched by the radio, so they can be released during a download
+    free(datablock_delivered[0]);
+    num_datablocks_delivered--;
+    for(size_t i = 0; i < num_datablocks_delivered; i++) {
+      datablock_delivered[i] = datablock_delivered[i + 1];
+    }
+    return SUCCESS;
+  }
+
   if(rx_state == AWAIT_BLOCK || rx_state == AWAIT_BLOCKREQ_ACK) {
     // Can't free resources currently in use
     return ERROR;
   }
 
-  if(datablock_buffer != NULL) {
-    free(datablock_buffer);
-    datablock_buffer = NULL;
+  free_block_buffers();
+  return SUCCESS;
+}
+
+oepl_radio_error_t oepl_radio_set_block_sink(oepl_radio_block_sink_t sink)
+{
+  if(rx_state == AWAIT_BLOCK || rx_state == AWAIT_BLOCKREQ_ACK) {
+    // The block in progress was set up for the current sink
+    return ERROR;
   }
+
+  block_sink = sink;
+  return SUCCESS;
+}
+
+oepl_radio_error_t oepl_radio_cancel_datablock(void)
+{
+  if(rx_state != AWAIT_BLOCK && rx_state != AWAIT_BLOCKREQ_ACK) {
+    return SUCCESS;
+  }
+
+  DPRINTF("Canceling block request\n");
+  idle_radio();
+  radio_state = IDLE;
+  free_block_buffers();
   return SUCCESS;
 }
 
@@ -1216,15 +1260,28 @@ void sl_rail_util_on_event(RAIL_Handle_t rail_handle, RAIL_Events_t events)
     RAIL_RxPacketInfo_t info;
     RAIL_RxPacketHandle_t handle = RAIL_HoldRxPacket(rail_handle);
     RAIL_GetRxPacketInfo(sl_rail_util_get_handle(SL_RAIL_UTIL_HANDLE_INST0), handle, &info);
-    if(info.packetStatus == RAIL_RX_PACKET_READY_SUCCESS && info.packetBytes > 4) {
+    if(info.packetStatus == RAIL_RX_PACKET_READY_SUCCESS
+       && info.packetBytes > 4 && info.packetBytes <= sizeof(rx_buffer)) {
       RAIL_RxPacketDetails_t details;
       RAIL_GetRxPacketDetails(rail_handle, handle, &details);
-      if(!details.isAck && phandle == NULL) {
-        phandle = handle;
-      } else {
-        RAIL_ReleaseRxPacket(rail_handle, handle);
+      if(!details.isAck) {
+        // Keep the packet in the RAIL FIFO and queue its handle for the event loop
+        uint8_t queued = rx_ring_head - rx_ring_tail;
+        if(queued < RX_RING_SIZE) {
+          rx_ring[rx_ring_head & (RX_RING_SIZE - 1)] = handle;
+          handle = RAIL_RX_PACKET_HANDLE_INVALID;
+          // Publish the handle only after it has been written
+          __DMB();
+          rx_ring_head++;
+          if(queued + 1 > rx_ring_high_water) {
+            rx_ring_high_water = queued + 1;
+          }
+        } else {
+          rx_ring_drops++;
+        }
       }
-    } else {
+    }
+    if(handle != RAIL_RX_PACKET_HANDLE_INVALID) {
       RAIL_ReleaseRxPacket(rail_handle, handle);
     }
   }
@@ -1252,7 +1309,17 @@ bool oepl_radio_is_event_pending(void)
   // Async actions we might be waiting to process:
   // - Timer expiry
   // - packet RX
-  return state_timer_expired || protocol_timer_expired || (phandle != NULL);
+  return state_timer_expired || protocol_timer_expired || (rx_ring_head != rx_ring_tail);
+}
+
+void oepl_radio_get_rx_stats(size_t* high_water, size_t* dropped)
+{
+  if(high_water) {
+    *high_water = rx_ring_high_water;
+  }
+  if(dropped) {
+    *dropped = rx_ring_drops;
+  }
 }
 
 void oepl_radio_get_mac(uint8_t mac[8])
@@ -1349,40 +1416,28 @@ static bool try_ingest_packet(
   RAIL_RxPacketInfo_t* packet_info, RAIL_RxPacketDetails_t* packet_details)
 {
   bool success = false;
-  if(phandle == NULL) {
-    return false;
-  }
-
-  phandle = RAIL_GetRxPacketInfo(sl_rail_util_get_handle(SL_RAIL_UTIL_HANDLE_INST0), phandle, packet_info);
-  
-  if(phandle == RAIL_RX_PACKET_HANDLE_INVALID) {
-    DPRINTF("Invalid handle\n");
+  if(rx_ring_tail == rx_ring_head) {
     return false;
   }
 
-  if(packet_info->packetBytes > sizeof(rx_buffer)) {
-    DPRINTF("Packet too big, %d > %d\n", packet_info->packetBytes, sizeof(rx_buffer));
-    goto done;
-  }
+  // The IRQ only queues packets with a valid CRC which fit the buffer
+  RAIL_Handle_t rail_handle = sl_rail_util_get_handle(SL_RAIL_UTIL_HANDLE_INST0);
+  RAIL_RxPacketHandle_t handle = rx_ring[rx_ring_tail & (RX_RING_SIZE - 1)];
+  RAIL_GetRxPacketInfo(rail_handle, handle, packet_info);
+  RAIL_GetRxPacketDetails(rail_handle, handle, packet_details);
+  RAIL_CopyRxPacket(rx_buffer, packet_info);
+  RAIL_ReleaseRxPacket(rail_handle, handle);
 
-  if(packet_info->packetStatus != RAIL_RX_PACKET_READY_SUCCESS) {
-    DPRINTF("Ignoring packet with malformed CRC\n");
-    goto done;
-  }
+  // Hand the slot back to the IRQ only after it has been read
+  __DMB();
+  rx_ring_tail++;
 
-  RAIL_CopyRxPacket(rx_buffer, packet_info);
   if(packet_info->packetBytes != rx_buffer[0] - 1) {
     DPRINTF("Mismatch FHR\n");
-    goto done;
+  } else {
+    success = true;
   }
 
-  RAIL_GetRxPacketDetails(sl_rail_util_get_handle(SL_RAIL_UTIL_HANDLE_INST0), phandle, packet_details);
-  success = true;
-
-done:
-  RAIL_ReleaseRxPacket(sl_rail_util_get_handle(SL_RAIL_UTIL_HANDLE_INST0), phandle);
-  phandle = NULL;
-
   if(success) {
     if((*f = is_packet_for_us(&rx_buffer[1])) != NULL
        && packet_info->packetBytes >= 1 + sizeof(struct MacFrameNormal) + 1) {
@@ -1689,6 +1744,133 @@ static void checksum_add(void *p, const uint8_t len) {
   ((uint8_t *)p)[0] = total;
 }
 
+static void deliver_datablock(void)
+{
+  if(block_sink != NULL) {
+    // Streamed blocks have already been delivered to the sink
+    free_block_buffers();
+    return;
+  }
+
+  // oepl_radio_request_datablock only starts a download with a free slot
+  datablock_delivered[num_datablocks_delivered++] = datablock_buffer;
+  datablock_buffer = NULL;
+}
+
+static bool store_block_part(uint8_t part, const uint8_t* data)
+{
+  blockreq_data_t* req = &current_state_data.blockreq;
+  // A block is sent as its header followed by the data, cut in 99 byte parts
+  size_t start = part * 99;
+  size_t end = start + (part == 41 ? 41 : 99);
+
+  if(block_sink == NULL) {
+    memcpy(&datablock_buffer[start], data, end - start);
+    req->remaining_parts_mask[part / 8] &= ~(1 << (part % 8));
+    return true;
+  }
+
+  // Data offsets of the part, leaving out the header and the padding of the last part
+  size_t data_start = start < sizeof(struct blockData) ? 0 : start - sizeof(struct blockData);
+  size_t data_end = end - sizeof(struct blockData);
+  if(data_end > req->block_size) {
+    data_end = req->block_size;
+  }
+  if(data_end > req->stream_offset + STREAM_WINDOW_SIZE) {
+    return false;
+  }
+
+  for(; start < sizeof(struct blockData); start++) {
+    req->stream_header[start] = *data++;
+  }
+  for(size_t offset = data_start; offset < data_end; offset++) {
+    stream_window[offset % STREAM_WINDOW_SIZE] = *data;
+    req->stream_checksum += *data++;
+  }
+  req->remaining_parts_mask[part / 8] &= ~(1 << (part % 8));
+
+  // Hand over every full page of which all parts are in. The last, partial
+  // page is handed over by finish_datablock.
+  while(!req->stream_failed && req->stream_offset + STREAM_PAGE_SIZE <= req->block_size) {
+    size_t first_part = (req->stream_offset + sizeof(struct blockData)) / 99;
+    size_t last_part = (req->stream_offset + sizeof(struct blockData) + STREAM_PAGE_SIZE - 1) / 99;
+    for(size_t i = first_part; i <= last_part; i++) {
+      if(req->remaining_parts_mask[i / 8] & (1 << (i % 8))) {
+        return true;
+      }
+    }
+    req->stream_failed = !block_sink(req->requested_block.idx, req->stream_offset,
+                                     &stream_window[req->stream_offset % STREAM_WINDOW_SIZE], STREAM_PAGE_SIZE);
+    req->stream_offset += STREAM_PAGE_SIZE;
+  }
+  return true;
+}
+
+static bool finish_datablock(oepl_radio_blockrecv_t* blockdesc)
+{
+  blockreq_data_t* req = &current_state_data.blockreq;
+  const struct blockData* bd = (const struct blockData*)(block_sink ? req->stream_header : datablock_buffer);
+  blockdesc->block_index = req->requested_block.idx;
+  blockdesc->block_size = bd->size;
+  blockdesc->block_data = block_sink ? NULL : &datablock_buffer[sizeof(struct blockData)];
+
+  if (bd->size > BLOCK_XFER_BUFFER_SIZE - sizeof(struct blockData)) {
+    DPRINTF("PROTO: Impossible data size; size = %d\n", bd->size);
+    return false;
+  }
+
+  uint16_t t = 0;
+  if(block_sink != NULL) {
+    if(bd->size != req->block_size) {
+      DPRINTF("PROTO: Streamed block has size %d instead of %d\n", bd->size, req->block_size);
+      return false;
+    }
+    if(!req->stream_failed && req->stream_offset < req->block_size) {
+      req->stream_failed = !block_sink(req->requested_block.idx, req->stream_offset,
+                                       &stream_window[req->stream_offset % STREAM_WINDOW_SIZE],
+                                       req->block_size - req->stream_offset);
+      req->stream_offset = req->block_size;
+    }
+    if(req->stream_failed) {
+      DPRINTF("Couldn't stream block to its destination\n");
+      return false;
+    }
+    t = req->stream_checksum;
+  } else {
+    for (uint16_t c = 0; c < bd->size; c++) {
+      t += bd->data[c];
+    }
+  }
+
+  if(t != bd->checksum) {
+    DPRINTF("Checksum on block invalid, expected 0x%04x but calculated %04x\n", bd->checksum, t);
+    if(block_sink == NULL) {
+      DPRINTF("Header bytes 0x%02x 0x%02x 0x%02x 0x%02x\n", datablock_buffer[0], datablock_buffer[1], datablock_buffer[2], datablock_buffer[3]);
+      DPRINTF("Checksummed bytes:");
+      for(size_t i = 0; i < bd->size; i++) {
+        if((i & 0x7) == 0) {
+          DPRINTF("\n");
+        }
+        DPRINTF("%02x ", bd->data[i]);
+      }
+    }
+    return false;
+  }
+  return true;
+}
+
+static void free_block_buffers(void)
+{
+  if(datablock_buffer) {
+    free(datablock_buffer);
+    datablock_buffer = NULL;
+  }
+  if(stream_window) {
+    free(stream_window);
+    stream_window = NULL;
+  }
+}
+
 static void idle_radio(void)
 {
   sl_sleeptimer_stop_timer(&protocol_timer_handle);
@@ -1700,10 +1882,10 @@ static void idle_radio(void)
     RAIL_Idle(sl_rail_util_get_handle(SL_RAIL_UTIL_HANDLE_INST0), RAIL_IDLE_ABORT, true);
   }
 
-  if(phandle != NULL) {
-    // Clear out straggling packet
-    RAIL_ReleaseRxPacket(sl_rail_util_get_handle(SL_RAIL_UTIL_HANDLE_INST0), phandle);
-    phandle = NULL;
+  while(rx_ring_tail != rx_ring_head) {
+    // Clear out straggling packets
+    RAIL_ReleaseRxPacket(sl_rail_util_get_handle(SL_RAIL_UTIL_HANDLE_INST0), rx_ring[rx_ring_tail & (RX_RING_SIZE - 1)]);
+    rx_ring_tail++;
   }
 
   if(has_sleepblock) {
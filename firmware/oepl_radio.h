@@ -71,6 +71,14 @@ typedef struct {
  *****************************************************************************/
 typedef oepl_radio_action_t (*oepl_radio_event_cb_t)(oepl_radio_event_t event, const void* event_data);
 
+/**************************************************************************//**
+ * Type definition for a block sink. Streamed blocks are handed to it in
+ * order, in flash pages while they are being received, at their offset in
+ * the block. Return false if the data couldn't be stored, which fails the
+ * block.
+ *****************************************************************************/
+typedef bool (*oepl_radio_block_sink_t)(size_t block_index, size_t offset, const uint8_t* data, size_t length);
+
 typedef struct {
   /// Information returned by the AP in response to a data poll
   struct AvailDataInfo AP_data;
@@ -87,8 +95,9 @@ typedef struct {
   size_t block_size;
   /// Pointer to the received block data, of length block_size.
   /// Note that this buffer must be explicitly free'd through calling
-  /// oepl_radio_blockbuffer_release() when the application is
-  /// done processing it, and before starting the next block request.
+  /// oepl_radio_release_datablock() when the application is done
+  /// processing it. The next block can be requested before that.
+  /// NULL for streamed blocks, which have been handed to the block sink.
   const uint8_t* block_data;
 } oepl_radio_blockrecv_t;
 
@@ -142,19 +151,40 @@ oepl_radio_error_t oepl_radio_send_tagdata(uint8_t* data, size_t length);
  * Request data block. This will start a block download and generate a
  * BLOCK_COMPLETE event when the block has been downloaded.
  *
+ * The radio has a spare block buffer, so the next block can be requested
+ * while the application is still processing the previous one. Returns ERROR
+ * when all buffers are held by the application.
+ *
  * Reminder: A file is split in blocks of 4096 bytes, and each block is
  * transfered in parts which fit in the PHY's PSDU.
  *****************************************************************************/
 oepl_radio_error_t oepl_radio_request_datablock(oepl_datablock_descriptor_t db);
 
 /**************************************************************************//**
- * Release the resources associated with the datablock which was received in
- * the BLOCK_COMPLETE event.
- * 
- * Needs to have been called before requesting the next datablock.
+ * Release the resources associated with the oldest datablock which was
+ * received in a BLOCK_COMPLETE event and not released yet.
+ *
+ * Can be called while the next datablock is being downloaded.
  *****************************************************************************/
 oepl_radio_error_t oepl_radio_release_datablock(void);
 
+/**************************************************************************//**
+ * Stream the blocks of following requests to the sink instead of assembling
+ * them in a RAM buffer, or go back to buffered blocks with NULL. Parts which
+ * arrive too far ahead of the first incomplete page are dropped and
+ * requested again.
+ *
+ * Can't be changed while a block download is in progress.
+ *****************************************************************************/
+oepl_radio_error_t oepl_radio_set_block_sink(oepl_radio_block_sink_t sink);
+
+/**************************************************************************//**
+ * Stop a block download which is in progress without generating an event,
+ * e.g. when the application gave up on the file while the next block was
+ * already requested.
+ *****************************************************************************/
+oepl_radio_error_t oepl_radio_cancel_datablock(void);
+
 /**************************************************************************//**
  * Manually send a transfer complete. This allows the application to process
  * an indication or collect datablocks before ack'ing to the AP.
@@ -178,6 +208,13 @@ bool oepl_radio_is_event_pending(void);
  *****************************************************************************/
 void oepl_radio_get_mac(uint8_t mac[8]);
 
+/**************************************************************************//**
+ * Get the receive queue statistics since boot: the highest number of frames
+ * waiting to be processed, and the number of frames dropped because the
+ * queue was full.
+ *****************************************************************************/
+void oepl_radio_get_rx_stats(size_t* high_water, size_t* dropped);
+
 /**************************************************************************//**
  * Get the details of the AP connection (if connected)
  *****************************************************************************/
@@ -0,0 +1,171 @@
+/******************************************************************************
+ * Draw arena report, for sizing draw_arena_size per hwtype.
+ *
+ * For a range of panel geometries this draws the two kinds of frames a tag
+ * shows: a fullscreen zlib image with the status overlays on top, and a
+ * rendered screen with text, a QR code and the overlays. Each is scanned the
+ * way the display driver does it, rotated and/or bottom to top, and the arena
+ * bytes in use when the first line is done are reported: everything a frame
+ * needs, before any seek points are taken. The image frame is then scanned
+ * again with a few budgets for seek points on top of that, to show what they
+ * save in inflated bytes.
+ *
+ * These are estimates for the tag, not measurements. The host has 8 byte
+ * pointers, so the draw items and pointer tables come out somewhat larger than
+ * on the tag, and the uzlib, QR code and font code it builds against may not be
+ * the versions the firmware uses. The frame log on the tag reports what spilled
+ * to the heap.
+ *****************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "oepl_drawing.hpp"
+#include "oepl_compression.hpp"
+#include "oepl-definitions.h"
+#include "test_images.h"
+#include "bench.h"
+
+extern std::vector<decompress *> decompContexts;
+
+struct panel {
+    uint16_t width;   // of the image, as the AP sends it
+    uint16_t height;
+    bool swapXY;      // the driver scans the image column by column
+    bool mirrorY;     // the driver scans bottom to top
+    uint8_t colors;
+};
+
+static const panel panels[] = {
+    {128, 128, false, false, 2},
+    {176, 264, true, false, 3},
+    {200, 200, false, true, 3},
+    {296, 152, true, false, 3},
+    {384, 168, true, false, 3},
+    {400, 300, false, true, 3},
+    {648, 480, false, false, 3},
+    {800, 480, false, false, 3},
+    {960, 672, true, false, 3},
+};
+
+static const uint8_t windowBits[] = {10, 12};
+static const size_t seekBudgets[] = {0, 2048, 4096, 8192};
+
+// Stand-ins for the overlay bitmaps from common/bitmaps.h, in the same width/height/data layout
+static uint8_t overlayBattery[4 + (2 * 10)] = {16, 0, 10, 0};
+static uint8_t overlayAnt[4 + (2 * 16)] = {16, 0, 16, 0};
+static uint8_t overlayCross[4 + 8] = {8, 0, 8, 0};
+
+static void addOverlays(uint16_t xres, uint16_t yres, uint8_t colors) {
+    uint8_t accent = (colors >= 3) ? COLOR_RED : COLOR_BLACK;
+    C_drawMask(xres - 27, yres - 26, 22, 22, COLOR_BLACK);
+    C_drawMask(xres - 27, yres - 26, 22, 22, accent);
+    C_drawRoundedRectangle(xres - 28, yres - 26, 24, 24, accent);
+    C_addBufferedImage(xres - 24, yres - 19, COLOR_BLACK, ROTATE_0, overlayBattery, DRAW_NORMAL);
+    C_drawMask(xres - 28, 4, 24, 24, COLOR_BLACK);
+    C_drawMask(xres - 28, 4, 24, 24, accent);
+    C_drawRoundedRectangle(xres - 28, 4, 24, 24, accent);
+    C_addBufferedImage(xres - 24, 8, COLOR_BLACK, ROTATE_0, overlayAnt, DRAW_NORMAL);
+    C_addBufferedImage(xres - 16, 15, accent, ROTATE_0, overlayCross, DRAW_NORMAL);
+}
+
+static void drawScreen(uint16_t width, uint16_t height) {
+    if (width * height < 100000) {
+        drawPriceTag(width, height);
+    } else {
+        drawSplash(width, height);
+    }
+}
+
+// The driver scans the panel in lines of its own, the image is turned to fit when swapXY is set
+static void setDisplay(const panel &p) {
+    if (p.swapXY) {
+        C_setDisplayParameters(true, p.height, p.width);
+    } else {
+        C_setDisplayParameters(false, p.width, p.height);
+    }
+}
+
+static uint64_t inflated(void) {
+    uint64_t total = 0;
+    for (decompress *dec : decompContexts) total += dec->inflatedBytes;
+    return total;
+}
+
+// Scans the current draw list like the driver, returning the arena bytes in use after the
+// first line, and the bytes inflated for the whole frame
+static void scan(const panel &p, size_t *firstLine, uint64_t *bytes) {
+    uint16_t lines = p.swapXY ? p.width : p.height;
+    uint16_t lineBytes = ((p.swapXY ? p.height : p.width) + 7) / 8;
+    std::vector<uint8_t> line(lineBytes);
+    for (uint16_t i = 0; i < lines; i++) {
+        uint16_t y = p.mirrorY ? lines - 1 - i : i;
+        for (uint8_t c = 0; c < (p.colors >= 3 ? 2 : 1); c++) {
+            memset(line.data(), 0, lineBytes);
+            C_renderDrawLine(line.data(), y, c ? COLOR_RED : COLOR_BLACK);
+        }
+        if (i == 0) {
+            size_t spilled, highWater;
+            C_getDrawArenaUsage(firstLine, &spilled, &highWater);
+            *firstLine += spilled;
+        }
+    }
+    *bytes = inflated();
+    C_releaseDrawArena();
+}
+
+int main(void) {
+    printf("%-18s %-6s %7s %7s", "panel", "window", "screen", "image");
+    for (size_t budget : seekBudgets) printf("  +%-5lu", (unsigned long)budget);
+    printf("  (bytes inflated per frame)\n");
+
+    for (const panel &p : panels) {
+        frame f = {"", p.width, p.height, drawScreen};
+        C_setDrawArenaSize(65536);
+        std::vector<uint8_t> raw = renderImage(f);
+        if (p.colors < 3) {
+            // black and white panels get 1bpp images, the B/W plane only
+            raw.resize(IMAGE_HEADER_SIZE + ((p.width / 8) * p.height));
+            raw[5] = 1;
+        }
+
+        // A rendered screen
+        size_t screen;
+        uint64_t bytes;
+        setDisplay(p);
+        drawScreen(p.width, p.height);
+        addOverlays(p.width, p.height, p.colors);
+        scan(p, &screen, &bytes);
+
+        for (uint8_t bits : windowBits) {
+            codecConfig c = {"", CODEC_ZLIB, bits, 0};
+            uint32_t fileSize = storeImage(c, raw);
+
+            // A fullscreen image, first with room to spare to see what it takes
+            size_t image;
+            C_setDrawArenaSize(65536);
+            setDisplay(p);
+            C_drawFlashFullscreenImageWithType(0, DATATYPE_IMG_ZLIB, fileSize);
+            addOverlays(p.width, p.height, p.colors);
+            scan(p, &image, &bytes);
+
+            char name[24];
+            snprintf(name, sizeof(name), "%dx%d%s%s", p.width, p.height, p.swapXY ? " swap" : "", p.mirrorY ? " mirror" : "");
+            printf("%-18s %-6lu %7lu %7lu", name, 1UL << bits, (unsigned long)screen, (unsigned long)image);
+
+            // then with that and a budget for seek points
+            size_t need = (screen > image) ? screen : image;
+            for (size_t budget : seekBudgets) {
+                size_t first;
+                C_setDrawArenaSize(need + budget);
+                setDisplay(p);
+                C_drawFlashFullscreenImageWithType(0, DATATYPE_IMG_ZLIB, fileSize);
+                addOverlays(p.width, p.height, p.colors);
+                scan(p, &first, &bytes);
+                printf(" %8lu", (unsigned long)bytes);
+            }
+            printf("\n");
+        }
+    }
+    printf("ok\n");
+    return 0;
+}
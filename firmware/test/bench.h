@@ -0,0 +1,35 @@
+/******************************************************************************
+ * Small helpers shared by the host tests and benchmarks.
+ *****************************************************************************/
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+static inline uint64_t bench_now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+// Deterministic pseudo-random bytes, so every run draws the same content
+static inline uint32_t bench_rand(uint32_t* state)
+{
+  *state = (*state * 1103515245UL) + 12345UL;
+  return *state >> 8;
+}
+
+#define BENCH_CHECK(cond, ...)          \
+  do {                                  \
+    if(!(cond)) {                       \
+      printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+      printf(__VA_ARGS__);              \
+      printf("\n");                     \
+      return 1;                         \
+    }                                   \
+  } while(0)
+
+#endif // BENCH_H
@@ -0,0 +1,110 @@
+/******************************************************************************
+ * Codec benchmark for compressed images: zlib against heatshrink.
+ *
+ * A few typical tag screens are rendered with the drawing engine and packed as
+ * 2bpp images the way the AP sends them. Each is compressed with zlib (as
+ * DATATYPE_IMG_ZLIB) and with heatshrink (as DATATYPE_IMG_HEATSHRINK), at
+ * several window sizes. The test then prints the
+ * compressed size, the decoder's window, and the time to decode the stream
+ * through the decompress class. It also times a full frame drawn from flash,
+ * and checks that every codec gives back exactly the rendered image, drawn as
+ * well as transcoded to the raw layout.
+ *****************************************************************************/
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "oepl_drawing.hpp"
+#include "oepl_compression.hpp"
+#include "oepl-definitions.h"
+#include "test_images.h"
+#include "bench.h"
+
+#define RUNS 5
+
+static const codecConfig codecs[] = {
+    {"zlib w12", CODEC_ZLIB, 12, 0},
+    {"zlib w13", CODEC_ZLIB, 13, 0},
+    {"hs w8 l4", CODEC_HEATSHRINK, 8, 4},
+    {"hs w10 l4", CODEC_HEATSHRINK, 10, 4},
+    {"hs w11 l4", CODEC_HEATSHRINK, 11, 4},
+};
+#define CODEC_COUNT (sizeof(codecs) / sizeof(codecs[0]))
+
+static bool writeRaw(void *ctx, uint32_t offset, const uint8_t *data, size_t length) {
+    std::vector<uint8_t> *out = (std::vector<uint8_t> *)ctx;
+    if (offset + length > out->size()) return false;
+    memcpy(out->data() + offset, data, length);
+    return true;
+}
+
+int main(void) {
+    C_setDrawArenaSize(65536);
+    printf("%-20s %-10s %8s %7s %8s %9s %10s\n", "image", "codec", "bytes", "ratio", "window", "decode", "frame");
+    for (const frame &f : frames) {
+        std::vector<uint8_t> raw = renderImage(f);
+        std::vector<uint8_t> decoded(raw.size());
+        uint32_t planeBytes = (raw.size() - IMAGE_HEADER_SIZE) / 2;
+        uint16_t lineBytes = f.width / 8;
+
+        for (const codecConfig &c : codecs) {
+            uint32_t fileSize = storeImage(c, raw);
+
+            // The stream on its own, front to back as a scan reads it
+            uint64_t decodeNs = UINT64_MAX;
+            for (int run = 0; run < RUNS; run++) {
+                decompress *dec = new decompress;
+                uint64_t start = bench_now_ns();
+                BENCH_CHECK(dec->openFromFlash(0, fileSize, c.codec), "%s %s: failed to open", f.name, c.name);
+                BENCH_CHECK((dec->ctx != nullptr) == (c.codec == CODEC_ZLIB), "%s %s: uzlib context %s", f.name, c.name,
+                            dec->ctx ? "allocated for heatshrink" : "missing");
+                for (uint32_t pos = 0; pos < raw.size(); pos += OUT_CACHE_SIZE) {
+                    uint32_t len = raw.size() - pos < OUT_CACHE_SIZE ? raw.size() - pos : OUT_CACHE_SIZE;
+                    dec->getBlock(pos, &decoded[pos], len);
+                }
+                uint64_t t = bench_now_ns() - start;
+                if (t < decodeNs) decodeNs = t;
+                delete dec;
+                C_flushDrawItems();
+                BENCH_CHECK(decoded == raw, "%s %s: decoded stream differs", f.name, c.name);
+            }
+
+            // A whole frame drawn from flash, both planes
+            uint64_t frameNs = UINT64_MAX;
+            for (int run = 0; run < RUNS; run++) {
+                std::vector<uint8_t> bw(lineBytes), ry(lineBytes);
+                C_setDisplayParameters(false, f.width, f.height);
+                C_drawFlashFullscreenImageWithType(0, c.codec == CODEC_ZLIB ? DATATYPE_IMG_ZLIB : DATATYPE_IMG_HEATSHRINK, fileSize);
+                uint64_t start = bench_now_ns();
+                for (uint16_t y = 0; y < f.height; y++) {
+                    memset(bw.data(), 0, lineBytes);
+                    memset(ry.data(), 0, lineBytes);
+                    C_renderDrawLine(bw.data(), y, COLOR_BLACK);
+                    C_renderDrawLine(ry.data(), y, COLOR_RED);
+                    BENCH_CHECK(memcmp(bw.data(), &raw[IMAGE_HEADER_SIZE + (y * lineBytes)], lineBytes) == 0 &&
+                                memcmp(ry.data(), &raw[IMAGE_HEADER_SIZE + planeBytes + (y * lineBytes)], lineBytes) == 0,
+                                "%s %s: line %d drawn wrong", f.name, c.name, y);
+                }
+                uint64_t t = bench_now_ns() - start;
+                if (t < frameNs) frameNs = t;
+                C_flushDrawItems();
+            }
+
+            // Transcoded outside of a frame, which must leave the arena off the heap
+            std::vector<uint8_t> transcoded(raw.size() - IMAGE_HEADER_SIZE);
+            uint8_t type = c.codec == CODEC_ZLIB ? DATATYPE_IMG_ZLIB : DATATYPE_IMG_HEATSHRINK;
+            C_releaseDrawArena();
+            size_t heapBefore = mallinfo2().uordblks;
+            BENCH_CHECK(C_inflateFlashImage(0, fileSize, transcoded.size(), &type, writeRaw, &transcoded), "%s %s: transcode failed", f.name, c.name);
+            BENCH_CHECK(memcmp(transcoded.data(), &raw[IMAGE_HEADER_SIZE], transcoded.size()) == 0 && type == DATATYPE_IMG_RAW_2BPP,
+                        "%s %s: transcoded image differs", f.name, c.name);
+            BENCH_CHECK(mallinfo2().uordblks == heapBefore, "%s %s: transcode left %ld bytes on the heap", f.name, c.name,
+                        (long)(mallinfo2().uordblks - heapBefore));
+
+            printf("%-20s %-10s %8u %6.1f%% %8lu %6.1f ns/B %7.1f ms\n", f.name, c.name, fileSize, 100.0 * fileSize / raw.size(),
+                   1UL << c.windowBits, (double)decodeNs / raw.size(), frameNs / 1e6);
+        }
+    }
+    printf("ok\n");
+    return 0;
+}
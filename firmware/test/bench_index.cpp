@@ -0,0 +1,133 @@
+/******************************************************************************
+ * Scanline index benchmark for drawItem::renderDrawLinePlanes.
+ *
+ * Builds the 7.5" splash screen with both overlays on an 800x480 canvas, and
+ * renders every line of it through the index and through a plain walk over the
+ * draw list, which is what renderDrawLine did before the index. The two have to
+ * come out identical; the timings are printed per line.
+ *****************************************************************************/
+#include "../oepl_drawing.cpp"
+#include "fonts/fonts.h"
+#include "bench.h"
+
+#define XRES 800
+#define YRES 480
+#define LINE_BYTES (XRES / 8)
+#define RUNS 20
+
+// The protected per-item renderer, for the reference walk
+struct itemProbe : drawItem {
+    static void drawLine(drawItem *di, uint8_t *line, uint16_t number, uint8_t c) {
+        static_cast<itemProbe *>(di)->getDrawLine(line, number, c);
+    }
+};
+
+static void renderDrawLineWalk(uint8_t *line, uint16_t number, uint8_t c) {
+    for (uint16_t i = 0; i < drawItemCount; i++) {
+        itemProbe::drawLine(drawItems[i], line, number, c);
+    }
+}
+
+// Stand-ins for the bitmaps from common/bitmaps.h, in the same width/height/data layout
+static uint8_t *makeSprite(uint16_t width, uint16_t height, uint32_t seed) {
+    uint16_t widthBytes = (width + 7) / 8;
+    uint8_t *image = (uint8_t *)malloc(4 + (widthBytes * height));
+    ((uint16_t *)image)[0] = width;
+    ((uint16_t *)image)[1] = height;
+    for (uint32_t i = 0; i < (uint32_t)(widthBytes * height); i++) image[4 + i] = bench_rand(&seed);
+    return image;
+}
+
+static void addSplash(const uint8_t *newton, const uint8_t *battery, const uint8_t *ant, const uint8_t *cross) {
+    const uint16_t xres = XRES, yres = YRES;
+    uint8_t mac[8] = {0x00, 0x00, 0x02, 0x8A, 0x3B, 0x41, 0x7C, 0x90};
+
+    C_epdSetFont(&FreeSansBold24pt7b);
+    C_epdPrintf(10, 10, COLOR_BLACK, ROTATE_0, "OpenEPaperLink");
+    C_epdSetFont(&FreeSansBold18pt7b);
+    C_epdPrintf(15, 60, COLOR_RED, ROTATE_0, "Newton M3 7.5\"");
+    C_epdSetFont(&FreeSans9pt7b);
+    C_epdPrintf(xres - 17, 310, COLOR_BLACK, ROTATE_270, "FW: %04X-%s", 0x0027, "dev");
+    C_epdPrintf(10, yres - 25, COLOR_BLACK, ROTATE_0, "MAC: %02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], mac[6], mac[7]);
+    C_addFlashImage(420, 81, COLOR_BLACK, ROTATE_0, newton);
+    C_addQR(100, 160, 3, 7, "https://openepaperlink.eu/tag/0/%02X/%02X%02X%02X%02X%02X%02X%02X%02X/", 0x26, mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], mac[6], mac[7]);
+
+    // Low battery and no-AP overlays, as add_overlays draws them on a 3-color panel
+    C_drawMask(xres - 27, yres - 26, 22, 22, COLOR_BLACK);
+    C_drawMask(xres - 27, yres - 26, 22, 22, COLOR_RED);
+    C_drawRoundedRectangle(xres - 28, yres - 26, 24, 24, COLOR_RED);
+    C_addBufferedImage(xres - 24, yres - 19, COLOR_BLACK, ROTATE_0, battery, DRAW_NORMAL);
+    C_drawMask(xres - 28, 4, 24, 24, COLOR_BLACK);
+    C_drawMask(xres - 28, 4, 24, 24, COLOR_RED);
+    C_drawRoundedRectangle(xres - 28, 4, 24, 24, COLOR_RED);
+    C_addBufferedImage(xres - 24, 8, COLOR_BLACK, ROTATE_0, ant, DRAW_NORMAL);
+    C_addBufferedImage(xres - 16, 15, COLOR_RED, ROTATE_0, cross, DRAW_NORMAL);
+}
+
+int main(void) {
+    static uint8_t indexed[2][YRES][LINE_BYTES];
+    static uint8_t walked[2][YRES][LINE_BYTES];
+    uint8_t *newton = makeSprite(340, 320, 1);
+    uint8_t *battery = makeSprite(16, 10, 2);
+    uint8_t *ant = makeSprite(16, 16, 3);
+    uint8_t *cross = makeSprite(8, 8, 4);
+
+    C_setDisplayParameters(false, XRES, YRES);
+    C_setDrawArenaSize(32768);
+    addSplash(newton, battery, ant, cross);
+    uint16_t count, highWater, dropped;
+    C_getDrawItemUsage(&count, &highWater, &dropped);
+    BENCH_CHECK(dropped == 0, "%d draw items dropped", dropped);
+
+    uint64_t indexNs = UINT64_MAX, walkNs = UINT64_MAX, planesNs = UINT64_MAX;
+    for (int run = 0; run < RUNS; run++) {
+        uint64_t start = bench_now_ns();
+        for (uint16_t y = 0; y < YRES; y++) {
+            for (uint8_t c = 0; c < 2; c++) {
+                memset(indexed[c][y], 0, LINE_BYTES);
+                C_renderDrawLine(indexed[c][y], y, c);
+            }
+        }
+        uint64_t t = bench_now_ns() - start;
+        if (t < indexNs) indexNs = t;
+
+        start = bench_now_ns();
+        for (uint16_t y = 0; y < YRES; y++) {
+            for (uint8_t c = 0; c < 2; c++) {
+                memset(walked[c][y], 0, LINE_BYTES);
+                renderDrawLineWalk(walked[c][y], y, c);
+            }
+        }
+        t = bench_now_ns() - start;
+        if (t < walkNs) walkNs = t;
+
+        start = bench_now_ns();
+        for (uint16_t y = 0; y < YRES; y++) {
+            uint8_t *planes[2] = {indexed[0][y], indexed[1][y]};
+            memset(planes[0], 0, LINE_BYTES);
+            memset(planes[1], 0, LINE_BYTES);
+            C_renderDrawLinePlanes(y, planes, 2);
+        }
+        t = bench_now_ns() - start;
+        if (t < planesNs) planesNs = t;
+    }
+
+    for (uint8_t c = 0; c < 2; c++) {
+        for (uint16_t y = 0; y < YRES; y++) {
+            BENCH_CHECK(memcmp(indexed[c][y], walked[c][y], LINE_BYTES) == 0, "color %d line %d differs from the list walk", c, y);
+        }
+    }
+
+    printf("%d items in %d bands, %d lines x 2 colors\n", count, drawBandCount, YRES);
+    printf("list walk:         %7.0f ns/line\n", (double)walkNs / (2 * YRES));
+    printf("index, per color:  %7.0f ns/line\n", (double)indexNs / (2 * YRES));
+    printf("index, per frame:  %7.0f ns/line (both colors at once)\n", (double)planesNs / (2 * YRES));
+    printf("ok\n");
+
+    C_flushDrawItems();
+    free(newton);
+    free(battery);
+    free(ant);
+    free(cross);
+    return 0;
+}
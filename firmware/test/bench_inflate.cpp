@@ -0,0 +1,83 @@
+/******************************************************************************
+ * Inflate cost of mirrored scans of compressed images.
+ *
+ * A mirrored display asks for the lines of a fullscreen image bottom to top,
+ * so every line is a backward seek in the compressed stream. This draws a few
+ * typical screens as compressed images, scans them front to back and
+ * back to front for several arena sizes, and prints the bytes the streams had
+ * to inflate per frame. The seek points live in what the arena has left, so
+ * the mirrored cost drops as the arena grows. Both scans are checked against
+ * the rendered image.
+ *****************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "oepl_drawing.hpp"
+#include "oepl_compression.hpp"
+#include "oepl-definitions.h"
+#include "test_images.h"
+#include "bench.h"
+
+extern std::vector<decompress *> decompContexts;
+
+static const codecConfig codecs[] = {
+    {"zlib w12", CODEC_ZLIB, 12, 0},
+    {"zlib w13", CODEC_ZLIB, 13, 0},
+    {"hs w10 l4", CODEC_HEATSHRINK, 10, 4},
+};
+static const size_t arenaSizes[] = {16384, 24576, 32768, 49152};
+
+static uint64_t inflated(void) {
+    uint64_t total = 0;
+    for (decompress *dec : decompContexts) total += dec->inflatedBytes;
+    return total;
+}
+
+// Draws the image from flash and renders every line, returning the bytes inflated for it
+static int scanFrame(const frame &f, uint8_t type, uint32_t fileSize, const std::vector<uint8_t> &raw, bool mirrored, uint64_t *bytes, uint64_t *ns) {
+    uint16_t lineBytes = f.width / 8;
+    uint32_t planeBytes = lineBytes * f.height;
+    std::vector<uint8_t> bw(lineBytes), ry(lineBytes);
+
+    C_setDisplayParameters(false, f.width, f.height);
+    C_drawFlashFullscreenImageWithType(0, type, fileSize);
+    uint64_t start = bench_now_ns();
+    for (uint16_t i = 0; i < f.height; i++) {
+        uint16_t y = mirrored ? f.height - 1 - i : i;
+        memset(bw.data(), 0, lineBytes);
+        memset(ry.data(), 0, lineBytes);
+        C_renderDrawLine(bw.data(), y, COLOR_BLACK);
+        C_renderDrawLine(ry.data(), y, COLOR_RED);
+        BENCH_CHECK(memcmp(bw.data(), &raw[IMAGE_HEADER_SIZE + (y * lineBytes)], lineBytes) == 0 &&
+                    memcmp(ry.data(), &raw[IMAGE_HEADER_SIZE + planeBytes + (y * lineBytes)], lineBytes) == 0,
+                    "%s: line %d drawn wrong%s", f.name, y, mirrored ? " in the mirrored scan" : "");
+    }
+    *ns = bench_now_ns() - start;
+    *bytes = inflated();
+    C_flushDrawItems();
+    return 0;
+}
+
+int main(void) {
+    printf("%-20s %-10s %7s %9s %10s %8s %10s\n", "image", "codec", "arena", "forward", "mirrored", "ratio", "mirrored");
+    for (const frame &f : frames) {
+        C_setDrawArenaSize(65536);
+        std::vector<uint8_t> raw = renderImage(f);
+
+        for (const codecConfig &c : codecs) {
+            uint32_t fileSize = storeImage(c, raw);
+            uint8_t type = (c.codec == CODEC_ZLIB) ? DATATYPE_IMG_ZLIB : DATATYPE_IMG_HEATSHRINK;
+
+            for (size_t arena : arenaSizes) {
+                uint64_t forward, mirrored, forwardNs, mirroredNs;
+                C_setDrawArenaSize(arena);
+                if (scanFrame(f, type, fileSize, raw, false, &forward, &forwardNs)) return 1;
+                if (scanFrame(f, type, fileSize, raw, true, &mirrored, &mirroredNs)) return 1;
+                printf("%-20s %-10s %7lu %9lu %10lu %7.1fx %7.1f ms\n", f.name, c.name, (unsigned long)arena,
+                       (unsigned long)forward, (unsigned long)mirrored, (double)mirrored / forward, mirroredNs / 1e6);
+            }
+        }
+    }
+    printf("ok\n");
+    return 0;
+}
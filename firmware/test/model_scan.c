@@ -0,0 +1,296 @@
+/******************************************************************************
+ * Timing model of the frame scan in oepl_display_driver_common.c.
+ *
+ * The driver is built as is, against an SPI driver that runs on a virtual
+ * clock instead of hardware: the CPU and the DMA each have their own time, a
+ * rendered line costs the CPU a fixed amount, and a transfer keeps the DMA busy
+ * for its bytes at the display's bit rate. A transfer can only start once the
+ * CPU has asked for it and the previous one has finished, which is where the
+ * driver waits. Its completion is only reported when the driver sleeps, so
+ * the driver has to wait for it the way it would on the tag.
+ *
+ * Every frame is scanned with the pipelined oepl_display_scan_frame and with the
+ * line-by-line loop it replaced, which has to send the very same bytes, also
+ * with transfers that are aborted halfway and without room for the pipeline's
+ * buffers. The limit column is the slower of rendering and clocking out the
+ * frame alone.
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <spidrv.h>
+#include "em_emu.h"
+#include "oepl_efr32_hwtypes.h"
+#include "oepl_drawing_capi.h"
+#include "drivers/oepl_display_driver_common.h"
+#include "bench.h"
+
+#define SPI_BITRATE 5000000ULL  // as set up in oepl_display_driver_common_activate
+#define TRANSFER_SETUP_NS 10000ULL  // CPU time to start a transfer and take its interrupt
+#define MAX_FRAME_BYTES (960 * 672 / 8)
+
+static uint64_t cpu_ns = 0;
+static uint64_t dma_free_ns = 0;
+static uint32_t render_ns = 0;
+static uint32_t transfers = 0;
+static uint8_t sent[MAX_FRAME_BYTES];
+static size_t sent_len = 0;
+
+// Completion of the transfer in flight, reported when the driver sleeps
+static SPIDRV_Callback_t pending_cb = NULL;
+static SPIDRV_Handle_t pending_handle = NULL;
+static Ecode_t pending_status = ECODE_OK;
+static int pending_items = 0;
+
+// Every this many transfers one is aborted halfway, 0 for none
+static uint32_t abort_every = 0;
+// Whether the arena has room for the pipeline's buffers
+static bool scan_buffer_room = true;
+
+// ---- Fake hardware ----
+
+static USART_TypeDef usart;
+static const oepl_efr32xg22_displayconfig_t display = {
+  .usart = &usart,
+  .MOSI = { gpioPortA, 1, 0 },
+  .MISO = { gpioPortInvalid, 0, 0 },
+  .SCK = { gpioPortA, 2, 0 },
+  .nCS = { gpioPortA, 3, 1 },
+  .nCS2 = { gpioPortInvalid, 0, 0 },
+  .DC = { gpioPortA, 4, 0 },
+  .BUSY = { gpioPortA, 5, 0 },
+  .nRST = { gpioPortA, 6, 1 },
+  .enable = { gpioPortInvalid, 0, 0 },
+};
+static const oepl_efr32xg22_tagconfig_t config = {
+  .display = &display,
+};
+
+const oepl_efr32xg22_tagconfig_t* oepl_efr32xg22_get_config(void)
+{
+  return &config;
+}
+
+static void start_transfer(const void* buffer, int count)
+{
+  if(cpu_ns < dma_free_ns) {
+    cpu_ns = dma_free_ns;
+  }
+  cpu_ns += TRANSFER_SETUP_NS;
+  dma_free_ns = cpu_ns + ((uint64_t)count * 8ULL * 1000000000ULL / SPI_BITRATE);
+  transfers++;
+  if(pending_cb != NULL) {
+    printf("FAIL: transfer started with another one in flight\n");
+    exit(1);
+  }
+  if(sent_len + count <= sizeof(sent)) {
+    memcpy(&sent[sent_len], buffer, count);
+  }
+  sent_len += count;
+}
+
+Ecode_t SPIDRV_Init(SPIDRV_Handle_t handle, SPIDRV_Init_t *initData)
+{
+  handle->initData = *initData;
+  return ECODE_OK;
+}
+
+Ecode_t SPIDRV_DeInit(SPIDRV_Handle_t handle)
+{
+  (void) handle;
+  return ECODE_OK;
+}
+
+// The completion is held back until the driver sleeps. An aborted transfer only
+// gets the first half of its bytes out
+Ecode_t SPIDRV_MTransmit(SPIDRV_Handle_t handle, const void *buffer, int count, SPIDRV_Callback_t callback)
+{
+  if(pending_cb != NULL) {
+    return ECODE_EMDRV_SPIDRV_BUSY;
+  }
+  bool aborted = abort_every && (transfers % abort_every) == abort_every - 1;
+  int items = aborted ? count / 2 : count;
+  start_transfer(buffer, items);
+  pending_cb = callback;
+  pending_handle = handle;
+  pending_status = aborted ? ECODE_EMDRV_SPIDRV_ABORTED : ECODE_OK;
+  pending_items = items;
+  return ECODE_OK;
+}
+
+// Sleeps until the transfer in flight is done
+void EMU_EnterEM1(void)
+{
+  SPIDRV_Callback_t cb = pending_cb;
+  if(cb == NULL) {
+    printf("FAIL: slept without a transfer in flight\n");
+    exit(1);
+  }
+  if(cpu_ns < dma_free_ns) {
+    cpu_ns = dma_free_ns;
+  }
+  pending_cb = NULL;
+  cb(pending_handle, pending_status, pending_items);
+}
+
+Ecode_t SPIDRV_MTransmitB(SPIDRV_Handle_t handle, const void *buffer, int count)
+{
+  (void) handle;
+  start_transfer(buffer, count);
+  cpu_ns = dma_free_ns;
+  return ECODE_OK;
+}
+
+Ecode_t SPIDRV_MTransferB(SPIDRV_Handle_t handle, const void *txBuffer, void *rxBuffer, int count)
+{
+  (void) rxBuffer;
+  return SPIDRV_MTransmitB(handle, txBuffer, count);
+}
+
+void* C_getDrawScanBuffer(size_t size)
+{
+  static uint8_t* buffer = NULL;
+  static size_t buffer_size = 0;
+  if(!scan_buffer_room) {
+    return NULL;
+  }
+  if(size > buffer_size) {
+    free(buffer);
+    buffer = malloc(size);
+    buffer_size = size;
+  }
+  return buffer;
+}
+
+// A line that isn't symmetric in any way, so mirroring mistakes show up
+void C_renderDrawLine(uint8_t *line, uint16_t number, uint8_t c)
+{
+  uint32_t seed = ((uint32_t)number << 8) | c;
+  for(size_t i = 0; i < (size_t)(MAX_FRAME_BYTES / 672); i++) {
+    line[i] = (uint8_t)bench_rand(&seed);
+  }
+  cpu_ns += render_ns;
+}
+
+// ---- The scan loop before the pipeline ----
+
+static void scan_frame_line_by_line(uint8_t* xbuf, size_t bufsize, size_t xstart, size_t xbytes, size_t ystart, size_t ylines, int color, bool mirrorX, bool mirrorY, uint8_t cs_mask)
+{
+  uint8_t swapbuf[MAX_FRAME_BYTES / 672];
+  uint8_t* outbuf = &xbuf[xstart];
+
+  for(size_t line = ystart; line < ystart + ylines; line++) {
+    memset(xbuf, 0, bufsize);
+    if(mirrorY) {
+      C_renderDrawLine(xbuf, ystart + ylines - 1 - (line - ystart), color);
+    } else {
+      C_renderDrawLine(xbuf, line, color);
+    }
+    if(mirrorX) {
+      for(size_t i = 0; i < xbytes; i++) {
+        swapbuf[xbytes - 1 - i] = SL_RBIT8(xbuf[xstart + i]);
+        outbuf = swapbuf;
+      }
+    } else {
+      outbuf = &xbuf[xstart];
+    }
+    oepl_display_driver_common_data_multi(outbuf, xbytes, false, cs_mask);
+  }
+}
+
+// ---- Model ----
+
+typedef struct {
+  uint64_t frame_ns;
+  uint32_t transfers;
+} scan_result_t;
+
+static void reset_clock(void)
+{
+  cpu_ns = 0;
+  dma_free_ns = 0;
+  transfers = 0;
+  sent_len = 0;
+}
+
+static scan_result_t finish_clock(void)
+{
+  scan_result_t result = { cpu_ns > dma_free_ns ? cpu_ns : dma_free_ns, transfers };
+  return result;
+}
+
+static int model(size_t xres, size_t yres, uint32_t line_render_ns, bool print)
+{
+  static uint8_t expected[MAX_FRAME_BYTES];
+  uint8_t xbuf[MAX_FRAME_BYTES / 672];
+  size_t xbytes = xres / 8;
+  scan_result_t piped = { 0 }, serial = { 0 };
+  render_ns = line_render_ns;
+
+  for(uint8_t mirror = 0; mirror < 4; mirror++) {
+    bool mirrorX = mirror & 1;
+    bool mirrorY = mirror & 2;
+
+    reset_clock();
+    scan_frame_line_by_line(xbuf, sizeof(xbuf), 0, xbytes, 0, yres, COLOR_BLACK, mirrorX, mirrorY, CS_LEADER);
+    serial = finish_clock();
+    memcpy(expected, sent, sent_len);
+
+    // Plain, with every third transfer aborted, and without the pipeline's buffers
+    for(uint8_t variant = 0; variant < 3; variant++) {
+      abort_every = (variant == 1) ? 3 : 0;
+      scan_buffer_room = (variant != 2);
+      reset_clock();
+      oepl_display_scan_frame(xbuf, sizeof(xbuf), 0, xbytes, 0, yres, COLOR_BLACK, mirrorX, mirrorY);
+      if(variant == 0) {
+        piped = finish_clock();
+      }
+
+      BENCH_CHECK(pending_cb == NULL, "%zux%zu left a transfer in flight", xres, yres);
+      BENCH_CHECK(sent_len == xbytes * yres, "%zux%zu variant %d sent %zu bytes", xres, yres, variant, sent_len);
+      BENCH_CHECK(memcmp(sent, expected, sent_len) == 0, "%zux%zu mirrorX %d mirrorY %d variant %d differs from the line-by-line scan",
+                  xres, yres, mirrorX, mirrorY, variant);
+    }
+    abort_every = 0;
+    scan_buffer_room = true;
+  }
+
+  if(print) {
+    uint64_t render_total = (uint64_t)line_render_ns * yres;
+    uint64_t spi_total = (uint64_t)xbytes * yres * 8ULL * 1000000000ULL / SPI_BITRATE;
+    printf("%4zux%-4zu %5u us/line %9.1f ms %6u xfers %9.1f ms %6u xfers %6.2fx %9.1f ms\n",
+           xres, yres, line_render_ns / 1000,
+           serial.frame_ns / 1e6, serial.transfers,
+           piped.frame_ns / 1e6, piped.transfers,
+           (double)serial.frame_ns / piped.frame_ns,
+           (render_total > spi_total ? render_total : spi_total) / 1e6);
+  }
+  return 0;
+}
+
+int main(void)
+{
+  static const size_t panels[][2] = { { 960, 672 }, { 800, 480 }, { 400, 300 }, { 128, 296 } };
+  static const uint32_t render_costs_ns[] = { 40000, 150000, 400000 };
+
+  oepl_display_driver_common_activate();
+
+  printf("One color plane per frame, SPI at %llu MHz, %llu us to start a transfer\n", SPI_BITRATE / 1000000, TRANSFER_SETUP_NS / 1000);
+  printf("%-9s %11s %11s %12s %11s %12s %7s %11s\n", "panel", "render", "serial", "", "pipelined", "", "gain", "limit");
+  for(size_t p = 0; p < sizeof(panels) / sizeof(panels[0]); p++) {
+    for(size_t r = 0; r < sizeof(render_costs_ns) / sizeof(render_costs_ns[0]); r++) {
+      if(model(panels[p][0], panels[p][1], render_costs_ns[r], true)) {
+        return 1;
+      }
+    }
+  }
+
+  // Line lengths around the chunk size, including lines too long to pipeline
+  for(size_t xres = 8; xres <= 960; xres += 8) {
+    if(model(xres, 20, 1000, false)) {
+      return 1;
+    }
+  }
+  printf("ok\n");
+  return 0;
+}
@@ -0,0 +1,26 @@
+/******************************************************************************
+ * Host stand-in for the Gecko bootloader interface. host_bootloader.c puts a
+ * single storage slot at the start of the host flash, and programs it the
+ * way NOR flash does.
+ *****************************************************************************/
+#ifndef BTL_INTERFACE_H
+#define BTL_INTERFACE_H
+
+#include <stdint.h>
+#include "btl_interface_storage.h"
+
+#define BOOTLOADER_OK 0
+#define BOOTLOADER_ERROR_INIT_BASE 0x0100
+#define BOOTLOADER_ERROR_INIT_STORAGE (BOOTLOADER_ERROR_INIT_BASE + 0x2)
+#define BOOTLOADER_ERROR_STORAGE_BASE 0x0400
+#define BOOTLOADER_ERROR_STORAGE_INVALID_SLOT (BOOTLOADER_ERROR_STORAGE_BASE + 0x1)
+#define BOOTLOADER_ERROR_STORAGE_INVALID_ADDRESS (BOOTLOADER_ERROR_STORAGE_BASE + 0x2)
+#define BOOTLOADER_ERROR_STORAGE_NEEDS_ALIGN (BOOTLOADER_ERROR_STORAGE_BASE + 0x4)
+#define BOOTLOADER_ERROR_SECURITY_BASE 0x0B00
+#define BOOTLOADER_ERROR_SECURITY_REJECTED (BOOTLOADER_ERROR_SECURITY_BASE + 0x1)
+
+int32_t bootloader_init(void);
+int32_t bootloader_deinit(void);
+void bootloader_rebootAndInstall(void);
+
+#endif // BTL_INTERFACE_H
@@ -0,0 +1,46 @@
+/******************************************************************************
+ * Host stand-in for the Gecko bootloader storage interface.
+ *****************************************************************************/
+#ifndef BTL_INTERFACE_STORAGE_H
+#define BTL_INTERFACE_STORAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Where host_bootloader.c puts its storage slot, and the erase granularity
+#define HOST_BOOTLOADER_SLOT_SIZE (256 * 1024)
+#define HOST_BOOTLOADER_PAGE_SIZE 4096
+
+typedef struct {
+  uint32_t address;
+  uint32_t length;
+} BootloaderStorageSlot_t;
+
+typedef struct {
+  uint32_t version;
+  uint32_t partSize;
+  uint32_t pageSize;
+  uint32_t wordSizeBytes;
+  uint32_t pageEraseMs;
+  uint32_t partEraseMs;
+} BootloaderStorageFlashInfo_t;
+
+typedef struct {
+  uint32_t version;
+  uint32_t capabilities;
+  BootloaderStorageFlashInfo_t flashInfo;
+  uint32_t numStorageSlots;
+} BootloaderStorageInformation_t;
+
+typedef void (*BootloaderParserCallback_t)(uint32_t address, uint8_t *data, size_t length, void *context);
+
+void bootloader_getStorageInfo(BootloaderStorageInformation_t *info);
+int32_t bootloader_getStorageSlotInfo(uint32_t slotId, BootloaderStorageSlot_t *slot);
+int32_t bootloader_readRawStorage(uint32_t address, uint8_t *buffer, size_t length);
+int32_t bootloader_writeRawStorage(uint32_t address, uint8_t *buffer, size_t length);
+int32_t bootloader_eraseRawStorage(uint32_t address, size_t length);
+int32_t bootloader_writeStorage(uint32_t slotId, uint32_t offset, uint8_t *buffer, size_t length);
+int32_t bootloader_eraseStorageSlot(uint32_t slotId);
+int32_t bootloader_verifyImage(uint32_t slotId, BootloaderParserCallback_t metadataCallback);
+
+#endif // BTL_INTERFACE_STORAGE_H
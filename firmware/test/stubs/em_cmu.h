@@ -0,0 +1,17 @@
+/******************************************************************************
+ * Host stand-in for the Gecko SDK clock management header.
+ *****************************************************************************/
+#ifndef EM_CMU_H
+#define EM_CMU_H
+
+#include "em_device.h"
+
+typedef enum {
+  cmuClock_USART0,
+  cmuClock_USART1,
+  cmuClock_EUART0,
+  cmuClock_I2C0,
+  cmuClock_I2C1,
+} CMU_Clock_TypeDef;
+
+#endif // EM_CMU_H
@@ -0,0 +1,13 @@
+/******************************************************************************
+ * Host stand-in for the Gecko SDK critical section macros.
+ *****************************************************************************/
+#ifndef EM_CORE_H
+#define EM_CORE_H
+
+#define CORE_DECLARE_IRQ_STATE
+#define CORE_ENTER_ATOMIC()
+#define CORE_EXIT_ATOMIC()
+#define CORE_ENTER_CRITICAL()
+#define CORE_EXIT_CRITICAL()
+
+#endif // EM_CORE_H
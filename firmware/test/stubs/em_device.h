@@ -0,0 +1,33 @@
+/******************************************************************************
+ * Host stand-in for the Gecko SDK device header: just enough types for the
+ * firmware headers and drivers built in test/.
+ *****************************************************************************/
+#ifndef EM_DEVICE_H
+#define EM_DEVICE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+  volatile uint32_t CTRL_SET;
+  volatile uint32_t CTRL_CLR;
+  volatile uint32_t CMD;
+} USART_TypeDef;
+
+#define USART_CTRL_LOOPBK_ENABLE 0x00000020UL
+#define USART_CMD_TXTRIEN 0x00000100UL
+#define USART_CMD_TXTRIDIS 0x00000200UL
+
+typedef struct {
+  uint32_t dummy;
+} I2C_TypeDef;
+
+static inline uint8_t SL_RBIT8(uint8_t value)
+{
+  value = (uint8_t)(((value >> 1) & 0x55) | ((value << 1) & 0xAA));
+  value = (uint8_t)(((value >> 2) & 0x33) | ((value << 2) & 0xCC));
+  return (uint8_t)((value >> 4) | (value << 4));
+}
+
+#endif // EM_DEVICE_H
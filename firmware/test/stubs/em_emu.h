@@ -0,0 +1,10 @@
+/******************************************************************************
+ * Host stand-in for the Gecko SDK energy management unit. Sleeping is left to
+ * the test, so it can decide what wakes the core up.
+ *****************************************************************************/
+#ifndef EM_EMU_H
+#define EM_EMU_H
+
+void EMU_EnterEM1(void);
+
+#endif // EM_EMU_H
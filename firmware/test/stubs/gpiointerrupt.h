@@ -0,0 +1,13 @@
+/******************************************************************************
+ * Host stand-in for the Gecko SDK GPIO interrupt dispatcher.
+ *****************************************************************************/
+#ifndef GPIOINTERRUPT_H
+#define GPIOINTERRUPT_H
+
+#include <stdint.h>
+
+typedef void (*GPIOINT_IrqCallbackPtrExt_t)(uint8_t intNo, void *ctx);
+
+unsigned int GPIOINT_CallbackRegisterExt(uint8_t pin, GPIOINT_IrqCallbackPtrExt_t callbackPtr, void *callbackCtx);
+
+#endif // GPIOINTERRUPT_H
@@ -0,0 +1,103 @@
+/******************************************************************************
+ * Stand-in for the Gecko bootloader's storage functions on top of the host
+ * flash, for the host builds in test/. Storage slot 0 takes the start of the
+ * flash and the raw storage is all of it. Writes only clear bits and erases
+ * have to cover whole pages, as on the tag's SPI flash, so a write over data
+ * which wasn't erased first shows up as corrupted content.
+ *****************************************************************************/
+#include <string.h>
+#include "btl_interface.h"
+#include "btl_interface_storage.h"
+#include "host_flash.h"
+
+int32_t bootloader_init(void)
+{
+  return BOOTLOADER_OK;
+}
+
+int32_t bootloader_deinit(void)
+{
+  return BOOTLOADER_OK;
+}
+
+void bootloader_rebootAndInstall(void)
+{
+}
+
+void bootloader_getStorageInfo(BootloaderStorageInformation_t *info)
+{
+  memset(info, 0, sizeof(*info));
+  info->flashInfo.partSize = HOST_FLASH_SIZE;
+  info->flashInfo.pageSize = HOST_BOOTLOADER_PAGE_SIZE;
+  info->flashInfo.wordSizeBytes = 1;
+  info->numStorageSlots = 1;
+}
+
+int32_t bootloader_getStorageSlotInfo(uint32_t slotId, BootloaderStorageSlot_t *slot)
+{
+  if(slotId != 0) {
+    return BOOTLOADER_ERROR_STORAGE_INVALID_SLOT;
+  }
+  slot->address = 0;
+  slot->length = HOST_BOOTLOADER_SLOT_SIZE;
+  return BOOTLOADER_OK;
+}
+
+int32_t bootloader_readRawStorage(uint32_t address, uint8_t *buffer, size_t length)
+{
+  if(address > HOST_FLASH_SIZE || length > HOST_FLASH_SIZE - address) {
+    return BOOTLOADER_ERROR_STORAGE_INVALID_ADDRESS;
+  }
+  HAL_flashRead(address, buffer, length);
+  return BOOTLOADER_OK;
+}
+
+int32_t bootloader_writeRawStorage(uint32_t address, uint8_t *buffer, size_t length)
+{
+  if(address > HOST_FLASH_SIZE || length > HOST_FLASH_SIZE - address) {
+    return BOOTLOADER_ERROR_STORAGE_INVALID_ADDRESS;
+  }
+  host_flash_program(address, buffer, length);
+  return BOOTLOADER_OK;
+}
+
+int32_t bootloader_eraseRawStorage(uint32_t address, size_t length)
+{
+  if(address > HOST_FLASH_SIZE || length > HOST_FLASH_SIZE - address) {
+    return BOOTLOADER_ERROR_STORAGE_INVALID_ADDRESS;
+  }
+  if(address % HOST_BOOTLOADER_PAGE_SIZE != 0 || length % HOST_BOOTLOADER_PAGE_SIZE != 0) {
+    return BOOTLOADER_ERROR_STORAGE_NEEDS_ALIGN;
+  }
+  host_flash_erase(address, length);
+  return BOOTLOADER_OK;
+}
+
+int32_t bootloader_writeStorage(uint32_t slotId, uint32_t offset, uint8_t *buffer, size_t length)
+{
+  if(slotId != 0) {
+    return BOOTLOADER_ERROR_STORAGE_INVALID_SLOT;
+  }
+  if(offset > HOST_BOOTLOADER_SLOT_SIZE || length > HOST_BOOTLOADER_SLOT_SIZE - offset) {
+    return BOOTLOADER_ERROR_STORAGE_INVALID_ADDRESS;
+  }
+  host_flash_program(offset, buffer, length);
+  return BOOTLOADER_OK;
+}
+
+int32_t bootloader_eraseStorageSlot(uint32_t slotId)
+{
+  if(slotId != 0) {
+    return BOOTLOADER_ERROR_STORAGE_INVALID_SLOT;
+  }
+  host_flash_erase(0, HOST_BOOTLOADER_SLOT_SIZE);
+  return BOOTLOADER_OK;
+}
+
+// There's no image parser on the host, the slot never holds a valid image
+int32_t bootloader_verifyImage(uint32_t slotId, BootloaderParserCallback_t metadataCallback)
+{
+  (void) slotId;
+  (void) metadataCallback;
+  return BOOTLOADER_ERROR_SECURITY_REJECTED;
+}
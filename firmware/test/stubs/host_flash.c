@@ -0,0 +1,94 @@
+/******************************************************************************
+ * RAM-backed stand-in for oepl_flash_driver.c, for the host builds in test/.
+ * Counts reads the same way, there is no cache so every page is a miss.
+ *****************************************************************************/
+#include <string.h>
+#include "host_flash.h"
+
+static uint8_t flash[HOST_FLASH_SIZE];
+static oepl_flash_stats_t stats;
+static int session_depth = 0;
+
+void host_flash_write(uint32_t address, const void* data, size_t length)
+{
+  if(address >= HOST_FLASH_SIZE || length > HOST_FLASH_SIZE - address) {
+    return;
+  }
+  memcpy(&flash[address], data, length);
+}
+
+void host_flash_reset(void)
+{
+  memset(flash, 0xFF, sizeof(flash));
+  memset(&stats, 0, sizeof(stats));
+}
+
+void host_flash_program(uint32_t address, const void* data, size_t length)
+{
+  if(address >= HOST_FLASH_SIZE || length > HOST_FLASH_SIZE - address) {
+    return;
+  }
+  const uint8_t* bytes = data;
+  for(size_t i = 0; i < length; i++) {
+    flash[address + i] &= bytes[i];
+  }
+}
+
+void host_flash_erase(uint32_t address, size_t length)
+{
+  if(address >= HOST_FLASH_SIZE || length > HOST_FLASH_SIZE - address) {
+    return;
+  }
+  memset(&flash[address], 0xFF, length);
+}
+
+uint32_t HAL_flashRead(uint32_t address, uint8_t *buffer, uint32_t num)
+{
+  if(session_depth == 0) {
+    stats.spi_opens++;
+  }
+  stats.reads++;
+  stats.bytes_read += num;
+  for(uint32_t i = 0; i < num; i++) {
+    buffer[i] = (address + i) < HOST_FLASH_SIZE ? flash[address + i] : 0xFF;
+  }
+  return num;
+}
+
+void oepl_flash_session_begin(void)
+{
+  if(session_depth++ == 0) {
+    stats.spi_opens++;
+  }
+}
+
+void oepl_flash_session_end(void)
+{
+  if(session_depth > 0) {
+    session_depth--;
+  }
+}
+
+void oepl_flash_session_suspend(void)
+{
+}
+
+void oepl_flash_cache_enable(void)
+{
+}
+
+void oepl_flash_cache_invalidate(uint32_t address, uint32_t length)
+{
+  (void) address;
+  (void) length;
+}
+
+void oepl_flash_get_stats(oepl_flash_stats_t* s)
+{
+  *s = stats;
+}
+
+void oepl_flash_reset_stats(void)
+{
+  memset(&stats, 0, sizeof(stats));
+}
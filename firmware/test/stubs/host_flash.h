@@ -0,0 +1,31 @@
+/******************************************************************************
+ * RAM-backed stand-in for the external flash, for the host builds in test/.
+ *****************************************************************************/
+#ifndef HOST_FLASH_H
+#define HOST_FLASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "oepl_flash_driver.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HOST_FLASH_SIZE (1024 * 1024)
+
+// Store data at the given flash address
+void host_flash_write(uint32_t address, const void* data, size_t length);
+// Erase the whole flash to 0xFF and clear the statistics
+void host_flash_reset(void);
+// Program data at the given flash address the way NOR flash does: bits can only
+// be cleared, so writing over data which wasn't erased leaves the AND of both
+void host_flash_program(uint32_t address, const void* data, size_t length);
+// Erase a range of the flash to 0xFF
+void host_flash_erase(uint32_t address, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_FLASH_H
@@ -0,0 +1,169 @@
+/******************************************************************************
+ * RAM-backed stand-in for the Gecko SDK NVM3 driver, for the host builds in
+ * test/. Objects keep their contents until host_nvm3_reset(), so a test can
+ * drop the firmware's RAM state and boot it again on the same NVM3 contents.
+ *****************************************************************************/
+#include <stdbool.h>
+#include <string.h>
+#include "nvm3.h"
+#include "nvm3_default.h"
+
+// Same limits as the default NVM3 configuration on the tag
+#define HOST_NVM3_MAX_OBJECTS 64
+#define HOST_NVM3_MAX_OBJECT_SIZE 254
+
+typedef struct {
+  bool used;
+  nvm3_ObjectKey_t key;
+  uint32_t type;
+  size_t len;
+  uint8_t data[HOST_NVM3_MAX_OBJECT_SIZE];
+  uint32_t counter;
+  size_t writes;
+} host_nvm3_object_t;
+
+struct nvm3_Handle {
+  host_nvm3_object_t objects[HOST_NVM3_MAX_OBJECTS];
+};
+
+static nvm3_Handle_t default_instance;
+nvm3_Handle_t *nvm3_defaultHandle = &default_instance;
+
+static host_nvm3_object_t* find_object(nvm3_Handle_t *h, nvm3_ObjectKey_t key)
+{
+  for(size_t i = 0; i < HOST_NVM3_MAX_OBJECTS; i++) {
+    if(h->objects[i].used && h->objects[i].key == key) {
+      return &h->objects[i];
+    }
+  }
+  return NULL;
+}
+
+static host_nvm3_object_t* create_object(nvm3_Handle_t *h, nvm3_ObjectKey_t key, uint32_t type)
+{
+  host_nvm3_object_t *object = find_object(h, key);
+  if(object == NULL) {
+    for(size_t i = 0; i < HOST_NVM3_MAX_OBJECTS && object == NULL; i++) {
+      if(!h->objects[i].used) {
+        object = &h->objects[i];
+        object->writes = 0;
+      }
+    }
+    if(object == NULL) {
+      return NULL;
+    }
+  }
+  object->used = true;
+  object->key = key;
+  object->type = type;
+  object->writes++;
+  return object;
+}
+
+Ecode_t nvm3_readData(nvm3_Handle_t *h, nvm3_ObjectKey_t key, void *value, size_t len)
+{
+  host_nvm3_object_t *object = find_object(h, key);
+  if(object == NULL) {
+    return ECODE_NVM3_ERR_KEY_NOT_FOUND;
+  }
+  if(object->type != NVM3_OBJECTTYPE_DATA) {
+    return ECODE_NVM3_ERR_OBJECT_IS_NOT_DATA;
+  }
+  if(len > object->len) {
+    return ECODE_NVM3_ERR_READ_DATA_SIZE;
+  }
+  memcpy(value, object->data, len);
+  return ECODE_NVM3_OK;
+}
+
+Ecode_t nvm3_writeData(nvm3_Handle_t *h, nvm3_ObjectKey_t key, const void *value, size_t len)
+{
+  if(len > HOST_NVM3_MAX_OBJECT_SIZE) {
+    return ECODE_NVM3_ERR_WRITE_DATA_SIZE;
+  }
+  host_nvm3_object_t *object = create_object(h, key, NVM3_OBJECTTYPE_DATA);
+  if(object == NULL) {
+    return ECODE_NVM3_ERR_STORAGE_FULL;
+  }
+  memcpy(object->data, value, len);
+  object->len = len;
+  return ECODE_NVM3_OK;
+}
+
+Ecode_t nvm3_deleteObject(nvm3_Handle_t *h, nvm3_ObjectKey_t key)
+{
+  host_nvm3_object_t *object = find_object(h, key);
+  if(object == NULL) {
+    return ECODE_NVM3_ERR_KEY_NOT_FOUND;
+  }
+  object->used = false;
+  return ECODE_NVM3_OK;
+}
+
+Ecode_t nvm3_getObjectInfo(nvm3_Handle_t *h, nvm3_ObjectKey_t key, uint32_t *type, size_t *len)
+{
+  host_nvm3_object_t *object = find_object(h, key);
+  if(object == NULL) {
+    return ECODE_NVM3_ERR_KEY_NOT_FOUND;
+  }
+  *type = object->type;
+  *len = object->type == NVM3_OBJECTTYPE_DATA ? object->len : sizeof(uint32_t);
+  return ECODE_NVM3_OK;
+}
+
+Ecode_t nvm3_readCounter(nvm3_Handle_t *h, nvm3_ObjectKey_t key, uint32_t *value)
+{
+  host_nvm3_object_t *object = find_object(h, key);
+  if(object == NULL) {
+    return ECODE_NVM3_ERR_KEY_NOT_FOUND;
+  }
+  if(object->type != NVM3_OBJECTTYPE_COUNTER) {
+    return ECODE_NVM3_ERR_OBJECT_IS_NOT_A_COUNTER;
+  }
+  *value = object->counter;
+  return ECODE_NVM3_OK;
+}
+
+Ecode_t nvm3_writeCounter(nvm3_Handle_t *h, nvm3_ObjectKey_t key, uint32_t value)
+{
+  host_nvm3_object_t *object = create_object(h, key, NVM3_OBJECTTYPE_COUNTER);
+  if(object == NULL) {
+    return ECODE_NVM3_ERR_STORAGE_FULL;
+  }
+  object->counter = value;
+  return ECODE_NVM3_OK;
+}
+
+Ecode_t nvm3_incrementCounter(nvm3_Handle_t *h, nvm3_ObjectKey_t key, uint32_t *newValue)
+{
+  host_nvm3_object_t *object = find_object(h, key);
+  if(object == NULL) {
+    return ECODE_NVM3_ERR_KEY_NOT_FOUND;
+  }
+  if(object->type != NVM3_OBJECTTYPE_COUNTER) {
+    return ECODE_NVM3_ERR_OBJECT_IS_NOT_A_COUNTER;
+  }
+  object->writes++;
+  object->counter++;
+  if(newValue != NULL) {
+    *newValue = object->counter;
+  }
+  return ECODE_NVM3_OK;
+}
+
+Ecode_t nvm3_eraseAll(nvm3_Handle_t *h)
+{
+  memset(h, 0, sizeof(*h));
+  return ECODE_NVM3_OK;
+}
+
+void host_nvm3_reset(void)
+{
+  nvm3_eraseAll(nvm3_defaultHandle);
+}
+
+size_t host_nvm3_write_count(nvm3_ObjectKey_t key)
+{
+  host_nvm3_object_t *object = find_object(nvm3_defaultHandle, key);
+  return object != NULL ? object->writes : 0;
+}
@@ -0,0 +1,139 @@
+/******************************************************************************
+ * No-op stand-ins for the Gecko SDK and hardware abstraction calls made by the
+ * drivers built in test/. Timers never fire and pins read back as low.
+ *****************************************************************************/
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "em_gpio.h"
+#include "gpiointerrupt.h"
+#include "sl_power_manager.h"
+#include "sl_sleeptimer.h"
+#include "sl_udelay.h"
+#include "oepl_hw_abstraction.h"
+
+void GPIO_PinModeSet(GPIO_Port_TypeDef port, unsigned int pin, GPIO_Mode_TypeDef mode, unsigned int out)
+{
+  (void) port;
+  (void) pin;
+  (void) mode;
+  (void) out;
+}
+
+void GPIO_PinOutSet(GPIO_Port_TypeDef port, unsigned int pin)
+{
+  (void) port;
+  (void) pin;
+}
+
+void GPIO_PinOutClear(GPIO_Port_TypeDef port, unsigned int pin)
+{
+  (void) port;
+  (void) pin;
+}
+
+void GPIO_PinOutToggle(GPIO_Port_TypeDef port, unsigned int pin)
+{
+  (void) port;
+  (void) pin;
+}
+
+unsigned int GPIO_PinInGet(GPIO_Port_TypeDef port, unsigned int pin)
+{
+  (void) port;
+  (void) pin;
+  return 0;
+}
+
+void GPIO_ExtIntConfig(GPIO_Port_TypeDef port, unsigned int pin, unsigned int intNo, bool risingEdge, bool fallingEdge, bool enable)
+{
+  (void) port;
+  (void) pin;
+  (void) intNo;
+  (void) risingEdge;
+  (void) fallingEdge;
+  (void) enable;
+}
+
+void GPIO_IntClear(uint32_t flags)
+{
+  (void) flags;
+}
+
+void GPIO_IntEnable(uint32_t flags)
+{
+  (void) flags;
+}
+
+void GPIO_IntDisable(uint32_t flags)
+{
+  (void) flags;
+}
+
+unsigned int GPIOINT_CallbackRegisterExt(uint8_t pin, GPIOINT_IrqCallbackPtrExt_t callbackPtr, void *callbackCtx)
+{
+  (void) callbackPtr;
+  (void) callbackCtx;
+  return pin;
+}
+
+void sl_power_manager_add_em_requirement(sl_power_manager_em_t em)
+{
+  (void) em;
+}
+
+void sl_power_manager_remove_em_requirement(sl_power_manager_em_t em)
+{
+  (void) em;
+}
+
+void sl_power_manager_sleep(void)
+{
+}
+
+sl_status_t sl_sleeptimer_start_timer_ms(sl_sleeptimer_timer_handle_t *handle, uint32_t timeout_ms, sl_sleeptimer_timer_callback_t callback, void *callback_data, uint8_t priority, uint16_t option_flags)
+{
+  (void) timeout_ms;
+  (void) priority;
+  (void) option_flags;
+  handle->callback = callback;
+  handle->data = callback_data;
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_sleeptimer_restart_timer_ms(sl_sleeptimer_timer_handle_t *handle, uint32_t timeout_ms, sl_sleeptimer_timer_callback_t callback, void *callback_data, uint8_t priority, uint16_t option_flags)
+{
+  return sl_sleeptimer_start_timer_ms(handle, timeout_ms, callback, callback_data, priority, option_flags);
+}
+
+sl_status_t sl_sleeptimer_stop_timer(sl_sleeptimer_timer_handle_t *handle)
+{
+  (void) handle;
+  return SL_STATUS_OK;
+}
+
+uint32_t sl_sleeptimer_get_tick_count(void)
+{
+  return 0;
+}
+
+uint32_t sl_sleeptimer_tick_to_ms(uint32_t tick)
+{
+  return tick;
+}
+
+void sl_udelay_wait(unsigned us)
+{
+  (void) us;
+}
+
+void oepl_hw_crash(oepl_hw_debug_module_t module, bool reboot, const char* fmt, ...)
+{
+  (void) module;
+  (void) reboot;
+  va_list args;
+  va_start(args, fmt);
+  vprintf(fmt, args);
+  va_end(args);
+  abort();
+}
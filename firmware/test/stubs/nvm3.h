@@ -0,0 +1,40 @@
+/******************************************************************************
+ * Host stand-in for the Gecko SDK NVM3 driver: data and counter objects kept
+ * in RAM by host_nvm3.c, with the status codes the firmware checks for.
+ *****************************************************************************/
+#ifndef NVM3_H
+#define NVM3_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sl_status.h"
+
+#define ECODE_NVM3_OK 0
+#define ECODE_NVM3_ERR_KEY_NOT_FOUND 0xF000000FUL
+#define ECODE_NVM3_ERR_OBJECT_IS_NOT_DATA 0xF0000010UL
+#define ECODE_NVM3_ERR_OBJECT_IS_NOT_A_COUNTER 0xF0000011UL
+#define ECODE_NVM3_ERR_STORAGE_FULL 0xF0000006UL
+#define ECODE_NVM3_ERR_WRITE_DATA_SIZE 0xF000000CUL
+#define ECODE_NVM3_ERR_READ_DATA_SIZE 0xF000000EUL
+
+#define NVM3_OBJECTTYPE_DATA 0
+#define NVM3_OBJECTTYPE_COUNTER 1
+
+typedef uint32_t nvm3_ObjectKey_t;
+typedef struct nvm3_Handle nvm3_Handle_t;
+
+Ecode_t nvm3_readData(nvm3_Handle_t *h, nvm3_ObjectKey_t key, void *value, size_t len);
+Ecode_t nvm3_writeData(nvm3_Handle_t *h, nvm3_ObjectKey_t key, const void *value, size_t len);
+Ecode_t nvm3_deleteObject(nvm3_Handle_t *h, nvm3_ObjectKey_t key);
+Ecode_t nvm3_getObjectInfo(nvm3_Handle_t *h, nvm3_ObjectKey_t key, uint32_t *type, size_t *len);
+Ecode_t nvm3_readCounter(nvm3_Handle_t *h, nvm3_ObjectKey_t key, uint32_t *value);
+Ecode_t nvm3_writeCounter(nvm3_Handle_t *h, nvm3_ObjectKey_t key, uint32_t value);
+Ecode_t nvm3_incrementCounter(nvm3_Handle_t *h, nvm3_ObjectKey_t key, uint32_t *newValue);
+Ecode_t nvm3_eraseAll(nvm3_Handle_t *h);
+
+// Drop every object, like a blank NVM3 area
+void host_nvm3_reset(void);
+// Number of times the object was written since it was created, 0 if it doesn't exist
+size_t host_nvm3_write_count(nvm3_ObjectKey_t key);
+
+#endif // NVM3_H
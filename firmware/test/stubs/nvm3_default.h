@@ -0,0 +1,11 @@
+/******************************************************************************
+ * Host stand-in for the Gecko SDK default NVM3 instance.
+ *****************************************************************************/
+#ifndef NVM3_DEFAULT_H
+#define NVM3_DEFAULT_H
+
+#include "nvm3.h"
+
+extern nvm3_Handle_t *nvm3_defaultHandle;
+
+#endif // NVM3_DEFAULT_H
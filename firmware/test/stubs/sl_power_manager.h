@@ -0,0 +1,17 @@
+/******************************************************************************
+ * Host stand-in for the Gecko SDK power manager.
+ *****************************************************************************/
+#ifndef SL_POWER_MANAGER_H
+#define SL_POWER_MANAGER_H
+
+typedef enum {
+  SL_POWER_MANAGER_EM0,
+  SL_POWER_MANAGER_EM1,
+  SL_POWER_MANAGER_EM2,
+} sl_power_manager_em_t;
+
+void sl_power_manager_add_em_requirement(sl_power_manager_em_t em);
+void sl_power_manager_remove_em_requirement(sl_power_manager_em_t em);
+void sl_power_manager_sleep(void);
+
+#endif // SL_POWER_MANAGER_H
@@ -0,0 +1,25 @@
+/******************************************************************************
+ * Host stand-in for the Gecko SDK sleeptimer, timers never fire.
+ *****************************************************************************/
+#ifndef SL_SLEEPTIMER_H
+#define SL_SLEEPTIMER_H
+
+#include <stdint.h>
+#include "sl_status.h"
+
+#define SL_SLEEPTIMER_NO_HIGH_PRECISION_HF_CLOCKS_REQUIRED_FLAG 0x01
+
+typedef struct sl_sleeptimer_timer_handle sl_sleeptimer_timer_handle_t;
+typedef void (*sl_sleeptimer_timer_callback_t)(sl_sleeptimer_timer_handle_t *handle, void *data);
+struct sl_sleeptimer_timer_handle {
+  sl_sleeptimer_timer_callback_t callback;
+  void *data;
+};
+
+sl_status_t sl_sleeptimer_start_timer_ms(sl_sleeptimer_timer_handle_t *handle, uint32_t timeout_ms, sl_sleeptimer_timer_callback_t callback, void *callback_data, uint8_t priority, uint16_t option_flags);
+sl_status_t sl_sleeptimer_restart_timer_ms(sl_sleeptimer_timer_handle_t *handle, uint32_t timeout_ms, sl_sleeptimer_timer_callback_t callback, void *callback_data, uint8_t priority, uint16_t option_flags);
+sl_status_t sl_sleeptimer_stop_timer(sl_sleeptimer_timer_handle_t *handle);
+uint32_t sl_sleeptimer_get_tick_count(void);
+uint32_t sl_sleeptimer_tick_to_ms(uint32_t tick);
+
+#endif // SL_SLEEPTIMER_H
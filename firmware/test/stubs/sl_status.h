@@ -0,0 +1,15 @@
+/******************************************************************************
+ * Host stand-in for the Gecko SDK status codes.
+ *****************************************************************************/
+#ifndef SL_STATUS_H
+#define SL_STATUS_H
+
+#include <stdint.h>
+
+typedef uint32_t sl_status_t;
+typedef uint32_t Ecode_t;
+
+#define SL_STATUS_OK 0
+#define ECODE_OK 0
+
+#endif // SL_STATUS_H
@@ -0,0 +1,11 @@
+/******************************************************************************
+ * Host stand-in for the Gecko SDK microsecond delay.
+ *****************************************************************************/
+#ifndef SL_UDELAY_H
+#define SL_UDELAY_H
+
+#include <stdint.h>
+
+void sl_udelay_wait(unsigned us);
+
+#endif // SL_UDELAY_H
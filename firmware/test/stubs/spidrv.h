@@ -0,0 +1,51 @@
+/******************************************************************************
+ * Host stand-in for the Gecko SDK SPI driver. The transfer functions are left
+ * to the test, so it can decide what a transfer costs.
+ *****************************************************************************/
+#ifndef SPIDRV_H
+#define SPIDRV_H
+
+#include <stdint.h>
+#include "sl_status.h"
+#include "em_gpio.h"
+
+#define ECODE_EMDRV_SPIDRV_OK ECODE_OK
+#define ECODE_EMDRV_SPIDRV_BUSY 0x0003
+#define ECODE_EMDRV_SPIDRV_ABORTED 0x0007
+
+typedef enum {
+  spidrvCsControlAuto,
+  spidrvCsControlApplication,
+} SPIDRV_CsControl_t;
+
+typedef struct {
+  USART_TypeDef *port;
+  GPIO_Port_TypeDef portTx;
+  GPIO_Port_TypeDef portRx;
+  GPIO_Port_TypeDef portClk;
+  GPIO_Port_TypeDef portCs;
+  uint8_t pinTx;
+  uint8_t pinRx;
+  uint8_t pinClk;
+  uint8_t pinCs;
+  uint32_t bitRate;
+  SPIDRV_CsControl_t csControl;
+} SPIDRV_Init_t;
+
+struct SPIDRV_HandleData;
+typedef void (*SPIDRV_Callback_t)(struct SPIDRV_HandleData *handle, Ecode_t transferStatus, int itemsTransferred);
+
+typedef struct SPIDRV_HandleData {
+  SPIDRV_Init_t initData;
+} SPIDRV_HandleData_t;
+typedef SPIDRV_HandleData_t *SPIDRV_Handle_t;
+
+#define SPIDRV_MASTER_DEFAULT { .bitRate = 1000000, .csControl = spidrvCsControlAuto }
+
+Ecode_t SPIDRV_Init(SPIDRV_Handle_t handle, SPIDRV_Init_t *initData);
+Ecode_t SPIDRV_DeInit(SPIDRV_Handle_t handle);
+Ecode_t SPIDRV_MTransmit(SPIDRV_Handle_t handle, const void *buffer, int count, SPIDRV_Callback_t callback);
+Ecode_t SPIDRV_MTransmitB(SPIDRV_Handle_t handle, const void *buffer, int count);
+Ecode_t SPIDRV_MTransferB(SPIDRV_Handle_t handle, const void *txBuffer, void *rxBuffer, int count);
+
+#endif // SPIDRV_H
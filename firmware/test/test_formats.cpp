@@ -0,0 +1,147 @@
+/******************************************************************************
+ * Golden tests for the image formats that only exist as decoders so far:
+ * zlib with interleaved plane rows (DATATYPE_IMG_ZLIB_INTERLEAVED) and the
+ * run-length coded 1bpp format (DATATYPE_IMG_RLE_1BPP). Heatshrink is covered
+ * by bench_codec.
+ *
+ * The typical screens from test_images.h are encoded in each format and drawn
+ * from flash, front to back and back to front, and every line is checked
+ * against the rendered image. Interleaved images are also transcoded to the
+ * raw layout and compared.
+ *****************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "oepl_drawing.hpp"
+#include "oepl_compression.hpp"
+#include "oepl-definitions.h"
+#include "test_images.h"
+#include "bench.h"
+
+// Header, then the B/W and R/Y row of every line after each other
+static std::vector<uint8_t> interleaveRows(const frame &f, const std::vector<uint8_t> &raw) {
+    uint16_t lineBytes = f.width / 8;
+    uint32_t planeBytes = lineBytes * f.height;
+    std::vector<uint8_t> out(raw.begin(), raw.begin() + IMAGE_HEADER_SIZE);
+    for (uint16_t y = 0; y < f.height; y++) {
+        const uint8_t *bw = &raw[IMAGE_HEADER_SIZE + (y * lineBytes)];
+        out.insert(out.end(), bw, bw + lineBytes);
+        out.insert(out.end(), bw + planeBytes, bw + planeBytes + lineBytes);
+    }
+    return out;
+}
+
+static void putVarint(std::vector<uint8_t> &out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(value);
+}
+
+// Header with bpp 1, the row offset table, then white and black runs per row of the B/W plane
+static std::vector<uint8_t> encodeRle(const frame &f, const std::vector<uint8_t> &raw) {
+    uint16_t lineBytes = f.width / 8;
+    std::vector<uint8_t> out(raw.begin(), raw.begin() + IMAGE_HEADER_SIZE);
+    out[5] = 1;
+    size_t table = out.size();
+    out.resize(table + (f.height * sizeof(uint32_t)));
+    size_t rows = out.size();
+
+    for (uint16_t y = 0; y < f.height; y++) {
+        uint32_t offset = out.size() - rows;
+        memcpy(&out[table + (y * sizeof(uint32_t))], &offset, sizeof(offset));
+        const uint8_t *bw = &raw[IMAGE_HEADER_SIZE + (y * lineBytes)];
+        bool black = false;
+        uint32_t run = 0;
+        for (uint16_t x = 0; x < f.width; x++) {
+            bool pixel = bw[x / 8] & (0x80 >> (x % 8));
+            if (pixel != black) {
+                putVarint(out, run);
+                black = pixel;
+                run = 0;
+            }
+            run++;
+        }
+        putVarint(out, run);
+    }
+    return out;
+}
+
+static uint32_t storeRaw(const std::vector<uint8_t> &data) {
+    host_flash_reset();
+    host_flash_write(0, data.data(), data.size());
+    return data.size();
+}
+
+static bool writeRaw(void *ctx, uint32_t offset, const uint8_t *data, size_t length) {
+    std::vector<uint8_t> *out = (std::vector<uint8_t> *)ctx;
+    if (offset + length > out->size()) return false;
+    memcpy(out->data() + offset, data, length);
+    return true;
+}
+
+// Draws the image and checks every line against the planes, bottom to top if mirrored
+static int scanFrame(const frame &f, uint8_t type, uint32_t fileSize, const std::vector<uint8_t> &raw, bool redPlane, bool mirrored) {
+    uint16_t lineBytes = f.width / 8;
+    uint32_t planeBytes = lineBytes * f.height;
+    std::vector<uint8_t> bw(lineBytes), ry(lineBytes);
+
+    C_setDisplayParameters(false, f.width, f.height);
+    C_drawFlashFullscreenImageWithType(0, type, fileSize);
+    for (uint16_t i = 0; i < f.height; i++) {
+        uint16_t y = mirrored ? f.height - 1 - i : i;
+        memset(bw.data(), 0, lineBytes);
+        memset(ry.data(), 0, lineBytes);
+        C_renderDrawLine(bw.data(), y, COLOR_BLACK);
+        C_renderDrawLine(ry.data(), y, COLOR_RED);
+        const uint8_t *expectBw = &raw[IMAGE_HEADER_SIZE + (y * lineBytes)];
+        BENCH_CHECK(memcmp(bw.data(), expectBw, lineBytes) == 0, "%s type 0x%02X: B/W line %d drawn wrong%s", f.name, type, y,
+                    mirrored ? " in the mirrored scan" : "");
+        if (redPlane) {
+            BENCH_CHECK(memcmp(ry.data(), expectBw + planeBytes, lineBytes) == 0, "%s type 0x%02X: R/Y line %d drawn wrong%s", f.name, type, y,
+                        mirrored ? " in the mirrored scan" : "");
+        }
+    }
+    C_flushDrawItems();
+    return 0;
+}
+
+int main(void) {
+    C_setDrawArenaSize(32768);
+    printf("%-20s %10s %10s %10s\n", "image", "zlib", "interleaved", "rle 1bpp");
+    for (const frame &f : frames) {
+        std::vector<uint8_t> raw = renderImage(f);
+
+        codecConfig c = {"zlib w12", CODEC_ZLIB, 12, 0};
+        uint32_t zlibSize = storeImage(c, raw);
+
+        // One stream for both planes
+        std::vector<uint8_t> interleaved = interleaveRows(f, raw);
+        std::vector<uint8_t> stream = compressZlib(interleaved, 12);
+        uint32_t rawSize = raw.size();
+        std::vector<uint8_t> file((uint8_t *)&rawSize, (uint8_t *)&rawSize + sizeof(rawSize));
+        file.insert(file.end(), stream.begin(), stream.end());
+        uint32_t interleavedSize = storeRaw(file);
+        for (bool mirrored : {false, true}) {
+            if (scanFrame(f, DATATYPE_IMG_ZLIB_INTERLEAVED, interleavedSize, raw, true, mirrored)) return 1;
+        }
+
+        // Transcoded, the planes come out stacked
+        std::vector<uint8_t> transcoded(raw.size() - IMAGE_HEADER_SIZE);
+        uint8_t type = DATATYPE_IMG_ZLIB_INTERLEAVED;
+        BENCH_CHECK(C_inflateFlashImage(0, interleavedSize, transcoded.size(), &type, writeRaw, &transcoded), "%s: interleaved transcode failed", f.name);
+        BENCH_CHECK(type == DATATYPE_IMG_RAW_2BPP && memcmp(transcoded.data(), &raw[IMAGE_HEADER_SIZE], transcoded.size()) == 0,
+                    "%s: transcoded interleaved image differs", f.name);
+
+        // The B/W plane on its own
+        uint32_t rleSize = storeRaw(encodeRle(f, raw));
+        for (bool mirrored : {false, true}) {
+            if (scanFrame(f, DATATYPE_IMG_RLE_1BPP, rleSize, raw, false, mirrored)) return 1;
+        }
+
+        printf("%-20s %10u %10u %10u\n", f.name, zlibSize, interleavedSize, rleSize);
+    }
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,198 @@
+/******************************************************************************
+ * Typical tag screens for the host tests, drawn with the drawing engine and
+ * packed as 2bpp images the way the AP sends them, and encoders to store them
+ * in flash compressed. Include after oepl_drawing.hpp and oepl_compression.hpp,
+ * which have no include guards.
+ *****************************************************************************/
+#ifndef TEST_IMAGES_H
+#define TEST_IMAGES_H
+
+#include <string.h>
+#include <vector>
+#include <zlib.h>
+#include "fonts/fonts.h"
+#include "host_flash.h"
+
+#define IMAGE_HEADER_SIZE 6  // header size byte, width, height, bpp
+
+struct frame {
+    const char *name;
+    uint16_t width;
+    uint16_t height;
+    void (*draw)(uint16_t width, uint16_t height);
+};
+
+static void drawPriceTag(uint16_t width, uint16_t height) {
+    C_drawRectangle(0, 0, width, 30, 0, 0, COLOR_RED);
+    C_epdSetFont(&FreeSans9pt7b);
+    C_epdPrintf(6, 6, COLOR_BLACK, ROTATE_0, "Organic whole milk 1L");
+    C_epdSetFont(&FreeSansBold24pt7b);
+    C_epdPrintf(10, 40, COLOR_BLACK, ROTATE_0, "1.29");
+    C_epdSetFont(&FreeSans9pt7b);
+    C_epdPrintf(10, height - 20, COLOR_BLACK, ROTATE_0, "1.29 / L   Art. 4071926");
+    for (uint16_t x = width - 110; x < width - 10; x += 3) {
+        C_drawRectangle(x, 50, 1 + (x % 2), 50, 0, 0, COLOR_BLACK);
+    }
+}
+
+static void drawInfoscreen(uint16_t width, uint16_t height) {
+    C_epdSetFont(&FreeSansBold18pt7b);
+    C_epdPrintf(7, 7, COLOR_BLACK, ROTATE_0, "AP Found");
+    C_epdSetFont(&FreeSans9pt7b);
+    for (uint8_t i = 0; i < 8; i++) {
+        C_epdPrintf(10, 50 + (i * 20), i % 3 ? COLOR_BLACK : COLOR_RED, ROTATE_0, "Line %d: RSSI -%ddBm LQI %d Ch %d", i, 40 + i, 200 - i, 11 + i);
+    }
+    C_drawRectangle(width - 130, 40, 120, 120, 8, 2, COLOR_BLACK);
+    C_addQR(width - 115, 55, 3, 3, "https://openepaperlink.eu/tag/1/%02X/0000028A3B417C90/", 0x26);
+    C_drawCircle(width - 40, height - 40, 25, 0, COLOR_RED);
+}
+
+static void drawSplash(uint16_t width, uint16_t height) {
+    C_epdSetFont(&FreeSansBold24pt7b);
+    C_epdPrintf(10, 10, COLOR_BLACK, ROTATE_0, "OpenEPaperLink");
+    C_epdSetFont(&FreeSansBold18pt7b);
+    C_epdPrintf(15, 60, COLOR_RED, ROTATE_0, "Newton M3 7.5\"");
+    C_epdSetFont(&FreeSans9pt7b);
+    C_epdPrintf(width - 17, 310, COLOR_BLACK, ROTATE_270, "FW: %04X-%s", 0x0027, "dev");
+    C_epdPrintf(10, height - 25, COLOR_BLACK, ROTATE_0, "MAC: 00:00:02:8A:3B:41:7C:90");
+    C_addQR(100, 160, 3, 7, "https://openepaperlink.eu/tag/0/26/0000028A3B417C90/");
+    for (uint16_t r = 20; r < 160; r += 12) {
+        C_drawCircle(580, 280, r, 3, COLOR_BLACK);
+    }
+}
+
+static const frame frames[] = {
+    {"price tag 296x128", 296, 128, drawPriceTag},
+    {"infoscreen 400x300", 400, 300, drawInfoscreen},
+    {"splash 800x480", 800, 480, drawSplash},
+};
+
+// An image as the AP sends it: header size byte, image header, B/W plane, R/Y plane
+static std::vector<uint8_t> renderImage(const frame &f) {
+    uint16_t lineBytes = f.width / 8;
+    uint32_t planeBytes = lineBytes * f.height;
+    std::vector<uint8_t> image(IMAGE_HEADER_SIZE + (2 * planeBytes), 0);
+    image[0] = IMAGE_HEADER_SIZE;
+    image[1] = f.width & 0xFF;
+    image[2] = f.width >> 8;
+    image[3] = f.height & 0xFF;
+    image[4] = f.height >> 8;
+    image[5] = 2;
+
+    C_setDisplayParameters(false, f.width, f.height);
+    f.draw(f.width, f.height);
+    for (uint16_t y = 0; y < f.height; y++) {
+        uint8_t *bw = &image[IMAGE_HEADER_SIZE + (y * lineBytes)];
+        uint8_t *ry = bw + planeBytes;
+        uint8_t *planes[2] = {bw, ry};
+        C_renderDrawLinePlanes(y, planes, 2);
+        // Red wins where both were drawn, B/W set on top of R/Y would be yellow
+        for (uint16_t i = 0; i < lineBytes; i++) bw[i] &= ~ry[i];
+    }
+    C_flushDrawItems();
+    return image;
+}
+
+static std::vector<uint8_t> compressZlib(const std::vector<uint8_t> &raw, uint8_t windowBits) {
+    std::vector<uint8_t> out(compressBound(raw.size()) + 64);
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    deflateInit2(&strm, Z_BEST_COMPRESSION, Z_DEFLATED, windowBits, 9, Z_DEFAULT_STRATEGY);
+    strm.next_in = (Bytef *)raw.data();
+    strm.avail_in = raw.size();
+    strm.next_out = out.data();
+    strm.avail_out = out.size();
+    deflate(&strm, Z_FINISH);
+    out.resize(strm.total_out);
+    deflateEnd(&strm);
+    return out;
+}
+
+
+struct bitWriter {
+    std::vector<uint8_t> &out;
+    uint8_t bits = 0;
+    uint8_t count = 0;
+    void put(uint32_t value, uint8_t width) {
+        while (width--) {
+            bits = (bits << 1) | ((value >> width) & 1);
+            if (++count == 8) {
+                out.push_back(bits);
+                bits = 0;
+                count = 0;
+            }
+        }
+    }
+    void flush() {
+        if (count) out.push_back(bits << (8 - count));
+    }
+};
+
+// Greedy LZSS in the bitstream decompress::unshrink reads, with hash chains to find matches
+static std::vector<uint8_t> compressHeatshrink(const std::vector<uint8_t> &raw, uint8_t windowBits, uint8_t lookaheadBits) {
+    std::vector<uint8_t> out;
+    out.push_back((windowBits << 4) | lookaheadBits);
+    bitWriter writer = {out};
+
+    const size_t window = 1UL << windowBits;
+    const size_t maxLen = 1UL << lookaheadBits;
+    const size_t minLen = ((1 + windowBits + lookaheadBits) / 9) + 1;  // shorter references cost more than literals
+    std::vector<int32_t> head(65536, -1);
+    std::vector<int32_t> prev(raw.size(), -1);
+
+    auto insert = [&](size_t pos) {
+        if (pos + 1 >= raw.size()) return;
+        uint16_t key = (raw[pos] << 8) | raw[pos + 1];
+        prev[pos] = head[key];
+        head[key] = pos;
+    };
+
+    for (size_t i = 0; i < raw.size();) {
+        size_t bestLen = 0, bestDist = 0;
+        if (i + 1 < raw.size()) {
+            int32_t candidate = head[(raw[i] << 8) | raw[i + 1]];
+            for (int steps = 0; candidate >= 0 && i - candidate <= window && steps < 256; steps++) {
+                size_t len = 0;
+                while (len < maxLen && i + len < raw.size() && raw[candidate + len] == raw[i + len]) len++;
+                if (len > bestLen) {
+                    bestLen = len;
+                    bestDist = i - candidate;
+                    if (len == maxLen) break;
+                }
+                candidate = prev[candidate];
+            }
+        }
+
+        if (bestLen >= minLen) {
+            writer.put(0, 1);
+            writer.put(bestDist - 1, windowBits);
+            writer.put(bestLen - 1, lookaheadBits);
+        } else {
+            bestLen = 1;
+            writer.put(1, 1);
+            writer.put(raw[i], 8);
+        }
+        for (size_t k = 0; k < bestLen; k++) insert(i + k);
+        i += bestLen;
+    }
+    writer.flush();
+    return out;
+}
+
+struct codecConfig {
+    const char *name;
+    uint8_t codec;
+    uint8_t windowBits;
+    uint8_t lookaheadBits;  // heatshrink only
+};
+
+static uint32_t storeImage(const codecConfig &c, const std::vector<uint8_t> &raw) {
+    std::vector<uint8_t> stream = (c.codec == CODEC_ZLIB) ? compressZlib(raw, c.windowBits) : compressHeatshrink(raw, c.windowBits, c.lookaheadBits);
+    uint32_t size = raw.size();
+    host_flash_reset();
+    host_flash_write(0, &size, sizeof(size));
+    host_flash_write(4, stream.data(), stream.size());
+    return 4 + stream.size();
+}
+
+#endif
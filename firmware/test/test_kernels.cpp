@@ -0,0 +1,367 @@
+/******************************************************************************
+ * Golden tests and microbenchmarks for the word-wide compositing kernels in
+ * oepl_drawing.cpp, against the byte-at-a-time kernels they replaced. The old
+ * kernels are copied below unchanged apart from their names.
+ *****************************************************************************/
+#include "../oepl_drawing.cpp"
+#include "bench.h"
+
+#define LINE_BYTES 100  // 800 pixels
+#define BENCH_CALLS 200000
+
+// ---- Kernels as they were before the word-wide rewrite ----
+
+static void old_invert_bytes(uint8_t *array, uint16_t length) {
+    for (uint16_t i = 0; i < length; i++) {
+        array[i] ^= 0xFF;  // ^ array[i];
+    }
+}
+
+static void old_and_array(uint8_t *array1, uint8_t *array2, uint16_t length) {
+    for (uint16_t i = 0; i < length; i++) {
+        array1[i] &= array2[i];
+    }
+}
+
+static void old_shiftBytesRight(uint8_t *data, uint8_t shift, uint8_t len) {
+    // Ensure the shift value is within bounds (0 to 7)
+    shift = shift % 8;
+
+    // Handle the case where shift is 0 or len is 0
+    if (shift == 0 || len == 0) {
+        return;
+    }
+
+    // Loop through the array from right to left
+    for (int i = len - 1; i > 0; i--) {
+        // Perform the shift by combining bits from the current byte
+        // and the next byte to its right
+        data[i] = (data[i] >> shift) | (data[i - 1] << (8 - shift));
+    }
+
+    // For the leftmost byte, simply shift it to the right
+    data[0] >>= shift;
+}
+
+static uint8_t old_bitReverse(uint8_t byte) {
+    byte = ((byte >> 1) & 0x55) | ((byte << 1) & 0xAA);
+    byte = ((byte >> 2) & 0x33) | ((byte << 2) & 0xCC);
+    byte = (byte >> 4) | (byte << 4);
+    return byte;
+}
+
+static void old_reverseBytes(uint8_t *src, uint8_t src_len) {
+    // Check for valid input
+    if (src == NULL || src_len == 0) {
+        return;
+    }
+
+    // Reverse the entire source array
+    for (uint8_t i = 0; i < src_len / 2; i++) {
+        uint8_t temp = src[i];
+        src[i] = src[src_len - i - 1];
+        src[src_len - i - 1] = temp;
+    }
+    // Reverse the bits within the bytes
+    for (uint8_t i = 0; i < src_len; i++) {
+        src[i] = old_bitReverse(src[i]);
+    }
+}
+
+static void old_copyWithByteShift(uint8_t *dst, uint8_t *src, uint8_t src_len, uint8_t offset, bool mask) {
+    if (mask) {
+        for (uint8_t i = 0; i < src_len; i++) {
+            dst[i + offset] &= ~(src[i]);
+        }
+    } else {
+        for (uint8_t i = 0; i < src_len; i++) {
+            dst[i + offset] |= src[i];
+        }
+    }
+}
+
+// What addBufferedImage and getXLine did together: widen the sprite row by the
+// sub-byte part of x, shift it there, then OR it in at x / 8
+static void old_composite(uint8_t *line, const uint8_t *src, uint8_t srcBytes, uint16_t x, bool mask) {
+    uint8_t widened[LINE_BYTES + 1] = {0};
+    uint8_t width = ((srcBytes * 8) + (x % 8) + 7) / 8;
+    memcpy(widened, src, srcBytes);
+    old_shiftBytesRight(widened, x % 8, width);
+    old_copyWithByteShift(line, widened, width, x / 8, mask);
+}
+
+// Old plane split in getXLine, for 2bpp images
+static void old_combine(uint8_t *bw, uint8_t *ry, uint8_t c, uint16_t length) {
+    switch (c) {
+        case COLOR_BLACK:
+            old_invert_bytes(ry, length);
+            old_and_array(bw, ry, length);
+            break;
+        case COLOR_RED:
+            old_invert_bytes(bw, length);
+            old_and_array(bw, ry, length);
+            break;
+        case COLOR_YELLOW:
+            old_and_array(bw, ry, length);
+            break;
+    }
+}
+
+// ---- Access to the new kernels ----
+
+struct itemProbe : drawItem {
+    static void copy(drawItem *di, uint8_t *dst, const uint8_t *src, uint8_t len, int16_t offset) {
+        static_cast<itemProbe *>(di)->copyWithBitShift(dst, src, len, offset);
+    }
+};
+
+static void fill(uint8_t *buf, size_t len, uint32_t *seed) {
+    for (size_t i = 0; i < len; i++) buf[i] = bench_rand(seed);
+}
+
+static bool getBit(const uint8_t *buf, int32_t bit) {
+    return buf[bit / 8] & (0x80 >> (bit % 8));
+}
+
+static int testByteKernels(void) {
+    uint32_t seed = 1;
+    uint8_t a[LINE_BYTES + 8], b[LINE_BYTES + 8], ra[LINE_BYTES + 8], rb[LINE_BYTES + 8];
+
+    // Every length and every alignment of the buffer against a word
+    for (uint16_t len = 0; len <= LINE_BYTES; len++) {
+        for (uint8_t align = 0; align < 4; align++) {
+            fill(a, sizeof(a), &seed);
+            fill(b, sizeof(b), &seed);
+            memcpy(ra, a, sizeof(a));
+            memcpy(rb, b, sizeof(b));
+            invert_bytes(a + align, len);
+            old_invert_bytes(ra + align, len);
+            BENCH_CHECK(memcmp(a, ra, sizeof(a)) == 0, "invert_bytes, length %d", len);
+
+            and_array(a + align, b + align, len);
+            old_and_array(ra + align, rb + align, len);
+            BENCH_CHECK(memcmp(a, ra, sizeof(a)) == 0, "and_array, length %d", len);
+
+            if (len <= 255) {
+                drawItem::reverseBytes(a + align, len);
+                old_reverseBytes(ra + align, len);
+                BENCH_CHECK(memcmp(a, ra, sizeof(a)) == 0, "reverseBytes, length %d", len);
+            }
+
+            for (uint8_t c = 0; c < 3; c++) {
+                uint8_t out[LINE_BYTES + 8];
+                memcpy(out, a, sizeof(out));
+                combine_planes(out + align, a + align, b + align, c, len);
+                old_combine(ra + align, rb + align, c, len);
+                BENCH_CHECK(memcmp(out + align, ra + align, len) == 0, "combine_planes, color %d length %d", c, len);
+                memcpy(ra, a, sizeof(a));
+                memcpy(rb, b, sizeof(b));
+            }
+        }
+    }
+    return 0;
+}
+
+static int testTranspose(void) {
+    uint32_t seed = 2;
+    for (int n = 0; n < 10000; n++) {
+        uint8_t in[8], out[8], ref[8] = {0};
+        fill(in, sizeof(in), &seed);
+        transpose8x8(in, out);
+        for (uint8_t i = 0; i < 8; i++) {
+            for (uint8_t j = 0; j < 8; j++) {
+                if (in[j] & (0x80 >> i)) ref[i] |= 0x80 >> j;
+            }
+        }
+        BENCH_CHECK(memcmp(out, ref, sizeof(out)) == 0, "transpose8x8");
+    }
+    return 0;
+}
+
+static int testCopyWithBitShift(void) {
+    uint32_t seed = 3;
+    drawItem item;
+    uint8_t src[LINE_BYTES], line[LINE_BYTES], ref[LINE_BYTES];
+    C_setDisplayParameters(false, LINE_BYTES * 8, 8);
+
+    for (uint8_t mask = 0; mask < 2; mask++) {
+        item.type = mask ? drawItem::DRAW_MASK : drawItem::DRAW_BUFFERED_1BPP;
+        for (uint8_t len = 1; len <= 40; len++) {
+            // Placements the old kernels could handle, fully on the line
+            for (uint16_t x = 0; ((x + 7) / 8) + len <= LINE_BYTES; x++) {
+                fill(src, len, &seed);
+                fill(line, sizeof(line), &seed);
+                memcpy(ref, line, sizeof(line));
+                itemProbe::copy(&item, line, src, len, x);
+                old_composite(ref, src, len, x, mask);
+                BENCH_CHECK(memcmp(line, ref, sizeof(line)) == 0, "copyWithBitShift, mask %d length %d x %d", mask, len, x);
+            }
+
+            // Placements hanging off either end are clipped, checked pixel by pixel
+            for (int16_t x = -(len * 8) - 8; x < LINE_BYTES * 8 + 8; x += 3) {
+                fill(src, len, &seed);
+                fill(line, sizeof(line), &seed);
+                memcpy(ref, line, sizeof(line));
+                itemProbe::copy(&item, line, src, len, x);
+                for (int32_t bit = 0; bit < len * 8; bit++) {
+                    int32_t px = x + bit;
+                    if (px < 0 || px >= LINE_BYTES * 8 || !getBit(src, bit)) continue;
+                    if (mask) {
+                        ref[px / 8] &= ~(0x80 >> (px % 8));
+                    } else {
+                        ref[px / 8] |= 0x80 >> (px % 8);
+                    }
+                }
+                BENCH_CHECK(memcmp(line, ref, sizeof(line)) == 0, "clipped copyWithBitShift, mask %d length %d x %d", mask, len, x);
+            }
+        }
+    }
+    return 0;
+}
+
+// Sprites are stored unshifted now; check the whole path through the draw list
+static int testBufferedImage(void) {
+    uint32_t seed = 4;
+    uint8_t image[4 + (8 * 3)];
+    uint8_t line[LINE_BYTES], ref[LINE_BYTES];
+    C_setDisplayParameters(false, LINE_BYTES * 8, 8);
+
+    for (uint16_t w = 1; w <= 64; w++) {
+        for (uint16_t x = 0; x < 64; x++) {
+            uint8_t widthBytes = (w + 7) / 8;
+            ((uint16_t *)image)[0] = w;
+            ((uint16_t *)image)[1] = 3;
+            fill(image + 4, widthBytes * 3, &seed);
+            C_addBufferedImage(x, 2, COLOR_BLACK, ROTATE_0, image, DRAW_NORMAL);
+            for (uint16_t y = 2; y < 5; y++) {
+                memset(line, 0, sizeof(line));
+                memset(ref, 0, sizeof(ref));
+                C_renderDrawLine(line, y, COLOR_BLACK);
+                old_composite(ref, image + 4 + ((y - 2) * widthBytes), widthBytes, x, false);
+                BENCH_CHECK(memcmp(line, ref, sizeof(line)) == 0, "buffered image, width %d x %d row %d", w, x, y - 2);
+            }
+            C_flushDrawItems();
+        }
+    }
+    return 0;
+}
+
+static void benchmark(void) {
+    static uint8_t a[LINE_BYTES + 8], b[LINE_BYTES + 8], line[LINE_BYTES + 8];
+    uint32_t seed = 5;
+    drawItem item;
+    item.type = drawItem::DRAW_BUFFERED_1BPP;
+    fill(a, sizeof(a), &seed);
+    fill(b, sizeof(b), &seed);
+    C_setDisplayParameters(false, (LINE_BYTES + 8) * 8, 8);
+
+    struct {
+        const char *name;
+        uint64_t oldNs;
+        uint64_t newNs;
+    } results[5];
+    uint64_t start;
+
+#define TIME(slot, what, code)                                   \
+    start = bench_now_ns();                                      \
+    for (uint32_t n = 0; n < BENCH_CALLS; n++) {                 \
+        code;                                                    \
+        __asm__ volatile("" : : "r"(line), "r"(a) : "memory");   \
+    }                                                            \
+    results[slot].what = bench_now_ns() - start;
+
+    results[0].name = "composite, x % 8 = 3";
+    TIME(0, oldNs, old_composite(line, a, LINE_BYTES - 1, 3, false));
+    TIME(0, newNs, itemProbe::copy(&item, line, a, LINE_BYTES - 1, 3));
+    results[1].name = "reverse";
+    TIME(1, oldNs, old_reverseBytes(a, LINE_BYTES));
+    TIME(1, newNs, drawItem::reverseBytes(a, LINE_BYTES));
+    results[2].name = "invert";
+    TIME(2, oldNs, old_invert_bytes(a, LINE_BYTES));
+    TIME(2, newNs, invert_bytes(a, LINE_BYTES));
+    results[3].name = "and";
+    TIME(3, oldNs, old_and_array(a, b, LINE_BYTES));
+    TIME(3, newNs, and_array(a, b, LINE_BYTES));
+    results[4].name = "plane split, black";
+    TIME(4, oldNs, old_combine(a, b, COLOR_BLACK, LINE_BYTES));
+    TIME(4, newNs, combine_planes(line, a, b, COLOR_BLACK, LINE_BYTES));
+#undef TIME
+
+    printf("%-22s %10s %10s   (ns per %d-byte line)\n", "kernel", "byte", "word", LINE_BYTES);
+    for (uint8_t i = 0; i < 5; i++) {
+        printf("%-22s %10.1f %10.1f\n", results[i].name, (double)results[i].oldNs / BENCH_CALLS, (double)results[i].newNs / BENCH_CALLS);
+    }
+}
+
+// The QR code's encoder buffer goes back to the arena, only the module matrix stays for the frame
+static int testQRArena(void) {
+    C_setDisplayParameters(false, 296, 128);
+    for (uint8_t version = 1; version <= 10; version++) {
+        drawMask(0, 0, 8, 8, COLOR_BLACK);
+        size_t before = drawArenaUsed;
+        addQR(10, 10, version, 2, "https://openepaperlink.eu/tag/%d/", version);
+        uint8_t size = (4 * version) + 17;
+        size_t matrix = (((size + 7) / 8) * size + DRAW_ARENA_ALIGN - 1) & ~(size_t)(DRAW_ARENA_ALIGN - 1);
+        BENCH_CHECK(drawArenaUsed - before == matrix, "QR version %d keeps %d bytes in the arena, the matrix is %d", version,
+                    (int)(drawArenaUsed - before), (int)matrix);
+        drawItem::flushDrawItems();
+    }
+    return 0;
+}
+
+static bool pixelSet(const uint8_t *line, uint16_t x) {
+    return line[x / 8] & (0x80 >> (x % 8));
+}
+
+// Corner radii are in pixels: 1 keeps the corner square, 2 takes the corner pixel off and is
+// what C_drawRoundedRectangle draws. A circle of radius r is 2r + 1 pixels across.
+static int testCorners(void) {
+    uint8_t line[LINE_BYTES], ref[LINE_BYTES];
+    C_setDisplayParameters(false, LINE_BYTES * 8, 64);
+
+    for (uint8_t radius = 0; radius <= 2; radius++) {
+        C_drawRectangle(8, 4, 24, 24, radius, 1, COLOR_BLACK);
+        memset(line, 0, sizeof(line));
+        C_renderDrawLine(line, 4, COLOR_BLACK);
+        BENCH_CHECK(pixelSet(line, 8) == (radius < 2) && pixelSet(line, 9) && pixelSet(line, 30) && pixelSet(line, 31) == (radius < 2),
+                    "radius %d: top row of the corners drawn wrong", radius);
+        memset(line, 0, sizeof(line));
+        C_renderDrawLine(line, 5, COLOR_BLACK);
+        BENCH_CHECK(pixelSet(line, 8) && pixelSet(line, 31), "radius %d: second row of the corners drawn wrong", radius);
+        C_flushDrawItems();
+    }
+
+    for (uint16_t y = 4; y < 28; y++) {
+        C_drawRoundedRectangle(8, 4, 24, 24, COLOR_BLACK);
+        memset(line, 0, sizeof(line));
+        C_renderDrawLine(line, y, COLOR_BLACK);
+        C_flushDrawItems();
+        C_drawRectangle(8, 4, 24, 24, 2, 1, COLOR_BLACK);
+        memset(ref, 0, sizeof(ref));
+        C_renderDrawLine(ref, y, COLOR_BLACK);
+        C_flushDrawItems();
+        BENCH_CHECK(memcmp(line, ref, sizeof(line)) == 0, "rounded rectangle differs from radius 2 in row %d", y - 4);
+    }
+
+    for (uint8_t radius = 1; radius <= 10; radius++) {
+        C_drawCircle(32, 32, radius, 0, COLOR_BLACK);
+        memset(line, 0, sizeof(line));
+        C_renderDrawLine(line, 32, COLOR_BLACK);
+        C_flushDrawItems();
+        BENCH_CHECK(pixelSet(line, 32 - radius) && pixelSet(line, 32 + radius) && !pixelSet(line, 31 - radius) && !pixelSet(line, 33 + radius),
+                    "circle of radius %d isn't %d pixels across", radius, (2 * radius) + 1);
+    }
+    return 0;
+}
+
+int main(void) {
+    if (testQRArena()) return 1;
+    if (testCorners()) return 1;
+    if (testByteKernels()) return 1;
+    if (testTranspose()) return 1;
+    if (testCopyWithBitShift()) return 1;
+    if (testBufferedImage()) return 1;
+    benchmark();
+    printf("ok\n");
+    return 0;
+}
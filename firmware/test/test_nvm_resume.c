@@ -0,0 +1,554 @@
+/******************************************************************************
+ * Tests for resuming downloads: the running MD5 and slot bookkeeping in
+ * oepl_nvm.c, and the way oepl_app.c picks a download up again.
+ *
+ * Both files are built as they are, included here so a power cycle can drop
+ * their RAM state. NVM3 is kept in RAM and the bootloader storage functions
+ * work on the host flash, which like the tag's SPI flash can only clear bits:
+ * bytes written over data which wasn't erased come out as the AND of both.
+ * The test plays the radio. It hands out the blocks the application asks
+ * for, streamed to the block sink in flash pages for images and in one buffer
+ * for firmware updates.
+ *
+ * - An image block fails its checksum after it was streamed into flash, and is
+ *   fetched again.
+ * - The tag loses power halfway through an image, with a failed block in flash
+ *   past the progress saved in NVM3, and resumes after booting.
+ * - A firmware update resumes after losing power between two saves of its MD5,
+ *   so checking the file has to fall back to reading it back.
+ *
+ * Each download has to pass the firmware's own MD5 check and leave the file
+ * in flash, and reads flash back only where the running MD5 can't be used.
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_flash.h"
+#include "nvm3.h"
+#include "bench.h"
+
+#define APP_STREAM_IMAGE_BLOCKS 1
+#include "../oepl_nvm.c"
+#undef DPRINTF
+#include "../oepl_app.c"
+
+#define SCREEN_WIDTH 800
+#define SCREEN_HEIGHT 480
+#define SCREEN_BPP 2
+#define IMAGE_SIZE ((20 * 4096) + 1000)
+#define FWU_SIZE ((14 * 4096) + 500)
+#define MAX_FILE_SIZE (IMAGE_SIZE > FWU_SIZE ? IMAGE_SIZE : FWU_SIZE)
+#define STREAM_PAGE_SIZE 256  // as handed to the sink by oepl_radio.c
+
+// -----------------------------------------------------------------------------
+//                      The radio, played by the test
+// -----------------------------------------------------------------------------
+static oepl_radio_event_cb_t radio_cb = NULL;
+static oepl_radio_block_sink_t block_sink = NULL;
+static bool block_requested = false;
+static size_t block_requested_idx = 0;
+static bool acknowledged = false;
+
+void oepl_radio_init(oepl_radio_event_cb_t cb, uint8_t reason, uint8_t channel)
+{
+  (void) reason;
+  (void) channel;
+  radio_cb = cb;
+}
+
+void oepl_radio_process(void)
+{
+}
+
+bool oepl_radio_is_event_pending(void)
+{
+  return false;
+}
+
+oepl_radio_error_t oepl_radio_send_poll_with_reason(uint8_t reason)
+{
+  (void) reason;
+  return SUCCESS;
+}
+
+oepl_radio_error_t oepl_radio_try_roam(void)
+{
+  return SUCCESS;
+}
+
+oepl_radio_error_t oepl_radio_request_datablock(oepl_datablock_descriptor_t db)
+{
+  if(block_requested) {
+    return ERROR;
+  }
+  block_requested = true;
+  block_requested_idx = db.idx;
+  return SUCCESS;
+}
+
+oepl_radio_error_t oepl_radio_release_datablock(void)
+{
+  return SUCCESS;
+}
+
+oepl_radio_error_t oepl_radio_set_block_sink(oepl_radio_block_sink_t sink)
+{
+  block_sink = sink;
+  return SUCCESS;
+}
+
+oepl_radio_error_t oepl_radio_cancel_datablock(void)
+{
+  block_requested = false;
+  return SUCCESS;
+}
+
+oepl_radio_error_t oepl_radio_acknowledge_action(const uint8_t AP_MAC[8], uint16_t AP_PAN)
+{
+  (void) AP_MAC;
+  (void) AP_PAN;
+  acknowledged = true;
+  return SUCCESS;
+}
+
+void oepl_radio_get_rx_stats(size_t* high_water, size_t* dropped)
+{
+  *high_water = 0;
+  *dropped = 0;
+}
+
+// -----------------------------------------------------------------------------
+//                   Hardware the downloads don't touch
+// -----------------------------------------------------------------------------
+void oepl_hw_init(void)
+{
+}
+
+void oepl_hw_init_gpio(oepl_hw_gpio_cb_t cb)
+{
+  (void) cb;
+}
+
+bool oepl_hw_get_voltage(uint16_t* voltage_mv, bool force_measurement)
+{
+  (void) force_measurement;
+  *voltage_mv = 3000;
+  return true;
+}
+
+bool oepl_hw_nfc_write_url(const uint8_t* url_buffer, size_t length)
+{
+  (void) url_buffer;
+  (void) length;
+  return false;
+}
+
+bool oepl_hw_nfc_write_raw(const uint8_t* raw_buffer, size_t length)
+{
+  (void) raw_buffer;
+  (void) length;
+  return false;
+}
+
+uint16_t oepl_hw_get_swversion(void)
+{
+  return 0x0100;
+}
+
+bool oepl_hw_get_screen_properties(size_t* x, size_t* y, size_t* bpp)
+{
+  *x = SCREEN_WIDTH;
+  *y = SCREEN_HEIGHT;
+  *bpp = SCREEN_BPP;
+  return true;
+}
+
+void oepl_hw_enter_deepsleep(void)
+{
+}
+
+void oepl_hw_flash_deepsleep(void)
+{
+}
+
+void oepl_hw_flash_wake(void)
+{
+}
+
+void oepl_hw_reboot(void)
+{
+  printf("FAIL: the application asked for a reboot in state %d\n", current_state);
+  exit(1);
+}
+
+bool oepl_led_flash_sequence(const uint8_t led_data[12])
+{
+  (void) led_data;
+  return true;
+}
+
+void oepl_display_process(void)
+{
+}
+
+bool oepl_display_is_event_pending(void)
+{
+  return false;
+}
+
+void oepl_display_wait_idle(void)
+{
+}
+
+void oepl_display_show_image(size_t img_idx)
+{
+  (void) img_idx;
+}
+
+void oepl_display_image_moved(size_t from_idx, size_t to_idx)
+{
+  (void) from_idx;
+  (void) to_idx;
+}
+
+void oepl_display_show_infoscreen(oepl_display_infoscreen_t screen)
+{
+  (void) screen;
+}
+
+void oepl_display_set_overlay(oepl_display_overlay_t overlay, bool show)
+{
+  (void) overlay;
+  (void) show;
+}
+
+void oepl_display_draw(oepl_display_draw_done_cb_t cb)
+{
+  (void) cb;
+}
+
+bool C_inflateFlashImage(uint32_t addr, uint32_t filesize, uint32_t maxsize, uint8_t *rawtype, C_imageWriter_t writer, void *ctx)
+{
+  (void) addr;
+  (void) filesize;
+  (void) maxsize;
+  (void) rawtype;
+  (void) writer;
+  (void) ctx;
+  return false;
+}
+
+// -----------------------------------------------------------------------------
+//                                 The tag
+// -----------------------------------------------------------------------------
+
+// Everything in RAM is lost, flash and NVM3 keep their contents. The slot size
+// cache in oepl_nvm_get_num_img_slots survives, it's the same after a boot.
+static void power_cycle(void)
+{
+  memset(&devconfig, 0, sizeof(devconfig));
+  memset(&tag_settings, 0, sizeof(tag_settings));
+  memset(&image_hash, 0, sizeof(image_hash));
+  memset(&image_hash_accepted, 0, sizeof(image_hash_accepted));
+  image_progress_unsaved = false;
+  memset(&fwu_hash, 0, sizeof(fwu_hash));
+  fwu_progress_unsaved = false;
+  image_append_idx = 0;
+  image_append_end = 0;
+
+  memset(&data_to_process, 0, sizeof(data_to_process));
+  memset(&datablock_in_progress, 0, sizeof(datablock_in_progress));
+  datablock = NULL;
+  datablock_received = false;
+  datablock_stream_img_idx = 0;
+  datablock_next_request = 0;
+  datablock_requested = false;
+  datablock_request_failures = 0;
+  datablock_retry_waiting = false;
+  transcode_pending = false;
+  current_state = BOOT;
+  stay_awake = false;
+  have_seen_ap = false;
+  event_flags = 0;
+
+  radio_cb = NULL;
+  block_sink = NULL;
+  block_requested = false;
+  acknowledged = false;
+}
+
+// Boots the way oepl_hw_init and the main loop do, up to being associated with an AP
+static int boot(void)
+{
+  BENCH_CHECK(oepl_nvm_init_default() == NVM_SUCCESS, "no device config in NVM3");
+  oepl_app_init();
+  BENCH_CHECK(radio_cb != NULL, "the application didn't start the radio");
+  radio_cb(ASSOCIATED, (const void*) 11);
+  oepl_app_process();
+  BENCH_CHECK(current_state == CONNECTED, "not connected after boot (state %d)", current_state);
+  return 0;
+}
+
+// A tag fresh from the factory: blank flash and NVM3, storage detected through the bootloader
+static int fresh_tag(void)
+{
+  host_flash_reset();
+  host_nvm3_reset();
+  power_cycle();
+  BENCH_CHECK(oepl_nvm_factory_reset(0) == NVM_SUCCESS, "factory reset failed");
+  return boot();
+}
+
+// -----------------------------------------------------------------------------
+//                                Downloads
+// -----------------------------------------------------------------------------
+typedef struct {
+  uint8_t type;
+  uint8_t data[MAX_FILE_SIZE];
+  size_t size;
+  uint64_t md5;
+} test_file_t;
+
+static test_file_t image_a, image_b, fwu;
+
+// No zero bytes, so a write over bytes which weren't erased always shows
+static void make_file(test_file_t* file, uint8_t type, size_t size, uint32_t seed)
+{
+  file->type = type;
+  file->size = size;
+  for(size_t i = 0; i < size; i++) {
+    file->data[i] = (uint8_t) bench_rand(&seed) | 0x01;
+  }
+  MD5Context md5;
+  md5Init(&md5);
+  md5Update(&md5, file->data, size);
+  md5Finalize(&md5);
+  memcpy(&file->md5, md5.digest, sizeof(file->md5));
+}
+
+static size_t blocks_in(const test_file_t* file)
+{
+  return (file->size + 4095) / 4096;
+}
+
+// The AP answers a poll with the file, the application decides where to start
+static int announce(const test_file_t* file)
+{
+  oepl_radio_data_indication_t indication;
+  memset(&indication, 0, sizeof(indication));
+  indication.AP_data.dataVer = file->md5;
+  indication.AP_data.dataSize = file->size;
+  indication.AP_data.dataType = file->type;
+  radio_cb(AP_DATA, &indication);
+  oepl_app_process();
+  BENCH_CHECK(current_state == DOWNLOAD, "file of type 0x%02X not downloaded (state %d)", file->type, current_state);
+  BENCH_CHECK(block_requested, "no block requested for file of type 0x%02X", file->type);
+  return 0;
+}
+
+// Streams the block to the sink a page at a time. A corrupted block gets a byte
+// flipped in every page, the radio finds out once all of it went to the sink.
+static int stream_block(const test_file_t* file, size_t idx, bool corrupt)
+{
+  size_t length = file->size - (idx * 4096) < 4096 ? file->size - (idx * 4096) : 4096;
+  for(size_t offset = 0; offset < length; offset += STREAM_PAGE_SIZE) {
+    uint8_t page[STREAM_PAGE_SIZE];
+    size_t page_size = length - offset < STREAM_PAGE_SIZE ? length - offset : STREAM_PAGE_SIZE;
+    memcpy(page, &file->data[(idx * 4096) + offset], page_size);
+    if(corrupt) {
+      page[page_size / 2] ^= 0xFF;
+    }
+    BENCH_CHECK(block_sink(idx, offset, page, page_size), "sink refused block %zu at offset %zu", idx, offset);
+  }
+  return 0;
+}
+
+// Hands the requested block to the application, after a failed attempt if 'refetch' is set
+static int deliver_block(const test_file_t* file, bool refetch)
+{
+  BENCH_CHECK(block_requested, "no block requested");
+  size_t idx = block_requested_idx;
+  block_requested = false;
+
+  oepl_radio_blockrecv_t block;
+  block.block_index = idx;
+  block.block_size = file->size - (idx * 4096) < 4096 ? file->size - (idx * 4096) : 4096;
+  if(block_sink != NULL) {
+    if(refetch && stream_block(file, idx, true)) {
+      return 1;
+    }
+    if(stream_block(file, idx, false)) {
+      return 1;
+    }
+    block.block_data = NULL;
+  } else {
+    block.block_data = &file->data[idx * 4096];
+  }
+  radio_cb(BLOCK_COMPLETE, &block);
+  oepl_app_process();
+  return 0;
+}
+
+// Delivers blocks until the application confirms the download, failing 'refetch_idx' once
+static int finish_download(const test_file_t* file, size_t refetch_idx)
+{
+  while(current_state == DOWNLOAD) {
+    if(deliver_block(file, block_requested_idx == refetch_idx)) {
+      return 1;
+    }
+  }
+  BENCH_CHECK(current_state == AWAITING_CONFIRMATION && acknowledged, "download of type 0x%02X didn't finish (state %d)", file->type, current_state);
+  return 0;
+}
+
+static int check_image(const test_file_t* file)
+{
+  size_t img_idx, slot_size, num_slots;
+  uint32_t address;
+  oepl_stored_image_hdr_t meta;
+  BENCH_CHECK(oepl_nvm_get_image_by_hash(file->md5, file->size, &img_idx, &meta) == NVM_SUCCESS, "image not in any slot");
+  BENCH_CHECK(meta.is_valid, "image in slot %zu failed its MD5 check", img_idx);
+  BENCH_CHECK(oepl_nvm_get_num_img_slots(&num_slots, &slot_size) == NVM_SUCCESS &&
+              oepl_nvm_get_image_raw_address(img_idx, &address) == NVM_SUCCESS, "no image slots");
+
+  static uint8_t stored[MAX_FILE_SIZE];
+  HAL_flashRead(address, stored, file->size);
+  for(size_t i = 0; i < file->size; i++) {
+    BENCH_CHECK(stored[i] == file->data[i], "image differs in flash at 0x%zx (block %zu): %02X instead of %02X", i, i / 4096, stored[i], file->data[i]);
+  }
+  return 0;
+}
+
+static size_t flash_bytes_read(void)
+{
+  oepl_flash_stats_t stats;
+  oepl_flash_get_stats(&stats);
+  return stats.bytes_read;
+}
+
+// -----------------------------------------------------------------------------
+//                                Scenarios
+// -----------------------------------------------------------------------------
+static int test_refetch(void)
+{
+  if(fresh_tag() || announce(&image_a)) {
+    return 1;
+  }
+  oepl_flash_reset_stats();
+  if(finish_download(&image_a, 5)) {
+    return 1;
+  }
+  // The refetched block went over erased flash, and the running MD5 rewound to before it
+  BENCH_CHECK(flash_bytes_read() == 0, "image MD5 checked by reading back %zu bytes", flash_bytes_read());
+  return check_image(&image_a);
+}
+
+static int test_power_loss(void)
+{
+  if(fresh_tag() || announce(&image_b)) {
+    return 1;
+  }
+  // Progress is saved every NVM_DOWNLOAD_PROGRESS_INTERVAL blocks. Go past that, and lose
+  // power while the next block is being streamed in with a bad checksum.
+  size_t received = NVM_DOWNLOAD_PROGRESS_INTERVAL + 3;
+  while(datablock_in_progress.idx < received) {
+    if(deliver_block(&image_b, false)) {
+      return 1;
+    }
+  }
+  BENCH_CHECK(block_requested && block_requested_idx == received, "block %zu wasn't requested", received);
+  if(stream_block(&image_b, received, true)) {
+    return 1;
+  }
+  power_cycle();
+  if(boot()) {
+    return 1;
+  }
+
+  size_t img_idx, progress;
+  oepl_stored_image_hdr_t meta;
+  BENCH_CHECK(oepl_nvm_get_image_by_hash(image_b.md5, image_b.size, &img_idx, &meta) == NVM_SUCCESS && !meta.is_valid,
+              "unfinished image lost its slot");
+  BENCH_CHECK(oepl_nvm_get_image_progress(img_idx, &progress) == NVM_SUCCESS && progress == NVM_DOWNLOAD_PROGRESS_INTERVAL * 4096,
+              "saved progress is %zu bytes", progress);
+
+  if(announce(&image_b)) {
+    return 1;
+  }
+  BENCH_CHECK(block_requested_idx == NVM_DOWNLOAD_PROGRESS_INTERVAL, "resumed at block %zu", block_requested_idx);
+  oepl_flash_reset_stats();
+  if(finish_download(&image_b, SIZE_MAX)) {
+    return 1;
+  }
+  // Picked up the MD5 saved with the progress, and wrote over an erased tail
+  BENCH_CHECK(flash_bytes_read() == 0, "image MD5 checked by reading back %zu bytes", flash_bytes_read());
+  BENCH_CHECK(oepl_nvm_get_image_progress(img_idx, &progress) == NVM_NOT_FOUND, "finished image kept its progress");
+  return check_image(&image_b);
+}
+
+static int test_fwu_stale_hash(void)
+{
+  // Without a power cycle, the MD5 accumulated during the download is used
+  if(fresh_tag() || announce(&fwu) || finish_download(&fwu, SIZE_MAX)) {
+    return 1;
+  }
+  oepl_flash_reset_stats();
+  BENCH_CHECK(check_fwu_md5() == NVM_SUCCESS, "FWU MD5 mismatch");
+  BENCH_CHECK(flash_bytes_read() == 0, "FWU MD5 checked by reading back %zu bytes", flash_bytes_read());
+
+  // Lose power a few blocks after the MD5 was saved. The download resumes after the last
+  // block written, past the saved MD5.
+  if(fresh_tag() || announce(&fwu)) {
+    return 1;
+  }
+  size_t received = NVM_DOWNLOAD_PROGRESS_INTERVAL + 3;
+  while(datablock_in_progress.idx < received) {
+    if(deliver_block(&fwu, false)) {
+      return 1;
+    }
+  }
+  power_cycle();
+  if(boot() || announce(&fwu)) {
+    return 1;
+  }
+  BENCH_CHECK(block_requested_idx == received, "FWU resumed at block %zu", block_requested_idx);
+  if(finish_download(&fwu, SIZE_MAX)) {
+    return 1;
+  }
+
+  download_hash_t saved;
+  BENCH_CHECK(nvm3_readData(nvm3_defaultHandle, NVM3_OBJECT_ID_FWU_HASH, &saved, sizeof(saved)) == ECODE_NVM3_OK &&
+              saved.length == NVM_DOWNLOAD_PROGRESS_INTERVAL * 4096, "saved FWU MD5 isn't the stale one");
+  oepl_flash_reset_stats();
+  BENCH_CHECK(check_fwu_md5() == NVM_SUCCESS, "FWU MD5 mismatch after resuming");
+  BENCH_CHECK(flash_bytes_read() == fwu.size, "FWU MD5 checked from %zu bytes read back", flash_bytes_read());
+
+  // And the readback does look at the flash
+  uint8_t zero = 0;
+  host_flash_program(fwu.size / 2, &zero, 1);
+  BENCH_CHECK(check_fwu_md5() == NVM_NOT_FOUND, "corrupted FWU passed its MD5 check");
+  return 0;
+}
+
+int main(void)
+{
+  make_file(&image_a, DATATYPE_IMG_ZLIB, IMAGE_SIZE, 1);
+  make_file(&image_b, DATATYPE_IMG_ZLIB, IMAGE_SIZE, 2);
+  make_file(&fwu, DATATYPE_FW_UPDATE, FWU_SIZE, 3);
+  BENCH_CHECK(blocks_in(&image_a) > NVM_DOWNLOAD_PROGRESS_INTERVAL + 4, "image too small to resume");
+
+  if(test_refetch()) {
+    return 1;
+  }
+  printf("refetch after a failed checksum: ok\n");
+  if(test_power_loss()) {
+    return 1;
+  }
+  printf("resume after power loss: ok\n");
+  if(test_fwu_stale_hash()) {
+    return 1;
+  }
+  printf("FWU with a stale MD5: ok\n");
+  printf("ok\n");
+  return 0;
+}